@@ -0,0 +1,153 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Automation.h"
+
+#include <cmath>
+
+namespace {
+
+	// Emits events of one lane, remembers last sent value
+	class LaneRenderer {
+	public:
+		LaneRenderer(const AutomationLane& lane, const AutomationSettings& settings, std::vector<MidiEvent>& midiEvents)
+			: lane(lane),
+			midiEvents(midiEvents),
+			levels(lane.target == AutomationTarget::PitchBend ? 16383.0 : 127.0),
+			step(settings.stepMicroseconds > 0 ? settings.stepMicroseconds : 1),
+			maxError(settings.maxError > 0.5 ? settings.maxError : 0.5)
+		{
+		}
+
+		void RenderSegment(const Breakpoint& from, const Breakpoint& to)
+		{
+			// Breakpoint itself: exact value, whatever error bound is
+			Emit(from.timeMicroseconds, from.value * levels, /*exact*/ true);
+
+			const int64_t duration = to.timeMicroseconds - from.timeMicroseconds;
+			if (duration <= 0)
+			{
+				return;
+			}
+			stats.fixedRateCount += static_cast<uint64_t>((duration + step - 1) / step);
+
+			const double a = from.value * levels;
+			const double b = to.value * levels;
+			switch (from.shape)
+			{
+			case CurveShape::Step:
+				break;
+			case CurveShape::Linear:
+				RenderLinear(from.timeMicroseconds, to.timeMicroseconds, a, b);
+				break;
+			case CurveShape::Smooth:
+				RenderSmooth(from.timeMicroseconds, to.timeMicroseconds, a, b);
+				break;
+			}
+		}
+
+		void RenderLast(const Breakpoint& last)
+		{
+			Emit(last.timeMicroseconds, last.value * levels, /*exact*/ true);
+			++stats.fixedRateCount;
+		}
+
+		AutomationStats stats;
+
+	private:
+		// Value crosses error bound around last sent value at known time:
+		// jump straight there, no sampling in between
+		void RenderLinear(int64_t startTime, int64_t endTime, double a, double b)
+		{
+			if (a == b)
+			{
+				return;
+			}
+			const double duration = static_cast<double>(endTime - startTime);
+			int64_t time = startTime;
+			while (true)
+			{
+				double bound = b > a ? lastValue + maxError : lastValue - maxError;
+				double crossing = static_cast<double>(startTime) + (bound - a) / (b - a) * duration;
+
+				// First grid time strictly after crossing, and after last event
+				int64_t next = (static_cast<int64_t>(std::floor(crossing / static_cast<double>(step))) + 1) * step;
+				time = next > time + step ? next : time + step;
+				if (time >= endTime)
+				{
+					return;
+				}
+				double x = a + (b - a) * static_cast<double>(time - startTime) / duration;
+				Emit(time, x, /*exact*/ false);
+			}
+		}
+
+		void RenderSmooth(int64_t startTime, int64_t endTime, double a, double b)
+		{
+			const double duration = static_cast<double>(endTime - startTime);
+			for (int64_t time = startTime + step; time < endTime; time += step)
+			{
+				double u = static_cast<double>(time - startTime) / duration;
+				double x = a + (b - a) * u * u * (3 - 2 * u);
+				Emit(time, x, /*exact*/ false);
+			}
+		}
+
+		// x: curve value in quantization steps
+		void Emit(int64_t time, double x, bool exact)
+		{
+			++stats.evaluationCount;
+			int32_t value = static_cast<int32_t>(std::lround(x));
+			if (value < 0)
+			{
+				value = 0;
+			}
+			if (value > static_cast<int32_t>(levels))
+			{
+				value = static_cast<int32_t>(levels);
+			}
+			if (sentAny && (value == lastValue || (!exact && std::fabs(x - lastValue) <= maxError)))
+			{
+				return;
+			}
+
+			MidiMessage midiMessage = lane.target == AutomationTarget::PitchBend
+				// 14 bits: Data1 is lower 7 bits, Data2 is upper 7 bits
+				? MidiMessage(static_cast<uint8_t>((PitchBendSignature << 4) | lane.channel),
+					static_cast<uint8_t>(value & 0x7F), static_cast<uint8_t>(value >> 7))
+				: MakeControlChangeMessage(lane.channel, lane.control, static_cast<uint8_t>(value));
+			midiEvents.push_back({ time, midiMessage });
+			++stats.eventCount;
+			lastValue = value;
+			sentAny = true;
+		}
+
+		const AutomationLane& lane;
+		std::vector<MidiEvent>& midiEvents;
+		const double levels;
+		const int64_t step;
+		const double maxError;
+		int32_t lastValue{ 0 };
+		bool sentAny{ false };
+	};
+
+}
+
+AutomationStats RenderAutomation(
+	const AutomationLane& lane,
+	const AutomationSettings& settings,
+	std::vector<MidiEvent>& midiEvents)
+{
+	if (lane.breakpoints.empty())
+	{
+		return {};
+	}
+
+	LaneRenderer renderer(lane, settings, midiEvents);
+	for (size_t i = 0; i + 1 < lane.breakpoints.size(); ++i)
+	{
+		renderer.RenderSegment(lane.breakpoints[i], lane.breakpoints[i + 1]);
+	}
+	renderer.RenderLast(lane.breakpoints.back());
+	return renderer.stats;
+}
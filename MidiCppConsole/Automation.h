@@ -0,0 +1,68 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "Player.h"
+
+#include <cstdint>
+#include <vector>
+
+// Controller automation: volume swells, filter sweeps, pitch glides.
+//
+// Curve is list of breakpoints, values between them follow segment shape.
+// Rendering turns curve into Control Change or Pitch Bend events.
+// Sending curve value every millisecond floods Midi link (31250 baud
+// cable carries about 1000 Control Changes per second, total), and most
+// of those messages repeat previous value: 7-bit controller has only 128 steps.
+// Renderer sends value only when it moved far enough from last sent value,
+// so link carries only messages that change something.
+
+enum class CurveShape : uint8_t {
+	Step,    // Holds value until next breakpoint
+	Linear,  // Straight line to next breakpoint
+	Smooth,  // S-curve to next breakpoint: starts and ends slowly
+};
+
+struct Breakpoint {
+	int64_t timeMicroseconds;
+	double value;                         // 0.0 to 1.0
+	CurveShape shape{ CurveShape::Linear }; // Shape of segment to next breakpoint
+};
+
+enum class AutomationTarget : uint8_t {
+	ControlChange,  // 7 bits, 0 to 127
+	PitchBend,      // 14 bits, 0 to 16383, 8192 is no bend
+};
+
+struct AutomationLane {
+	AutomationTarget target{ AutomationTarget::ControlChange };
+	uint8_t channel{ 0 };   // 4 bits, 0 to 15
+	uint8_t control{ 7 };   // Control Change only. 7 is Channel Volume
+	std::vector<Breakpoint> breakpoints;  // Sorted by time
+};
+
+struct AutomationSettings {
+	// Curve is evaluated on this time grid, no event is closer than this
+	int64_t stepMicroseconds{ 1000 };
+
+	// How far curve may drift from last sent value before new value is sent,
+	// in quantization steps (1/127 for Control Change).
+	// 0.5 sends every change of quantized value; below 0.5 is same as 0.5.
+	double maxError{ 0.5 };
+};
+
+struct AutomationStats {
+	uint64_t eventCount{ 0 };       // Events rendered
+	uint64_t fixedRateCount{ 0 };   // Events at every grid step, for comparison
+	uint64_t evaluationCount{ 0 };  // Curve evaluations: render cost
+};
+
+// Appends lane's events to midiEvents, in time order.
+// Linear segments are solved for time when value crosses error bound,
+// so their cost is per event, not per grid step.
+// Last value of every breakpoint is sent exactly.
+AutomationStats RenderAutomation(
+	const AutomationLane& lane,
+	const AutomationSettings& settings,
+	std::vector<MidiEvent>& midiEvents);
@@ -0,0 +1,1532 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Benchmark.h"
+
+#include "Automation.h"
+#include "DeviceState.h"
+#include "Drums.h"
+#include "Filter.h"
+#include "GeneralMidi.h"
+#include "Generator.h"
+#include "Latency.h"
+#include "Metrics.h"
+#include "MidiOutput.h"
+#include "MidiStream.h"
+#include "Mpe.h"
+#include "Panic.h"
+#include "Pipeline.h"
+#include "Programs.h"
+#include "Player.h"
+#include "Score.h"
+#include "Sequencer.h"
+#include "Trace.h"
+#include "Transcode.h"
+#include "Ump.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+volatile uint64_t benchmarkSink;
+
+void ReportBenchmark(const char* name, uint64_t items, double seconds, uint64_t bytes)
+{
+	double nsPerItem = items > 0 ? seconds * 1e9 / static_cast<double>(items) : 0.0;
+	double itemsPerSecond = seconds > 0 ? static_cast<double>(items) / seconds : 0.0;
+	printf("%-32s %12llu items %10.2f ns/item %14.0f items/s",
+		name, static_cast<unsigned long long>(items), nsPerItem, itemsPerSecond);
+	if (bytes > 0 && seconds > 0)
+	{
+		printf(" %10.1f MB/s", static_cast<double>(bytes) / seconds / (1024.0 * 1024.0));
+	}
+	printf("\n");
+}
+
+namespace {
+
+	// Benchmarks that produce Midi check it first against known answer:
+	// fast code that sends wrong bytes isn't worth timing.
+	// Failed check is printed, and RunBenchmarks returns false.
+	bool benchmarkCheckFailed = false;
+
+	void Check(const char* name, bool passed, const char* what)
+	{
+		if (!passed)
+		{
+			fprintf(stderr, "%s: check failed: %s\n", name, what);
+			benchmarkCheckFailed = true;
+		}
+	}
+
+	void CheckMessages(const char* name, const std::vector<MidiMessage>& actual, const std::vector<MidiMessage>& expected)
+	{
+		for (size_t i = 0; i < actual.size() || i < expected.size(); ++i)
+		{
+			DWORD actualDWord = i < actual.size() ? actual[i].dataDWord : 0;
+			DWORD expectedDWord = i < expected.size() ? expected[i].dataDWord : 0;
+			if (i >= actual.size() || i >= expected.size() || actualDWord != expectedDWord)
+			{
+				fprintf(stderr, "%s: check failed: message %zu of %zu is %06lX, expected %06lX of %zu\n",
+					name, i, actual.size(), static_cast<unsigned long>(actualDWord), static_cast<unsigned long>(expectedDWord), expected.size());
+				benchmarkCheckFailed = true;
+				return;
+			}
+		}
+	}
+
+	//
+	// Send path
+	//
+
+	void BenchmarkSendMemory(uint64_t iterations)
+	{
+		MemoryMidiOutput midiOutput;
+		midiOutput.midiMessages.reserve(iterations);
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			(void)SendMidiNote(midiOutput, static_cast<uint8_t>(i & 0xF), static_cast<uint8_t>(i & 0x7F), 90);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.midiMessages.back().dataDWord);
+		ReportBenchmark("send-memory", iterations, seconds);
+	}
+
+	void BenchmarkSendNull(uint64_t iterations)
+	{
+		NullMidiOutput midiOutput;
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			(void)SendMidiNote(midiOutput, static_cast<uint8_t>(i & 0xF), static_cast<uint8_t>(i & 0x7F), 90);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark("send-null", iterations, seconds);
+	}
+
+	// Same as send-null, but every result is checked:
+	// difference is cost of error propagation on success path
+	void BenchmarkSendChecked(uint64_t iterations)
+	{
+		NullMidiOutput midiOutput;
+		uint64_t failedCount = 0;
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			if (!SendMidiNote(midiOutput, static_cast<uint8_t>(i & 0xF), static_cast<uint8_t>(i & 0x7F), 90))
+			{
+				++failedCount;
+			}
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.count);
+		DoNotOptimize(failedCount);
+		ReportBenchmark("send-checked", iterations, seconds);
+	}
+
+	// Same as send-null, with sounding notes tracked for hung-note safety net
+	void BenchmarkSendPanicGuarded(uint64_t iterations)
+	{
+		auto nullOutput = std::make_unique<NullMidiOutput>();
+		NullMidiOutput& counter = *nullOutput;
+		PanicMidiOutput midiOutput(std::move(nullOutput));
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			// Alternate Note On and Note Off, so tracking bits flip
+			(void)SendMidiNote(midiOutput, static_cast<uint8_t>(i & 0xF), static_cast<uint8_t>((i >> 1) & 0x7F), (i & 1) ? 0 : 90);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(counter.count);
+		ReportBenchmark("send-panic-guarded", iterations, seconds);
+	}
+
+	//
+	// MidiMessage packing
+	//
+
+	// Random Status and data bytes, as separate arrays
+	struct PackInput {
+		std::vector<uint8_t> statusBytes;
+		std::vector<uint8_t> data1;
+		std::vector<uint8_t> data2;
+
+		explicit PackInput(size_t count) : statusBytes(count), data1(count), data2(count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				statusBytes[i] = static_cast<uint8_t>(0x80 | (i * 7 % 0x70));
+				data1[i] = static_cast<uint8_t>(i * 13 % 128);
+				data2[i] = static_cast<uint8_t>(i * 29 % 128);
+			}
+		}
+	};
+
+	// Packing as MidiMessage does it: shifts, correct on any CPU
+	void BenchmarkPackShift(uint64_t iterations)
+	{
+		PackInput input(static_cast<size_t>(iterations));
+		std::vector<MidiMessage> midiMessages(input.statusBytes.size());
+
+		Stopwatch stopwatch;
+		for (size_t i = 0; i < midiMessages.size(); ++i)
+		{
+			midiMessages[i] = MidiMessage(input.statusBytes[i], input.data1[i], input.data2[i]);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiMessages.back().dataDWord);
+		ReportBenchmark("pack-shift", iterations, seconds, iterations * sizeof(MidiMessage));
+	}
+
+	// Packing the way old union did it: store bytes one by one,
+	// then reinterpret as DWORD (here with memcpy, which is legal).
+	// Only correct on little-endian CPUs, kept as baseline.
+	void BenchmarkPackBytes(uint64_t iterations)
+	{
+		PackInput input(static_cast<size_t>(iterations));
+		std::vector<MidiMessage> midiMessages(input.statusBytes.size());
+
+		Stopwatch stopwatch;
+		for (size_t i = 0; i < midiMessages.size(); ++i)
+		{
+			uint8_t bytes[4] = { input.statusBytes[i], input.data1[i], input.data2[i], 0 };
+			memcpy(&midiMessages[i].dataDWord, bytes, sizeof(bytes));
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiMessages.back().dataDWord);
+		ReportBenchmark("pack-bytes", iterations, seconds, iterations * sizeof(MidiMessage));
+	}
+
+	//
+	// Midi 1.0 <-> Midi 2.0 translation
+	//
+
+	// Mix of channel messages, as played melody and automation would send
+	std::vector<MidiMessage> MakeTranslationInput(size_t count)
+	{
+		std::vector<MidiMessage> midiMessages(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint8_t channel = static_cast<uint8_t>(i & 0xF);
+			uint8_t value = static_cast<uint8_t>(i * 13 % 128);
+			switch (i % 4)
+			{
+			case 0: midiMessages[i] = MakeNoteMessage(channel, value, 90); break;
+			case 1: midiMessages[i] = MakeNoteMessage(channel, value, 0); break;
+			case 2: midiMessages[i] = MakeControlChangeMessage(channel, 7, value); break;
+			default: midiMessages[i] = MidiMessage(static_cast<uint8_t>(0xE0 | channel), value, 64); break;
+			}
+		}
+		return midiMessages;
+	}
+
+	void BenchmarkUmpToMidi2(uint64_t iterations)
+	{
+		std::vector<MidiMessage> midiMessages = MakeTranslationInput(static_cast<size_t>(iterations));
+		std::vector<uint32_t> words(midiMessages.size() * 2);
+
+		Stopwatch stopwatch;
+		size_t wordCount = TranslateToMidi2(midiMessages.data(), midiMessages.size(), 0, words.data());
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(wordCount);
+		ReportBenchmark("ump-to-midi2", iterations, seconds, wordCount * sizeof(uint32_t));
+	}
+
+	void BenchmarkUmpToMidi1(uint64_t iterations)
+	{
+		std::vector<MidiMessage> input = MakeTranslationInput(static_cast<size_t>(iterations));
+		std::vector<uint32_t> words(input.size() * 2);
+		size_t wordCount = TranslateToMidi2(input.data(), input.size(), 0, words.data());
+		std::vector<MidiMessage> midiMessages(wordCount * 2);
+
+		Stopwatch stopwatch;
+		size_t count = TranslateToMidi1(words.data(), wordCount, midiMessages.data());
+		double seconds = stopwatch.ElapsedSeconds();
+
+		// Round trip gives back same messages, except Note Off form
+		DoNotOptimize(midiMessages[count - 1].dataDWord);
+		ReportBenchmark("ump-to-midi1", count, seconds, wordCount * sizeof(uint32_t));
+	}
+
+	//
+	// MPE
+	//
+
+	// Zone of 3 Member Channels, every decision it makes, byte by byte
+	void CheckMpeZone(const char* name)
+	{
+		MemoryMidiOutput midiOutput;
+		MpeZone zone(midiOutput, 3);
+		(void)zone.Configure();
+
+		MpeNote a = zone.NoteOn(60, 90).Value();
+		MpeNote b = zone.NoteOn(62, 90).Value();
+		(void)zone.NoteOff(a);
+		// Channel 1 was just released: never used channel 3 is picked
+		MpeNote c = zone.NoteOn(64, 90).Value();
+		// Channel 1 still has default expression: only Note On goes out
+		MpeNote d = zone.NoteOn(65, 90).Value();
+		// All channels sounding: oldest note (b) is stopped
+		MpeNote e = zone.NoteOn(67, 90).Value();
+		// b's channel belongs to e now
+		(void)zone.SetPitchBend(b, 0);
+		(void)zone.SetPitchBend(e, 8192 + 100);
+		(void)zone.SetPitchBend(e, 8192 + 100);
+		(void)zone.SetPressure(a, 100);
+
+		Check(name, a.channel == 1 && b.channel == 2 && c.channel == 3 && d.channel == 1 && e.channel == 2, "Member Channel choice");
+		CheckMessages(name, midiOutput.midiMessages, {
+			// RPN 6 = 3 Member Channels, on Manager Channel
+			MidiMessage(0xB0, 101, 0), MidiMessage(0xB0, 100, 6), MidiMessage(0xB0, 6, 3),
+			// Pitch Bend center (LSB, MSB), Timbre, Pressure, then note
+			MidiMessage(0xE1, 0x00, 0x40), MidiMessage(0xB1, 74, 64), MidiMessage(0xD1, 0), MidiMessage(0x91, 60, 90),
+			MidiMessage(0xE2, 0x00, 0x40), MidiMessage(0xB2, 74, 64), MidiMessage(0xD2, 0), MidiMessage(0x92, 62, 90),
+			MidiMessage(0x91, 60, 0),
+			MidiMessage(0xE3, 0x00, 0x40), MidiMessage(0xB3, 74, 64), MidiMessage(0xD3, 0), MidiMessage(0x93, 64, 90),
+			MidiMessage(0x91, 65, 90),
+			MidiMessage(0x92, 62, 0), MidiMessage(0x92, 67, 90),
+			MidiMessage(0xE2, 100, 0x40),
+			});
+
+		const MpeStats& stats = zone.Stats();
+		Check(name, stats.sentCount == 20 && stats.skippedCount == 7 && stats.stolenCount == 1, "sent, skipped and stolen counts");
+	}
+
+	// 10 fingers on expressive controller, each reporting position at 1 kHz.
+	// Pitch bend is vibrato (changes every update), pressure swells slowly
+	// (same value for many updates). Every finger plays new note every 0.5 s.
+	void BenchmarkMpeFingers(uint64_t iterations)
+	{
+		CheckMpeZone("mpe-fingers");
+
+		const uint32_t FingerCount = 10;
+		NullMidiOutput midiOutput;
+		MpeZone zone(midiOutput);
+		MpeNote notes[FingerCount];
+
+		const uint64_t milliseconds = iterations / FingerCount;
+		Stopwatch stopwatch;
+		(void)zone.Configure();
+		for (uint64_t time = 0; time < milliseconds; ++time)
+		{
+			for (uint32_t finger = 0; finger < FingerCount; ++finger)
+			{
+				uint64_t fingerTime = time + finger * 50;
+				if (fingerTime % 500 == 0)
+				{
+					(void)zone.NoteOff(notes[finger]);
+					MidiExpected<MpeNote> note = zone.NoteOn(static_cast<uint8_t>(48 + finger * 3 + fingerTime / 500 % 12), 90);
+					if (note)
+					{
+						notes[finger] = *note;
+					}
+				}
+
+				// Triangle wave, 200 ms period, 100 steps up and down
+				uint64_t phase = fingerTime % 200;
+				uint16_t pitchBend = static_cast<uint16_t>(8192 - 50 + (phase < 100 ? phase : 200 - phase));
+				uint8_t pressure = static_cast<uint8_t>(32 + fingerTime / 20 % 64);
+				(void)zone.SetPitchBend(notes[finger], pitchBend);
+				(void)zone.SetPressure(notes[finger], pressure);
+			}
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		const MpeStats& stats = zone.Stats();
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark("mpe-fingers", milliseconds * FingerCount, seconds);
+		printf("  %llu Midi Messages sent, %llu updates skipped (same value), %llu notes stolen\n",
+			static_cast<unsigned long long>(stats.sentCount),
+			static_cast<unsigned long long>(stats.skippedCount),
+			static_cast<unsigned long long>(stats.stolenCount));
+	}
+
+	//
+	// Controller automation
+	//
+
+	void CheckAutomationEvents(const char* name, const std::vector<MidiEvent>& actual, const std::vector<MidiEvent>& expected)
+	{
+		std::vector<MidiMessage> actualMessages;
+		std::vector<MidiMessage> expectedMessages;
+		bool sameTimes = actual.size() == expected.size();
+		for (size_t i = 0; i < actual.size(); ++i)
+		{
+			actualMessages.push_back(actual[i].midiMessage);
+			sameTimes = sameTimes && actual[i].timeMicroseconds == expected[i].timeMicroseconds;
+		}
+		for (const MidiEvent& midiEvent : expected)
+		{
+			expectedMessages.push_back(midiEvent.midiMessage);
+		}
+		CheckMessages(name, actualMessages, expectedMessages);
+		Check(name, sameTimes, "event times");
+	}
+
+	// Short lanes worked out by hand
+	void CheckAutomation(const char* name)
+	{
+		// Volume 0 to 10 and on to 12, 10 ms each, value may drift 4 steps.
+		// Linear segment jumps straight to grid step after crossing 4:
+		// crossing at 4 ms, so 5 ms. Next crossing (8) is at 8 ms,
+		// grid step after it is 10 ms, which is breakpoint itself.
+		// Last breakpoint is only 2 steps away, but breakpoints go out exactly.
+		AutomationLane lane;
+		lane.channel = 2;
+		lane.breakpoints = {
+			{ 0, 0.0, CurveShape::Linear },
+			{ 10000, 10.0 / 127.0, CurveShape::Linear },
+			{ 20000, 12.0 / 127.0 },
+		};
+		AutomationSettings settings;
+		settings.maxError = 4.0;
+		std::vector<MidiEvent> midiEvents;
+		AutomationStats stats = RenderAutomation(lane, settings, midiEvents);
+		CheckAutomationEvents(name, midiEvents, {
+			{ 0, MakeControlChangeMessage(2, 7, 0) },
+			{ 5000, MakeControlChangeMessage(2, 7, 5) },
+			{ 10000, MakeControlChangeMessage(2, 7, 10) },
+			{ 20000, MakeControlChangeMessage(2, 7, 12) },
+			});
+		Check(name, stats.eventCount == 4 && stats.fixedRateCount == 21, "Control Change counts");
+
+		// Pitch Bend is 14 bits, LSB first: center (8191.5 rounds up), then top
+		lane.target = AutomationTarget::PitchBend;
+		lane.breakpoints = {
+			{ 0, 0.5, CurveShape::Step },
+			{ 1000, 1.0 },
+		};
+		midiEvents.clear();
+		RenderAutomation(lane, AutomationSettings(), midiEvents);
+		CheckAutomationEvents(name, midiEvents, {
+			{ 0, MidiMessage(0xE2, 0x00, 0x40) },
+			{ 1000, MidiMessage(0xE2, 0x7F, 0x7F) },
+			});
+	}
+
+	// Curve with breakpoint every second, alternating shapes,
+	// rendered on 1 ms grid: iterations is number of grid steps
+	void BenchmarkAutomation(const char* name, AutomationTarget target, uint64_t iterations)
+	{
+		CheckAutomation(name);
+
+		AutomationLane lane;
+		lane.target = target;
+		const CurveShape shapes[] = { CurveShape::Linear, CurveShape::Smooth, CurveShape::Linear, CurveShape::Step };
+		for (uint64_t i = 0; i <= iterations / 1000; ++i)
+		{
+			double value = static_cast<double>(i * 37 % 100) / 100.0;
+			lane.breakpoints.push_back({ static_cast<int64_t>(i) * 1000000, value, shapes[i % 4] });
+		}
+		std::vector<MidiEvent> midiEvents;
+		midiEvents.reserve(static_cast<size_t>(iterations));
+
+		Stopwatch stopwatch;
+		AutomationStats stats = RenderAutomation(lane, AutomationSettings(), midiEvents);
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiEvents.size());
+		ReportBenchmark(name, stats.fixedRateCount, seconds);
+		printf("  %llu events instead of %llu at fixed rate (%.1f%% saved), %llu curve evaluations\n",
+			static_cast<unsigned long long>(stats.eventCount),
+			static_cast<unsigned long long>(stats.fixedRateCount),
+			100.0 - 100.0 * static_cast<double>(stats.eventCount) / static_cast<double>(stats.fixedRateCount),
+			static_cast<unsigned long long>(stats.evaluationCount));
+	}
+
+	void BenchmarkAutomationControlChange(uint64_t iterations)
+	{
+		BenchmarkAutomation("automation-cc", AutomationTarget::ControlChange, iterations);
+	}
+
+	void BenchmarkAutomationPitchBend(uint64_t iterations)
+	{
+		BenchmarkAutomation("automation-pitch-bend", AutomationTarget::PitchBend, iterations);
+	}
+
+	//
+	// Coroutine voices
+	//
+
+	SequencerTask BenchmarkVoice(Sequencer& sequencer, uint8_t channel, uint8_t pitch, uint64_t noteCount)
+	{
+		for (uint64_t i = 0; i < noteCount; ++i)
+		{
+			(void)SendMidiNote(sequencer.Output(), channel, pitch, 90);
+			co_await Delay(0.25);
+			(void)SendMidiNote(sequencer.Output(), channel, pitch, 0);
+			co_await Delay(0.25);
+		}
+	}
+
+	// Remembers number of messages sent at every Flush()
+	class FlushRecordingMidiOutput : public MemoryMidiOutput {
+	public:
+		std::vector<size_t> flushes;
+
+		void Flush() override { flushes.push_back(midiMessages.size()); }
+	};
+
+	SequencerTask CheckVoiceSpawned(Sequencer& sequencer, double& startBeat)
+	{
+		startBeat = sequencer.Beat();
+		(void)SendMidiNote(sequencer.Output(), 2, 80, 90);
+		co_await Delay(0.5);
+		(void)SendMidiNote(sequencer.Output(), 2, 81, 90);
+	}
+
+	SequencerTask CheckVoiceA(Sequencer& sequencer, double& spawnedStartBeat)
+	{
+		(void)SendMidiNote(sequencer.Output(), 0, 60, 90);
+		co_await Delay(1);
+		(void)SendMidiNote(sequencer.Output(), 0, 61, 90);
+		sequencer.Spawn(CheckVoiceSpawned(sequencer, spawnedStartBeat));
+		co_await Delay(1);
+		(void)SendMidiNote(sequencer.Output(), 0, 62, 90);
+	}
+
+	SequencerTask CheckVoiceB(Sequencer& sequencer)
+	{
+		(void)SendMidiNote(sequencer.Output(), 1, 70, 90);
+		co_await Delay(1);
+		(void)SendMidiNote(sequencer.Output(), 1, 71, 90);
+		co_await Delay(0.5);
+		(void)SendMidiNote(sequencer.Output(), 1, 72, 90);
+	}
+
+	// Three voices, worked out by hand:
+	//     beat 0:   A, B                 (spawn order)
+	//     beat 1:   A, B, then C         (A and B waited since beat 0, C spawned by A at beat 1)
+	//     beat 1.5: B, C                 (both scheduled at beat 1, B first)
+	//     beat 2:   A
+	// One Flush() per beat.
+	void CheckSequencer(const char* name)
+	{
+		FlushRecordingMidiOutput midiOutput;
+		Clock clock(ClockMode::Virtual);
+		Sequencer sequencer(midiOutput, clock);
+		double spawnedStartBeat = -1;
+		sequencer.Spawn(CheckVoiceA(sequencer, spawnedStartBeat));
+		sequencer.Spawn(CheckVoiceB(sequencer));
+		sequencer.Run();
+
+		CheckMessages(name, midiOutput.midiMessages, {
+			MakeNoteMessage(0, 60, 90), MakeNoteMessage(1, 70, 90),
+			MakeNoteMessage(0, 61, 90), MakeNoteMessage(1, 71, 90), MakeNoteMessage(2, 80, 90),
+			MakeNoteMessage(1, 72, 90), MakeNoteMessage(2, 81, 90),
+			MakeNoteMessage(0, 62, 90),
+			});
+		Check(name, midiOutput.flushes == std::vector<size_t>{ 2, 5, 7, 8 }, "one Flush() per wakeup time");
+		Check(name, spawnedStartBeat == 1.0, "voice spawned at beat 1 starts at beat 1");
+		Check(name, sequencer.ResumeCount() == 8, "resume count");
+
+		// Freed frame is next one handed out for its size class
+		void* frame = FramePool::Allocate(200);
+		FramePool::Free(frame, 200);
+		void* reused = FramePool::Allocate(200);
+		Check(name, reused == frame, "frame reused");
+		FramePool::Free(reused, 200);
+	}
+
+	// 10 000 voices on one thread, virtual clock: measures switching cost alone.
+	// iterations is number of voice wakeups.
+	void BenchmarkCoroutineVoices(uint64_t iterations)
+	{
+		CheckSequencer("coroutine-voices");
+
+		const uint64_t VoiceCount = 10000;
+		const uint64_t noteCount = std::max<uint64_t>(1, iterations / VoiceCount / 2);
+		NullMidiOutput midiOutput;
+		Clock clock(ClockMode::Virtual);
+		Sequencer sequencer(midiOutput, clock);
+
+		Stopwatch stopwatch;
+		for (uint64_t voice = 0; voice < VoiceCount; ++voice)
+		{
+			sequencer.Spawn(BenchmarkVoice(sequencer, static_cast<uint8_t>(voice & 0xF), static_cast<uint8_t>(voice % 128), noteCount));
+		}
+		sequencer.Run();
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark("coroutine-voices", sequencer.ResumeCount(), seconds);
+	}
+
+	//
+	// Program and bank selection
+	//
+
+	// Song changes: all 16 channels configured each time, but only
+	// couple of them change program, and bank changes rarely.
+	// iterations is number of channel selections.
+	void BenchmarkProgramConfigure(uint64_t iterations)
+	{
+		NullMidiOutput midiOutput;
+		ChannelPrograms programs(midiOutput);
+		ProgramSelection selections[16];
+		const uint64_t songCount = std::max<uint64_t>(1, iterations / 16);
+
+		Stopwatch stopwatch;
+		for (uint64_t song = 0; song < songCount; ++song)
+		{
+			ProgramSelection& changed = selections[song % 16];
+			changed.program = static_cast<uint8_t>(song % 128);
+			ProgramSelection& rebanked = selections[song * 7 % 16];
+			rebanked.bankMsb = static_cast<uint8_t>(song / 16 % 2);
+			(void)programs.Configure(selections);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		const ProgramStats& stats = programs.Stats();
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark("program-configure", songCount * 16, seconds);
+		printf("  %llu Midi Messages sent, %llu skipped (channel already had that value)\n",
+			static_cast<unsigned long long>(stats.sentCount),
+			static_cast<unsigned long long>(stats.skippedCount));
+	}
+
+	//
+	// Instrument names
+	//
+
+	// Looks up every General Midi name in turn.
+	// iterations is number of lookups.
+	void BenchmarkInstrumentLookupPerfectHash(uint64_t iterations)
+	{
+		uint64_t sum = 0;
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			std::string_view name = GeneralMidi::InstrumentNames[i % GeneralMidi::InstrumentNames.size()];
+			sum += GeneralMidi::FindInstrument(name).value_or(0);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(sum);
+		ReportBenchmark("instrument-lookup-perfect-hash", iterations, seconds);
+	}
+
+	// Letters and digits, lowercase: key for matching like GeneralMidi::FindInstrument
+	void NormalizeName(std::string_view name, std::string& normalized)
+	{
+		normalized.clear();
+		for (char c : name)
+		{
+			if (char n = GeneralMidi::NormalizeChar(c))
+			{
+				normalized += n;
+			}
+		}
+	}
+
+	// Same lookups with same matching rules in std::unordered_map, built at startup
+	void BenchmarkInstrumentLookupUnorderedMap(uint64_t iterations)
+	{
+		Stopwatch buildStopwatch;
+		std::unordered_map<std::string, uint8_t> instruments;
+		std::string key;
+		for (size_t i = 0; i < GeneralMidi::InstrumentNames.size(); ++i)
+		{
+			NormalizeName(GeneralMidi::InstrumentNames[i], key);
+			instruments.emplace(key, static_cast<uint8_t>(i));
+		}
+		double buildSeconds = buildStopwatch.ElapsedSeconds();
+
+		uint64_t sum = 0;
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			NormalizeName(GeneralMidi::InstrumentNames[i % GeneralMidi::InstrumentNames.size()], key);
+			auto found = instruments.find(key);
+			sum += found != instruments.end() ? found->second : 0;
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(sum);
+		ReportBenchmark("instrument-lookup-unordered-map", iterations, seconds);
+		printf("  Map built at startup in %.1f us\n", buildSeconds * 1e6);
+	}
+
+	//
+	// Drums
+	//
+
+	// Rock beat rendered and played on virtual clock.
+	// iterations is number of hits.
+	void BenchmarkDrums(const char* name, DrumNoteOffs noteOffs, uint64_t iterations)
+	{
+		DrumSettings settings;
+		settings.noteOffs = noteOffs;
+		DrumPattern pattern;
+		(void)ParseDrumPattern(
+			"swing 58 "
+			"bass-drum-1:    x.....x.x.......\n"
+			"acoustic-snare: ....X.......X...\n"
+			"closed-hi-hat:  x.x.x.x.x.x.x.x.\n",
+			settings, pattern);
+		const uint64_t hitsPerBar = 13;
+		pattern.bars = static_cast<uint32_t>(std::max<uint64_t>(1, iterations / hitsPerBar));
+
+		NullMidiOutput midiOutput;
+		Clock clock(ClockMode::Virtual);
+		std::vector<MidiEvent> midiEvents;
+
+		Stopwatch stopwatch;
+		DrumStats stats = RenderDrums(pattern, settings, midiEvents);
+		(void)PlayEvents(midiOutput, clock, midiEvents);
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark(name, stats.hitCount, seconds);
+		printf("  %llu Midi Messages, %llu wakeups (%.2f per hit)\n",
+			static_cast<unsigned long long>(stats.messageCount),
+			static_cast<unsigned long long>(stats.wakeupCount),
+			static_cast<double>(stats.wakeupCount) / static_cast<double>(stats.hitCount));
+	}
+
+	void BenchmarkDrumsPerHit(uint64_t iterations)
+	{
+		BenchmarkDrums("drums-per-hit", DrumNoteOffs::PerHit, iterations);
+	}
+
+	void BenchmarkDrumsNextStep(uint64_t iterations)
+	{
+		BenchmarkDrums("drums-next-step", DrumNoteOffs::NextStep, iterations);
+	}
+
+	//
+	// Event pipeline
+	//
+
+	// Batch of events like generated music: notes, their Note Offs,
+	// volume changes that often repeat, instrument changes
+	std::vector<MidiEvent> MakePipelineEvents(uint64_t count)
+	{
+		std::vector<MidiEvent> midiEvents;
+		midiEvents.reserve(static_cast<size_t>(count));
+		for (uint64_t i = 0; midiEvents.size() < count; ++i)
+		{
+			uint8_t channel = static_cast<uint8_t>(i % 16);
+			uint8_t pitch = static_cast<uint8_t>(24 + i * 7 % 80);
+			int64_t time = static_cast<int64_t>(i) * 1000;
+			switch (i % 8)
+			{
+			case 0:
+				midiEvents.push_back({ time, MakeInstrumentMessage(channel, static_cast<uint8_t>(i / 64 % 4)) });
+				break;
+			case 1:
+			case 5:
+				midiEvents.push_back({ time, MakeControlChangeMessage(channel, 7, static_cast<uint8_t>(100 + i / 32 % 2)) });
+				break;
+			default:
+				midiEvents.push_back({ time, MakeNoteMessage(channel, pitch, static_cast<uint8_t>(20 + i % 100)) });
+				break;
+			}
+		}
+		return midiEvents;
+	}
+
+	// Naive chaining, for comparison: every stage is object behind
+	// virtual call, and writes its output to its own buffer
+	class ChainedStage {
+	public:
+		virtual ~ChainedStage() = default;
+		virtual void Process(const std::vector<MidiEvent>& input, std::vector<MidiEvent>& output) = 0;
+	};
+
+	template <typename Stage>
+	class ChainedStageOf : public ChainedStage {
+	public:
+		explicit ChainedStageOf(Stage stage) : stage(std::move(stage)) {}
+
+		void Process(const std::vector<MidiEvent>& input, std::vector<MidiEvent>& output) override
+		{
+			output.clear();
+			for (MidiEvent midiEvent : input)
+			{
+				if (stage(midiEvent))
+				{
+					output.push_back(midiEvent);
+				}
+			}
+		}
+
+	private:
+		Stage stage;
+	};
+
+	const size_t PipelineBatchSize = 256;
+
+	ChannelMap MakeBenchmarkChannelMap()
+	{
+		ChannelMap channelMap;
+		channelMap.channels[9] = 10;  // Keep drums away from channel 9
+		return channelMap;
+	}
+
+	// iterations is number of events
+	void BenchmarkPipelineFused(uint64_t iterations)
+	{
+		const std::vector<MidiEvent> input = MakePipelineEvents(iterations);
+		std::vector<MidiEvent> batch(PipelineBatchSize);
+		auto pipeline = MakePipeline(MakeBenchmarkChannelMap(), Transpose{ 5 }, VelocityCurve(0.7), RedundancyElision());
+
+		uint64_t keptCount = 0;
+		Stopwatch stopwatch;
+		for (size_t begin = 0; begin < input.size(); begin += PipelineBatchSize)
+		{
+			size_t count = std::min(PipelineBatchSize, input.size() - begin);
+			std::copy(input.begin() + begin, input.begin() + begin + count, batch.begin());
+			keptCount += pipeline.Process(batch.data(), count);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(keptCount);
+		ReportBenchmark("pipeline-fused", input.size(), seconds);
+		printf("  %llu of %zu events kept\n", static_cast<unsigned long long>(keptCount), input.size());
+	}
+
+	void BenchmarkPipelineChained(uint64_t iterations)
+	{
+		const std::vector<MidiEvent> input = MakePipelineEvents(iterations);
+		std::vector<std::unique_ptr<ChainedStage>> stages;
+		stages.push_back(std::make_unique<ChainedStageOf<ChannelMap>>(MakeBenchmarkChannelMap()));
+		stages.push_back(std::make_unique<ChainedStageOf<Transpose>>(Transpose{ 5 }));
+		stages.push_back(std::make_unique<ChainedStageOf<VelocityCurve>>(VelocityCurve(0.7)));
+		stages.push_back(std::make_unique<ChainedStageOf<RedundancyElision>>(RedundancyElision()));
+		std::vector<std::vector<MidiEvent>> buffers(stages.size() + 1);
+		for (std::vector<MidiEvent>& buffer : buffers)
+		{
+			buffer.reserve(PipelineBatchSize);
+		}
+
+		uint64_t keptCount = 0;
+		Stopwatch stopwatch;
+		for (size_t begin = 0; begin < input.size(); begin += PipelineBatchSize)
+		{
+			size_t count = std::min(PipelineBatchSize, input.size() - begin);
+			buffers[0].assign(input.begin() + begin, input.begin() + begin + count);
+			for (size_t i = 0; i < stages.size(); ++i)
+			{
+				stages[i]->Process(buffers[i], buffers[i + 1]);
+			}
+			keptCount += buffers.back().size();
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(keptCount);
+		ReportBenchmark("pipeline-chained", input.size(), seconds);
+		printf("  %llu of %zu events kept\n", static_cast<unsigned long long>(keptCount), input.size());
+	}
+
+	//
+	// Message filtering
+	//
+
+	const char* const BenchmarkFilterRules = "drop aftertouch, mute 3, drop control 1";
+
+	// Every message type on every channel, in order branch predictor can't learn
+	std::vector<MidiEvent> MakeFilterEvents(uint64_t count)
+	{
+		std::vector<MidiEvent> midiEvents;
+		midiEvents.reserve(static_cast<size_t>(count));
+		uint32_t random = 1;
+		for (uint64_t i = 0; i < count; ++i)
+		{
+			random = random * 1664525u + 1013904223u;
+			const uint8_t status = static_cast<uint8_t>(0x80 | ((random >> 24) % 0x70));
+			midiEvents.push_back({ static_cast<int64_t>(i) * 1000,
+				MidiMessage(status, static_cast<uint8_t>((random >> 8) % 4), static_cast<uint8_t>(random >> 16 & 0x7F)) });
+		}
+		return midiEvents;
+	}
+
+	// Same rules as BenchmarkFilterRules, written as tests, for comparison
+	struct BranchingFilter {
+		bool operator()(MidiEvent& midiEvent) const
+		{
+			const uint8_t signature = midiEvent.midiMessage.Status() >> 4;
+			if (signature == 0b1010 || signature == 0b1101)
+			{
+				return false;
+			}
+			if ((midiEvent.midiMessage.Status() & 0x0F) == 3)
+			{
+				return false;
+			}
+			return !(signature == ControlChangeSignature && midiEvent.midiMessage.Data1() == 1);
+		}
+	};
+
+	template <typename Filter>
+	void BenchmarkFilterBatches(const char* name, uint64_t iterations, Filter&& process)
+	{
+		const std::vector<MidiEvent> input = MakeFilterEvents(iterations);
+		std::vector<MidiEvent> batch(PipelineBatchSize);
+
+		uint64_t keptCount = 0;
+		Stopwatch stopwatch;
+		for (size_t begin = 0; begin < input.size(); begin += PipelineBatchSize)
+		{
+			size_t count = std::min(PipelineBatchSize, input.size() - begin);
+			std::copy(input.begin() + begin, input.begin() + begin + count, batch.begin());
+			keptCount += process(batch.data(), count);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(keptCount);
+		ReportBenchmark(name, input.size(), seconds);
+		printf("  %llu of %zu events kept\n", static_cast<unsigned long long>(keptCount), input.size());
+	}
+
+	void BenchmarkFilterTable(uint64_t iterations)
+	{
+		MidiFilter filter;
+		MidiFilterTable table;
+		ParseMidiFilter(BenchmarkFilterRules, table);
+		filter.Publish(table);
+		BenchmarkFilterBatches("filter-table", iterations,
+			[&](MidiEvent* midiEvents, size_t count) { return filter.Process(midiEvents, count); });
+	}
+
+	void BenchmarkFilterBranching(uint64_t iterations)
+	{
+		auto pipeline = MakePipeline(BranchingFilter());
+		BenchmarkFilterBatches("filter-branching", iterations,
+			[&](MidiEvent* midiEvents, size_t count) { return pipeline.Process(midiEvents, count); });
+	}
+
+	// Messages checked as they're sent, while another thread keeps
+	// swapping rules: sender never waits for it
+	void BenchmarkFilterAsSent(uint64_t iterations)
+	{
+		const std::vector<MidiEvent> input = MakeFilterEvents(iterations);
+		MidiFilter filter;
+		MidiFilterTable tables[2];
+		ParseMidiFilter(BenchmarkFilterRules, tables[1]);
+		filter.Publish(tables[1]);
+		auto nullOutput = std::make_unique<NullMidiOutput>();
+		NullMidiOutput& sink = *nullOutput;
+		FilterMidiOutput midiOutput(std::move(nullOutput), filter);
+
+		std::atomic<bool> stop{ false };
+		uint64_t swapCount = 0;
+		std::thread swapper([&]()
+			{
+				while (!stop.load(std::memory_order_relaxed))
+				{
+					filter.Publish(tables[swapCount++ % 2]);
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+
+		Stopwatch stopwatch;
+		for (const MidiEvent& midiEvent : input)
+		{
+			(void)midiOutput.Send(midiEvent.midiMessage);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+		stop = true;
+		swapper.join();
+
+		DoNotOptimize(sink.count);
+		ReportBenchmark("filter-as-sent", input.size(), seconds);
+		printf("  %llu of %zu messages kept, %llu rule swaps\n", static_cast<unsigned long long>(sink.count),
+			input.size(), static_cast<unsigned long long>(swapCount));
+	}
+
+	//
+	// Device state
+	//
+
+	// Recording state of everything sent: what it adds to every send
+	void BenchmarkStateTrack(uint64_t iterations)
+	{
+		const std::vector<MidiEvent> input = MakeFilterEvents(iterations);
+		auto nullOutput = std::make_unique<NullMidiOutput>();
+		NullMidiOutput& sink = *nullOutput;
+		StateMidiOutput midiOutput(std::move(nullOutput));
+
+		Stopwatch stopwatch;
+		for (const MidiEvent& midiEvent : input)
+		{
+			(void)midiOutput.Send(midiEvent.midiMessage);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(sink.count);
+		ReportBenchmark("state-track", input.size(), seconds);
+	}
+
+	// Restore of busy device: every channel has bank, program, bend range,
+	// a dozen controllers and bend. iterations is restored messages.
+	void BenchmarkStateRestore(uint64_t iterations)
+	{
+		DeviceState state;
+		for (uint8_t channel = 0; channel < 16; ++channel)
+		{
+			state.Update(MakeControlChangeMessage(channel, BankSelectMsbControl, 121));
+			state.Update(MakeInstrumentMessage(channel, static_cast<uint8_t>(channel * 8)));
+			state.Update(MakeControlChangeMessage(channel, 101, 0));
+			state.Update(MakeControlChangeMessage(channel, 100, 0));
+			state.Update(MakeControlChangeMessage(channel, 6, 12));
+			for (uint8_t control = 70; control < 82; ++control)
+			{
+				state.Update(MakeControlChangeMessage(channel, control, 90));
+			}
+			state.Update(MidiMessage(static_cast<uint8_t>((PitchBendSignature << 4) | channel), 0, 80));
+		}
+
+		NullMidiOutput midiOutput;
+		uint64_t restoredCount = 0;
+		uint64_t restoreCount = 0;
+		Stopwatch stopwatch;
+		while (restoredCount < iterations)
+		{
+			size_t sentCount = 0;
+			(void)state.Restore(midiOutput, sentCount);
+			restoredCount += sentCount;
+			++restoreCount;
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark("state-restore", restoredCount, seconds);
+		printf("  %llu messages per restore\n", static_cast<unsigned long long>(restoredCount / std::max<uint64_t>(restoreCount, 1)));
+	}
+
+	//
+	// Latency calibration
+	//
+
+	// Probe out and back through in-process loopback: the floor under
+	// every calibration, what measuring itself costs
+	void BenchmarkLoopbackProbe(uint64_t iterations)
+	{
+		MidiInput midiInput;
+		LoopbackMidiOutput midiOutput(midiInput);
+		MidiMessage midiMessage;
+		std::chrono::steady_clock::time_point arrival;
+		uint64_t receivedCount = 0;
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			(void)midiOutput.Send(MakeControlChangeMessage(15, 119, static_cast<uint8_t>(i & 0x7F)));
+			receivedCount += midiInput.Receive(std::chrono::milliseconds(1), midiMessage, arrival) ? 1 : 0;
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(receivedCount);
+		ReportBenchmark("loopback-probe", iterations, seconds);
+	}
+
+	// Same song on 4 devices with different latencies, virtual clock:
+	// cost of merging per-device deadlines. iterations is sends.
+	void BenchmarkPlayDevices(uint64_t iterations)
+	{
+		const size_t DeviceCount = 4;
+		const int64_t LatenciesMs[DeviceCount] = { 0, 5, 12, 30 };
+		NullMidiOutput outputs[DeviceCount];
+		MidiOutput* midiOutputs[DeviceCount];
+		for (size_t i = 0; i < DeviceCount; ++i)
+		{
+			outputs[i].SetLatency(std::chrono::milliseconds(LatenciesMs[i]));
+			midiOutputs[i] = &outputs[i];
+		}
+
+		std::vector<MidiEvent> midiEvents(std::max<uint64_t>(1, iterations / DeviceCount));
+		for (size_t i = 0; i < midiEvents.size(); ++i)
+		{
+			// Note every millisecond: devices' sends interleave
+			midiEvents[i] = { static_cast<int64_t>(i) * 1000, MakeNoteMessage(0, static_cast<uint8_t>(i % 128), i % 2 == 0 ? 90 : 0) };
+		}
+		Clock clock(ClockMode::Virtual);
+
+		Stopwatch stopwatch;
+		(void)PlayEvents(midiOutputs, DeviceCount, clock, midiEvents.data(), midiEvents.size());
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(outputs[0].count + outputs[DeviceCount - 1].count);
+		ReportBenchmark("play-devices", midiEvents.size() * DeviceCount, seconds);
+	}
+
+	//
+	// Standard Midi File transcoding
+	//
+
+	// Format 1 file: track per channel, notes back to back
+	std::string MakeSyntheticSmf(uint16_t trackCount, uint32_t notesPerTrack)
+	{
+		std::string bytes;
+		SmfWriter writer(bytes);
+		writer.WriteHeader({ 1, trackCount, 480 });
+		for (uint16_t track = 0; track < trackCount; ++track)
+		{
+			auto writeTrack = [&](SmfWriter& trackWriter)
+			{
+				uint64_t tick = 0;
+				for (uint32_t note = 0; note < notesPerTrack; ++note)
+				{
+					const uint8_t noteOn[] = { static_cast<uint8_t>(48 + (note + track * 7) % 36), 90 };
+					const uint8_t noteOff[] = { noteOn[0], 0 };
+					trackWriter.WriteEvent(tick, { tick, static_cast<uint8_t>(0x90 | track), 0, noteOn, 2 });
+					tick += 120 + track;
+					trackWriter.WriteEvent(tick, { tick, static_cast<uint8_t>(0x90 | track), 0, noteOff, 2 });
+				}
+				trackWriter.EndTrack(tick);
+			};
+			SmfWriter counter;
+			writeTrack(counter);
+			writer.BeginTrack(static_cast<uint32_t>(counter.ByteCount()));
+			writeTrack(writer);
+		}
+		writer.Flush();
+		return bytes;
+	}
+
+	// Corpus of 64 files, merged to format 0 and retimed to 960 PPQN
+	// by one worker per CPU, output only counted.
+	// iterations is total notes in corpus.
+	void BenchmarkSmfTranscode(uint64_t iterations)
+	{
+		const size_t FileCount = 64;
+		const uint16_t TrackCount = 4;
+		const uint32_t notesPerTrack = static_cast<uint32_t>(std::max<uint64_t>(8, iterations / FileCount / TrackCount));
+		std::vector<std::string> corpus;
+		uint64_t corpusBytes = 0;
+		for (size_t i = 0; i < FileCount; ++i)
+		{
+			corpus.push_back(MakeSyntheticSmf(TrackCount, notesPerTrack));
+			corpusBytes += corpus.back().size();
+		}
+
+		const TranscodeSettings settings{ TranscodeMode::Merge, 960 };
+		const uint32_t jobs = std::max(1u, std::thread::hardware_concurrency());
+		std::atomic<size_t> nextFile{ 0 };
+		std::atomic<uint64_t> outputBytes{ 0 };
+		auto worker = [&]()
+		{
+			SmfFile smf;
+			for (size_t i = nextFile.fetch_add(1); i < corpus.size(); i = nextFile.fetch_add(1))
+			{
+				const char* error = nullptr;
+				SmfWriter writer;
+				if (ParseSmf(reinterpret_cast<const uint8_t*>(corpus[i].data()), corpus[i].size(), smf, error)
+					&& TranscodeSmf(smf, settings, writer, error))
+				{
+					outputBytes += writer.ByteCount();
+				}
+			}
+		};
+
+		Stopwatch stopwatch;
+		std::vector<std::thread> threads;
+		for (uint32_t i = 1; i < jobs; ++i)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(outputBytes);
+		ReportBenchmark("smf-transcode", FileCount, seconds, corpusBytes);
+		printf("  %zu files of %.0f KB, %u workers, %.2f MB out\n", FileCount,
+			static_cast<double>(corpusBytes) / FileCount / 1024.0, jobs, static_cast<double>(outputBytes) / (1024.0 * 1024.0));
+	}
+
+	// ParseSmf(): chunks, and one validating walk of every track.
+	// iterations is notes in file.
+	void BenchmarkSmfParse(uint64_t iterations)
+	{
+		const uint16_t TrackCount = 16;
+		std::string bytes = MakeSyntheticSmf(TrackCount, static_cast<uint32_t>(std::max<uint64_t>(8, iterations / TrackCount)));
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(bytes.data());
+		SmfFile smf;
+		const char* error = nullptr;
+
+		const int Repeats = 8;
+		Stopwatch stopwatch;
+		size_t trackCount = 0;
+		for (int i = 0; i < Repeats; ++i)
+		{
+			trackCount += ParseSmf(data, bytes.size(), smf, error) ? smf.tracks.size() : 0;
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(trackCount);
+		ReportBenchmark("smf-parse", Repeats, seconds, bytes.size() * Repeats);
+	}
+
+	// Walk of every event of parsed file, with reader given.
+	// Checked reader is what every walk cost before ParseSmf() validated tracks.
+	template <typename Reader>
+	void BenchmarkSmfWalk(const char* name, uint64_t iterations)
+	{
+		const uint16_t TrackCount = 16;
+		std::string bytes = MakeSyntheticSmf(TrackCount, static_cast<uint32_t>(std::max<uint64_t>(8, iterations / TrackCount)));
+		SmfFile smf;
+		const char* error = nullptr;
+		if (!ParseSmf(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), smf, error))
+		{
+			return;
+		}
+
+		const int Repeats = 8;
+		Stopwatch stopwatch;
+		uint64_t eventCount = 0;
+		uint64_t checksum = 0;
+		for (int i = 0; i < Repeats; ++i)
+		{
+			for (const SmfChunk& track : smf.tracks)
+			{
+				Reader reader(track);
+				SmfEvent event;
+				while (reader.Next(event))
+				{
+					checksum += event.tick + event.status;
+					++eventCount;
+				}
+			}
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(checksum);
+		ReportBenchmark(name, eventCount, seconds, bytes.size() * Repeats);
+	}
+
+	void BenchmarkSmfWalkChecked(uint64_t iterations)
+	{
+		BenchmarkSmfWalk<SmfCheckedTrackReader>("smf-walk-checked", iterations);
+	}
+
+	void BenchmarkSmfWalkValidated(uint64_t iterations)
+	{
+		BenchmarkSmfWalk<SmfTrackReader>("smf-walk-validated", iterations);
+	}
+
+	//
+	// Raw Midi byte stream decoding
+	//
+
+	// Like recorded performance: Note On runs with running status,
+	// Timing Clock between them, and a System Exclusive dump now and then
+	std::vector<uint8_t> MakeRecordedStream(uint64_t noteCount)
+	{
+		std::vector<uint8_t> bytes;
+		bytes.reserve(noteCount * 2 + noteCount / 8);
+		for (uint64_t note = 0; note < noteCount; ++note)
+		{
+			if (note % 64 == 0)
+			{
+				bytes.push_back(static_cast<uint8_t>(0x90 | (note / 64) % 16));
+			}
+			if (note % 24 == 23)
+			{
+				bytes.push_back(0xF8);
+			}
+			if (note % 4096 == 4095)
+			{
+				bytes.push_back(0xF0);
+				for (int i = 0; i < 1024; ++i)
+				{
+					bytes.push_back(static_cast<uint8_t>(i & 0x7F));
+				}
+				bytes.push_back(0xF7);
+				bytes.push_back(static_cast<uint8_t>(0x90 | (note / 64) % 16));
+			}
+			bytes.push_back(static_cast<uint8_t>(36 + note % 60));
+			bytes.push_back(static_cast<uint8_t>(note % 2 == 0 ? 90 : 0));
+		}
+		return bytes;
+	}
+
+	void BenchmarkMidiStreamDecode(uint64_t iterations)
+	{
+		std::vector<uint8_t> bytes = MakeRecordedStream(iterations);
+		std::vector<MidiMessage> midiMessages(bytes.size());
+		MidiStreamDecoder decoder;
+
+		Stopwatch stopwatch;
+		size_t messageCount = decoder.Decode(bytes.data(), bytes.size(), midiMessages.data());
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(messageCount > 0 ? midiMessages[messageCount - 1].dataDWord : 0);
+		ReportBenchmark("midi-stream-decode", messageCount, seconds, bytes.size());
+	}
+
+	// Scan for Status bytes through data bytes, like System Exclusive dump.
+	// iterations is bytes scanned.
+	template <const uint8_t* (*Find)(const uint8_t*, const uint8_t*)>
+	void BenchmarkMidiStreamScan(const char* name, uint64_t iterations)
+	{
+		std::vector<uint8_t> bytes(std::max<uint64_t>(iterations, 1));
+		for (size_t i = 0; i < bytes.size(); ++i)
+		{
+			bytes[i] = static_cast<uint8_t>(i & 0x7F);
+		}
+		bytes.back() = 0xF7;
+
+		Stopwatch stopwatch;
+		const uint8_t* statusByte = Find(bytes.data(), bytes.data() + bytes.size());
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(static_cast<uint64_t>(statusByte - bytes.data()));
+		ReportBenchmark(name, bytes.size(), seconds, bytes.size());
+	}
+
+	void BenchmarkMidiStreamScanSse2(uint64_t iterations)
+	{
+		BenchmarkMidiStreamScan<FindMidiStatusByte>("midi-stream-scan-sse2", iterations);
+	}
+
+	void BenchmarkMidiStreamScanScalar(uint64_t iterations)
+	{
+		BenchmarkMidiStreamScan<FindMidiStatusByteScalar>("midi-stream-scan-scalar", iterations);
+	}
+
+	//
+	// Note list parsing
+	//
+
+	void BenchmarkParseNotes(uint64_t iterations)
+	{
+		std::string text;
+		char note[32];
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			snprintf(note, sizeof(note), "%u:%u:%u,", static_cast<unsigned>(i % 128), 90u, 250u);
+			text += note;
+		}
+
+		std::vector<Note> notes;
+		notes.reserve(iterations);
+
+		Stopwatch stopwatch;
+		ParseNoteList(text, Note{ 60, 90, 2000 }, notes);
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(notes.size());
+		ReportBenchmark("parse-notes", notes.size(), seconds, text.size());
+	}
+
+	//
+	// Score notation
+	//
+
+	// Score with a bit of everything: notes, accidentals, chords,
+	// rests, durations, velocities and commands
+	std::string MakeScore(uint64_t noteCount)
+	{
+		static const char* const Pieces[] = {
+			"C4/4 ", "D#4 ", "Eb3/8. ", "G4!100 ", "[C4 E4 G4]/2 ", "r/16 ",
+			"72 ", "A-1/64 ", "B5 ", "program 24\n", "tempo 140 ", "F#6/1 # comment\n",
+		};
+		const size_t PieceCount = sizeof(Pieces) / sizeof(Pieces[0]);
+
+		std::string score;
+		score.reserve(noteCount * 6);
+		for (uint64_t i = 0; i < noteCount; ++i)
+		{
+			score += Pieces[i % PieceCount];
+		}
+		return score;
+	}
+
+	void BenchmarkParseScore(uint64_t iterations)
+	{
+		std::string score = MakeScore(iterations);
+		std::vector<MidiEvent> midiEvents;
+
+		Stopwatch stopwatch;
+		bool ok = CompileScore(score, ScoreDefaults{}, midiEvents);
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(ok ? midiEvents.size() : 0);
+		ReportBenchmark("parse-score", midiEvents.size(), seconds, score.size());
+	}
+
+	//
+	// Load generator
+	//
+
+	void BenchmarkGenerate(uint64_t iterations)
+	{
+		// Virtual clock: measures generator cost alone, without pacing
+		NullMidiOutput midiOutput;
+		Clock clock(ClockMode::Virtual);
+		GeneratorSettings settings;
+		settings.rate = iterations;
+		settings.seconds = 1;
+
+		Stopwatch stopwatch;
+		GeneratorStats stats = RunGenerator(midiOutput, clock, settings);
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(midiOutput.count);
+		ReportBenchmark("generate", stats.messageCount, seconds);
+	}
+
+	//
+	// Tracing
+	//
+
+	// Cost of one trace event when tracing is on. Goal is under 50 ns.
+	void BenchmarkTraceEnabled(uint64_t iterations)
+	{
+		const size_t EventsPerThread = 1 << 16;
+		bool wasEnabled = traceEnabled;
+		StartTrace(EventsPerThread);
+		TraceBuffer* buffer = threadTraceBuffer;
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			TraceCounter("benchmark", static_cast<int64_t>(i));
+
+			// Reuse buffer, so it stays in cache like it would in real run
+			if (buffer->count.load(std::memory_order_relaxed) == buffer->capacity)
+			{
+				buffer->count.store(0, std::memory_order_relaxed);
+			}
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		traceEnabled = wasEnabled;
+		DoNotOptimize(buffer->count.load());
+		buffer->count.store(0);
+		ReportBenchmark("trace-enabled", iterations, seconds);
+	}
+
+	// Cost of trace point when tracing is off
+	void BenchmarkTraceDisabled(uint64_t iterations)
+	{
+		bool wasEnabled = traceEnabled;
+		traceEnabled = false;
+
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			TraceScope traceScope("benchmark");
+			DoNotOptimize(i);
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		traceEnabled = wasEnabled;
+		ReportBenchmark("trace-disabled", iterations, seconds);
+	}
+
+	//
+	// Metrics
+	//
+
+	// Cost of counting one sent message in this thread's block
+	void BenchmarkMetricsCount(uint64_t iterations)
+	{
+		Stopwatch stopwatch;
+		for (uint64_t i = 0; i < iterations; ++i)
+		{
+			CountSentMessage(MakeNoteMessage(0, static_cast<uint8_t>(i & 0x7F), 90));
+		}
+		double seconds = stopwatch.ElapsedSeconds();
+
+		DoNotOptimize(ReadMetrics().counters[static_cast<uint32_t>(Metric::SentNoteOn)]);
+		ReportBenchmark("metrics-count", iterations, seconds);
+	}
+
+	struct BenchmarkEntry {
+		const char* name;
+		void (*run)(uint64_t iterations);
+	};
+
+	const BenchmarkEntry benchmarks[] = {
+		{ "send-memory", BenchmarkSendMemory },
+		{ "send-null", BenchmarkSendNull },
+		{ "send-checked", BenchmarkSendChecked },
+		{ "send-panic-guarded", BenchmarkSendPanicGuarded },
+		{ "pack-shift", BenchmarkPackShift },
+		{ "pack-bytes", BenchmarkPackBytes },
+		{ "ump-to-midi2", BenchmarkUmpToMidi2 },
+		{ "ump-to-midi1", BenchmarkUmpToMidi1 },
+		{ "mpe-fingers", BenchmarkMpeFingers },
+		{ "automation-cc", BenchmarkAutomationControlChange },
+		{ "automation-pitch-bend", BenchmarkAutomationPitchBend },
+		{ "coroutine-voices", BenchmarkCoroutineVoices },
+		{ "program-configure", BenchmarkProgramConfigure },
+		{ "instrument-lookup-perfect-hash", BenchmarkInstrumentLookupPerfectHash },
+		{ "instrument-lookup-unordered-map", BenchmarkInstrumentLookupUnorderedMap },
+		{ "drums-per-hit", BenchmarkDrumsPerHit },
+		{ "drums-next-step", BenchmarkDrumsNextStep },
+		{ "pipeline-fused", BenchmarkPipelineFused },
+		{ "pipeline-chained", BenchmarkPipelineChained },
+		{ "filter-table", BenchmarkFilterTable },
+		{ "filter-branching", BenchmarkFilterBranching },
+		{ "filter-as-sent", BenchmarkFilterAsSent },
+		{ "state-track", BenchmarkStateTrack },
+		{ "state-restore", BenchmarkStateRestore },
+		{ "loopback-probe", BenchmarkLoopbackProbe },
+		{ "play-devices", BenchmarkPlayDevices },
+		{ "smf-transcode", BenchmarkSmfTranscode },
+		{ "smf-parse", BenchmarkSmfParse },
+		{ "smf-walk-checked", BenchmarkSmfWalkChecked },
+		{ "smf-walk-validated", BenchmarkSmfWalkValidated },
+		{ "midi-stream-decode", BenchmarkMidiStreamDecode },
+		{ "midi-stream-scan-sse2", BenchmarkMidiStreamScanSse2 },
+		{ "midi-stream-scan-scalar", BenchmarkMidiStreamScanScalar },
+		{ "parse-notes", BenchmarkParseNotes },
+		{ "parse-score", BenchmarkParseScore },
+		{ "generate", BenchmarkGenerate },
+		{ "trace-enabled", BenchmarkTraceEnabled },
+		{ "trace-disabled", BenchmarkTraceDisabled },
+		{ "metrics-count", BenchmarkMetricsCount },
+	};
+
+}
+
+bool RunBenchmarks(const char* name, uint64_t iterations)
+{
+	bool all = strcmp(name, "all") == 0;
+	bool found = false;
+	benchmarkCheckFailed = false;
+	for (const BenchmarkEntry& benchmark : benchmarks)
+	{
+		if (all || strcmp(name, benchmark.name) == 0)
+		{
+			benchmark.run(iterations);
+			found = true;
+		}
+	}
+
+	if (!found)
+	{
+		fprintf(stderr, "Unknown benchmark: %s\nAvailable:", name);
+		for (const BenchmarkEntry& benchmark : benchmarks)
+		{
+			fprintf(stderr, " %s", benchmark.name);
+		}
+		fputs(" all\n", stderr);
+	}
+	return found && !benchmarkCheckFailed;
+}
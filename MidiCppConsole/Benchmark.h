@@ -0,0 +1,36 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Written by benchmarks so compiler can't optimize measured work away.
+extern volatile uint64_t benchmarkSink;
+
+inline void DoNotOptimize(uint64_t value)
+{
+	benchmarkSink = value;
+}
+
+class Stopwatch {
+public:
+	Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+	double ElapsedSeconds() const
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+// Prints one result line: ns per item, items per second and,
+// when bytes is not 0, MB per second.
+void ReportBenchmark(const char* name, uint64_t items, double seconds, uint64_t bytes = 0);
+
+// Runs benchmark by name, or all benchmarks when name is "all".
+// Returns false if there's no such benchmark.
+bool RunBenchmarks(const char* name, uint64_t iterations);
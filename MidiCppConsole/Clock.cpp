@@ -0,0 +1,60 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Clock.h"
+
+#include <Windows.h>
+
+#include <thread>
+
+Clock::Clock(ClockMode mode)
+	: mode(mode), start(std::chrono::steady_clock::now())
+{
+	if (mode == ClockMode::Realtime)
+	{
+		// Default Windows timer tick is 15.6 ms, ask for 1 ms
+		timeBeginPeriod(1);
+	}
+}
+
+Clock::~Clock()
+{
+	if (mode == ClockMode::Realtime)
+	{
+		timeEndPeriod(1);
+	}
+}
+
+std::chrono::nanoseconds Clock::Now() const
+{
+	if (mode == ClockMode::Virtual)
+	{
+		return virtualNow;
+	}
+	return std::chrono::steady_clock::now() - start;
+}
+
+void Clock::SleepUntil(std::chrono::nanoseconds deadline)
+{
+	if (mode == ClockMode::Virtual)
+	{
+		if (deadline > virtualNow)
+		{
+			virtualNow = deadline;
+		}
+		return;
+	}
+
+	// OS sleep can still wake up a millisecond or so late,
+	// so sleep until just before deadline, then spin the rest of the way
+	const std::chrono::milliseconds SpinTime(2);
+	const std::chrono::steady_clock::time_point target = start + deadline;
+	if (target - std::chrono::steady_clock::now() > SpinTime)
+	{
+		std::this_thread::sleep_until(target - SpinTime);
+	}
+	while (std::chrono::steady_clock::now() < target)
+	{
+		std::this_thread::yield();
+	}
+}
@@ -0,0 +1,37 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <chrono>
+
+enum class ClockMode {
+	Realtime, // Wall clock, playback sleeps between Midi Messages
+	Virtual,  // Time jumps straight to next deadline, no sleeping
+};
+
+// Playback time source.
+// All deadlines are absolute, measured from Clock creation,
+// so small sleep errors don't add up over a long melody.
+class Clock {
+public:
+	explicit Clock(ClockMode mode);
+	~Clock();
+
+	Clock(const Clock&) = delete;
+	Clock& operator=(const Clock&) = delete;
+
+	// Time passed since Clock was created
+	std::chrono::nanoseconds Now() const;
+
+	// Waits until deadline (time since Clock was created).
+	// Returns immediately if deadline already passed.
+	void SleepUntil(std::chrono::nanoseconds deadline);
+
+	ClockMode Mode() const { return mode; }
+
+private:
+	ClockMode mode;
+	std::chrono::steady_clock::time_point start;
+	std::chrono::nanoseconds virtualNow{ 0 };
+};
@@ -0,0 +1,542 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "CommandLine.h"
+
+#include "Metrics.h"
+#include "Parse.h"
+
+#include <climits>
+#include <optional>
+#include <string_view>
+
+namespace {
+
+	// Walks argv, one argument at a time.
+	class ArgumentReader {
+	public:
+		ArgumentReader(int argc, char* argv[]) : argc(argc), argv(argv) {}
+
+		bool Done() const { return index >= argc; }
+
+		std::string_view Next() { return argv[index++]; }
+
+		// Value after option, for example "60" in "--pitch 60"
+		bool NextValue(std::string_view option, const char*& value)
+		{
+			if (Done())
+			{
+				fprintf(stderr, "Missing value for %.*s\n", static_cast<int>(option.size()), option.data());
+				return false;
+			}
+			value = argv[index++];
+			return true;
+		}
+
+		template <typename T>
+		bool NextNumber(std::string_view option, T minValue, T maxValue, T& value)
+		{
+			const char* text = nullptr;
+			if (!NextValue(option, text))
+			{
+				return false;
+			}
+			if (!ParseUnsigned<T>(text, maxValue, value) || value < minValue)
+			{
+				fprintf(stderr, "Bad value for %.*s: %s\n", static_cast<int>(option.size()), option.data(), text);
+				return false;
+			}
+			return true;
+		}
+
+		template <typename T>
+		bool NextSignedNumber(std::string_view option, T minValue, T maxValue, T& value)
+		{
+			const char* text = nullptr;
+			if (!NextValue(option, text))
+			{
+				return false;
+			}
+			if (!ParseSigned<T>(text, minValue, maxValue, value))
+			{
+				fprintf(stderr, "Bad value for %.*s: %s\n", static_cast<int>(option.size()), option.data(), text);
+				return false;
+			}
+			return true;
+		}
+
+	private:
+		int argc;
+		char** argv;
+		int index{ 1 }; // Skip program name
+	};
+
+	bool ParseBackend(std::string_view name, MidiBackend& backend)
+	{
+		if (name == "winmm") { backend = MidiBackend::WinMm; return true; }
+		if (name == "memory") { backend = MidiBackend::Memory; return true; }
+		if (name == "null") { backend = MidiBackend::Null; return true; }
+		if (name == "file") { backend = MidiBackend::File; return true; }
+		if (name == "ump") { backend = MidiBackend::UmpFile; return true; }
+		return false;
+	}
+
+	// "0,1:15": devices 0 and 1, device 1 is 15 ms slower
+	bool ParseDevices(std::string_view text, std::vector<OutputDevice>& devices)
+	{
+		devices.clear();
+		while (true)
+		{
+			std::string_view token = NextToken(text, ",");
+			if (token.empty())
+			{
+				break;
+			}
+			size_t colon = token.find(':');
+			OutputDevice device{};
+			if (!ParseUnsigned<UINT>(token.substr(0, colon), UINT_MAX, device.deviceId))
+			{
+				return false;
+			}
+			if (colon != std::string_view::npos)
+			{
+				uint32_t latencyMs = 0;
+				if (!ParseUnsigned<uint32_t>(token.substr(colon + 1), 10000, latencyMs))
+				{
+					return false;
+				}
+				device.latencyMs = latencyMs;
+			}
+			devices.push_back(device);
+		}
+		return !devices.empty();
+	}
+
+	bool ParseDistribution(std::string_view name, Distribution& distribution)
+	{
+		if (name == "uniform") { distribution = Distribution::Uniform; return true; }
+		if (name == "normal") { distribution = Distribution::Normal; return true; }
+		return false;
+	}
+
+	// Range "first-last", or single value "first"
+	bool ParseRange(std::string_view text, uint8_t minValue, uint8_t maxValue, ValueRange& range)
+	{
+		size_t dash = text.find('-');
+		std::string_view last = dash == std::string_view::npos ? text : text.substr(dash + 1);
+		return ParseUnsigned<uint8_t>(text.substr(0, dash), maxValue, range.first)
+			&& ParseUnsigned<uint8_t>(last, maxValue, range.last)
+			&& range.first >= minValue
+			&& range.first <= range.last;
+	}
+
+	// Number, or General Midi name
+	bool ParseInstrument(std::string_view text, uint8_t& instrument)
+	{
+		if (ParseUnsigned<uint8_t>(text, 127, instrument))
+		{
+			return true;
+		}
+		std::optional<uint8_t> program = GeneralMidi::FindInstrument(text);
+		if (program)
+		{
+			instrument = *program;
+		}
+		return program.has_value();
+	}
+
+	// MSB[:LSB], for example 121:1
+	bool ParseBank(std::string_view text, uint8_t& bankMsb, uint8_t& bankLsb)
+	{
+		size_t colon = text.find(':');
+		bankLsb = 0;
+		return ParseUnsigned<uint8_t>(text.substr(0, colon), 127, bankMsb)
+			&& (colon == std::string_view::npos || ParseUnsigned<uint8_t>(text.substr(colon + 1), 127, bankLsb));
+	}
+
+	bool ParseDrumNoteOffs(std::string_view name, DrumNoteOffs& noteOffs)
+	{
+		if (name == "per-hit") { noteOffs = DrumNoteOffs::PerHit; return true; }
+		if (name == "next-step") { noteOffs = DrumNoteOffs::NextStep; return true; }
+		if (name == "none") { noteOffs = DrumNoteOffs::None; return true; }
+		return false;
+	}
+
+	bool ParseTranscodeMode(std::string_view name, TranscodeMode& mode)
+	{
+		if (name == "copy") { mode = TranscodeMode::Copy; return true; }
+		if (name == "merge") { mode = TranscodeMode::Merge; return true; }
+		if (name == "split") { mode = TranscodeMode::Split; return true; }
+		return false;
+	}
+
+	bool ParseClockMode(std::string_view name, ClockMode& clockMode)
+	{
+		if (name == "realtime") { clockMode = ClockMode::Realtime; return true; }
+		if (name == "virtual") { clockMode = ClockMode::Virtual; return true; }
+		return false;
+	}
+
+}
+
+bool ParseCommandLine(int argc, char* argv[], Options& options)
+{
+	// Note list is parsed after all options,
+	// so --velocity and --duration apply no matter where they are.
+	const char* noteList = nullptr;
+
+	ArgumentReader reader(argc, argv);
+	while (!reader.Done())
+	{
+		std::string_view option = reader.Next();
+		const char* value = nullptr;
+		bool ok = true;
+
+		if (option == "--help" || option == "-h" || option == "/?")
+		{
+			options.runMode = RunMode::Help;
+		}
+		else if (option == "--notes")
+		{
+			ok = reader.NextValue(option, noteList);
+		}
+		else if (option == "--file")
+		{
+			ok = reader.NextValue(option, options.notesFilePath);
+		}
+		else if (option == "--score")
+		{
+			ok = reader.NextValue(option, options.scoreText);
+		}
+		else if (option == "--score-file")
+		{
+			ok = reader.NextValue(option, options.scoreFilePath);
+		}
+		else if (option == "--jingle")
+		{
+			ok = reader.NextValue(option, options.jingleName);
+		}
+		else if (option == "--drums")
+		{
+			ok = reader.NextValue(option, options.drumsText);
+		}
+		else if (option == "--drum-note-offs")
+		{
+			ok = reader.NextValue(option, value) && ParseDrumNoteOffs(value, options.drums.noteOffs);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Unknown drum Note Off mode: %s\n", value);
+			}
+		}
+		else if (option == "--channel")
+		{
+			ok = reader.NextNumber<uint8_t>(option, 0, 15, options.channel);
+		}
+		else if (option == "--instrument")
+		{
+			ok = reader.NextValue(option, value) && ParseInstrument(value, options.instrument);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Unknown instrument: %s\n", value);
+			}
+		}
+		else if (option == "--bank")
+		{
+			ok = reader.NextValue(option, value) && ParseBank(value, options.bankMsb, options.bankLsb);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Bad bank: %s\n", value);
+			}
+			options.selectBank = ok;
+		}
+		else if (option == "--transpose")
+		{
+			ok = reader.NextSignedNumber<int8_t>(option, -127, 127, options.transpose);
+		}
+		else if (option == "--velocity")
+		{
+			ok = reader.NextNumber<uint8_t>(option, 0, 127, options.defaultNote.velocity);
+		}
+		else if (option == "--duration")
+		{
+			ok = reader.NextNumber<uint32_t>(option, 0, UINT32_MAX, options.defaultNote.durationMs);
+		}
+		else if (option == "--backend")
+		{
+			ok = reader.NextValue(option, value) && ParseBackend(value, options.backend);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Unknown backend: %s\n", value);
+			}
+		}
+		else if (option == "--device")
+		{
+			ok = reader.NextNumber<UINT>(option, 0, UINT_MAX, options.deviceId);
+		}
+		else if (option == "--devices")
+		{
+			ok = reader.NextValue(option, value) && ParseDevices(value, options.devices);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Bad device list: %s\n", value);
+			}
+		}
+		else if (option == "--hot-plug")
+		{
+			options.hotPlug = true;
+		}
+		else if (option == "--list-devices")
+		{
+			options.runMode = RunMode::ListDevices;
+		}
+		else if (option == "--output")
+		{
+			ok = reader.NextValue(option, options.outputPath);
+		}
+		else if (option == "--clock")
+		{
+			ok = reader.NextValue(option, value) && ParseClockMode(value, options.clockMode);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Unknown clock mode: %s\n", value);
+			}
+		}
+		else if (option == "--trace")
+		{
+			ok = reader.NextValue(option, options.tracePath);
+		}
+		else if (option == "--metrics")
+		{
+			ok = reader.NextValue(option, options.metricsPath);
+		}
+		else if (option == "--metrics-interval")
+		{
+			ok = reader.NextNumber<uint32_t>(option, MinMetricsIntervalMs, UINT32_MAX, options.metricsIntervalMs);
+		}
+		else if (option == "--calibrate")
+		{
+			options.runMode = RunMode::Calibrate;
+		}
+		else if (option == "--input")
+		{
+			ok = reader.NextNumber<UINT>(option, 0, UINT_MAX, options.inputDeviceId);
+		}
+		else if (option == "--probes")
+		{
+			ok = reader.NextNumber<uint32_t>(option, 1, 100000, options.calibration.probeCount);
+		}
+		else if (option == "--latency-file")
+		{
+			ok = reader.NextValue(option, options.latencyPath);
+		}
+		else if (option == "--state-file")
+		{
+			ok = reader.NextValue(option, options.statePath);
+		}
+		else if (option == "--filter")
+		{
+			ok = reader.NextValue(option, options.filterRules);
+		}
+		else if (option == "--filter-file")
+		{
+			ok = reader.NextValue(option, options.filterPath);
+		}
+		else if (option == "--transcode")
+		{
+			options.runMode = RunMode::Transcode;
+			ok = reader.NextValue(option, value) && ParseTranscodeMode(value, options.transcode.mode);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Unknown transcode mode: %s\n", value);
+			}
+		}
+		else if (option == "--ppqn")
+		{
+			ok = reader.NextNumber<uint16_t>(option, 1, 0x7FFF, options.transcode.ppqn);
+		}
+		else if (option == "--input-dir")
+		{
+			ok = reader.NextValue(option, options.inputDirectory);
+		}
+		else if (option == "--output-dir")
+		{
+			ok = reader.NextValue(option, options.outputDirectory);
+		}
+		else if (option == "--jobs")
+		{
+			ok = reader.NextNumber<uint32_t>(option, 0, 1024, options.jobs);
+		}
+		else if (option == "--decode-raw")
+		{
+			options.runMode = RunMode::Decode;
+			ok = reader.NextValue(option, options.rawInputPath);
+		}
+		else if (option == "--generate")
+		{
+			options.runMode = RunMode::Generate;
+		}
+		else if (option == "--rate")
+		{
+			ok = reader.NextNumber<uint64_t>(option, 1, 1000000000, options.generator.rate);
+		}
+		else if (option == "--seconds")
+		{
+			ok = reader.NextNumber<uint64_t>(option, 0, 1000000, options.generator.seconds);
+		}
+		else if (option == "--channels" || option == "--pitches" || option == "--velocities")
+		{
+			ValueRange& range = option == "--channels" ? options.generator.channels
+				: option == "--pitches" ? options.generator.pitches
+				: options.generator.velocities;
+			uint8_t minValue = option == "--velocities" ? 1 : 0;
+			uint8_t maxValue = option == "--channels" ? 15 : 127;
+			ok = reader.NextValue(option, value) && ParseRange(value, minValue, maxValue, range);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Bad range for %.*s: %s\n", static_cast<int>(option.size()), option.data(), value);
+			}
+		}
+		else if (option == "--distribution")
+		{
+			ok = reader.NextValue(option, value) && ParseDistribution(value, options.generator.distribution);
+			if (!ok && value != nullptr)
+			{
+				fprintf(stderr, "Unknown distribution: %s\n", value);
+			}
+		}
+		else if (option == "--polyphony")
+		{
+			ok = reader.NextNumber<uint32_t>(option, 1, 16 * 128, options.generator.polyphony);
+		}
+		else if (option == "--seed")
+		{
+			ok = reader.NextNumber<uint64_t>(option, 0, UINT64_MAX, options.generator.seed);
+		}
+		else if (option == "--benchmark")
+		{
+			options.runMode = RunMode::Benchmark;
+			ok = reader.NextValue(option, options.benchmarkName);
+		}
+		else if (option == "--iterations")
+		{
+			ok = reader.NextNumber<uint64_t>(option, 0, UINT64_MAX, options.benchmarkIterations);
+		}
+		else
+		{
+			fprintf(stderr, "Unknown option: %.*s\n", static_cast<int>(option.size()), option.data());
+			ok = false;
+		}
+
+		if (!ok)
+		{
+			return false;
+		}
+	}
+
+	if (options.filterRules != nullptr && options.filterPath != nullptr)
+	{
+		fputs("Use --filter or --filter-file, not both\n", stderr);
+		return false;
+	}
+	if (noteList != nullptr)
+	{
+		return ParseNoteList(noteList, options.defaultNote, options.notes);
+	}
+	return true;
+}
+
+void PrintUsage(FILE* file)
+{
+	fputs(
+		"Usage: MidiCppConsole [options]\n"
+		"\n"
+		"Without options, plays Middle C on Guitar for 2 seconds.\n"
+		"\n"
+		"Playback:\n"
+		"  --notes LIST       Notes to play one after another, for example 60:90:500,64,67\n"
+		"                     Each note is pitch[:velocity[:durationMs]]\n"
+		"  --file PATH        Read note list from file\n"
+		"  --score TEXT       Play score notation, for example \"tempo 90 C4/4 E4 G4 [C4 E4 G4]/2\"\n"
+		"  --score-file PATH  Read score notation from file\n"
+		"  --jingle NAME      Play built-in melody: startup, shutdown or twinkle\n"
+		"  --drums TEXT       Play drum pattern on channel 10, for example\n"
+		"                     \"swing 60 bass-drum-1:x...x... closed-hi-hat:x.x.x.x.\"\n"
+		"  --drum-note-offs M next-step (default), per-hit or none\n"
+		"  --channel N        Midi channel, 0 to 15 (default 0)\n"
+		"  --instrument N     Midi instrument, 0 to 127, or General Midi name like\n"
+		"                     \"Acoustic Grand Piano\" (default 24, Acoustic Guitar (nylon))\n"
+		"  --bank MSB[:LSB]   Bank Select before instrument, each 0 to 127\n"
+		"  --transpose N      Shift notes by N semitones, -127 to 127 (default 0)\n"
+		"  --velocity N       Default note velocity, 0 to 127 (default 90)\n"
+		"  --duration MS      Default note duration (default 2000)\n"
+		"\n"
+		"Output:\n"
+		"  --backend NAME     winmm (default), memory, null, file (raw Midi bytes)\n"
+		"                     or ump (Midi 2.0 Universal MIDI Packets)\n"
+		"  --device N         Windows Midi device index (default 0)\n"
+		"  --devices LIST     Play on several devices together, for example 0,1:15\n"
+		"                     N:MS is device's latency, else from --latency-file;\n"
+		"                     faster devices are held back to match slowest\n"
+		"  --list-devices     Print Windows Midi devices and their indexes\n"
+		"  --hot-plug         Keep running when device is unplugged, and\n"
+		"                     reconnect when it's plugged in again\n"
+		"  --output PATH      Output file for file and ump backends, - for stdout\n"
+		"  --clock MODE       realtime (default) or virtual (no sleeping)\n"
+		"  --latency-file PATH  Send early by device's latency, saved by --calibrate\n"
+		"  --state-file PATH  Restore programs, controllers and bends saved by last run\n"
+		"                     before playing, save them again after; reconnected\n"
+		"                     devices are always restored\n"
+		"\n"
+		"Filtering:\n"
+		"  --filter RULES     Drop messages, for example \"drop aftertouch, mute 3\";\n"
+		"                     rules: drop TYPE [channel N], drop control N [channel N],\n"
+		"                     mute N. Types: note-off, note-on, notes, poly-aftertouch,\n"
+		"                     channel-pressure, aftertouch, control-change,\n"
+		"                     program-change, pitch-bend, system-common, real-time\n"
+		"  --filter-file PATH Same rules from file, reloaded while playing when it changes\n"
+		"\n"
+		"Latency calibration (device's Midi Out connected back to a Midi In):\n"
+		"  --calibrate        Measure round trip of probe messages, print it, and\n"
+		"                     save median to --latency-file\n"
+		"  --input N          Windows Midi input device index (default 0);\n"
+		"                     other backends loop back in process\n"
+		"  --probes N         Probe messages to send (default 100)\n"
+		"\n"
+		"Diagnostics:\n"
+		"  --trace PATH       Write timeline of wakeups, sends and queue depths as\n"
+		"                     Chrome trace JSON (open in https://ui.perfetto.dev)\n"
+		"  --metrics PATH     Keep rewriting PATH with live counters: messages sent\n"
+		"                     per type, drops, late events, queue high-water, errors\n"
+		"  --metrics-interval MS  How often metrics file is rewritten (default 1000),\n"
+		"                     at least 10\n"
+		"\n"
+		"Standard Midi File transcoding:\n"
+		"  --transcode MODE   Convert every .mid file of --input-dir into --output-dir:\n"
+		"                     copy, merge (all tracks into one, format 0) or\n"
+		"                     split (one track per channel, format 1)\n"
+		"  --ppqn N           Also change ticks per quarter note, 1 to 32767\n"
+		"  --input-dir DIR    Directory with Standard Midi Files\n"
+		"  --output-dir DIR   Directory for converted files, created if missing\n"
+		"  --jobs N           Worker threads (default one per CPU)\n"
+		"\n"
+		"Raw Midi byte stream:\n"
+		"  --decode-raw PATH  Print Midi Messages of raw Midi bytes (file backend\n"
+		"                     output, captures), one per line, to --output or stdout;\n"
+		"                     running status, Real-Time and System Exclusive allowed\n"
+		"\n"
+		"Load generator:\n"
+		"  --generate         Send random notes at fixed rate and report timing\n"
+		"  --rate N           Midi Messages per second (default 1000)\n"
+		"  --seconds N        How long to generate (default 1)\n"
+		"  --channels A-B     Channel range (default 0-15)\n"
+		"  --pitches A-B      Pitch range (default 36-96)\n"
+		"  --velocities A-B   Velocity range (default 1-127)\n"
+		"  --distribution D   uniform (default) or normal, for pitches and velocities\n"
+		"  --polyphony N      Max notes sounding at once (default 8)\n"
+		"  --seed N           Random seed (default 1)\n"
+		"\n"
+		"Benchmark:\n"
+		"  --benchmark NAME   Run benchmark NAME, or all\n"
+		"  --iterations N     Iterations per benchmark (default 1000000)\n",
+		file);
+}
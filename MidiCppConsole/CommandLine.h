@@ -0,0 +1,102 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "Clock.h"
+#include "Drums.h"
+#include "GeneralMidi.h"
+#include "Generator.h"
+#include "Latency.h"
+#include "MidiOutput.h"
+#include "Player.h"
+#include "Transcode.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <vector>
+
+enum class RunMode {
+	Play,         // Play notes, default
+	Generate,     // Synthetic load generator
+	Calibrate,    // Measure output latency over Midi loopback
+	Transcode,    // Convert Standard Midi Files
+	Decode,       // Print Midi Messages of raw Midi byte stream
+	Benchmark,    // Run benchmarks and print results
+	ListDevices,  // Print Windows Midi output devices
+	Help,         // Print usage
+};
+
+// One of several devices playing together, see --devices
+struct OutputDevice {
+	UINT deviceId;
+	std::optional<uint32_t> latencyMs;  // Given on command line, else from latency file
+};
+
+// Everything main() needs to know, parsed from command line.
+// Defaults reproduce original example: Middle C on Guitar for 2 seconds.
+struct Options {
+	RunMode runMode{ RunMode::Play };
+
+	// Playback
+	std::vector<Note> notes;            // Empty means default note
+	const char* notesFilePath{ nullptr };
+	const char* scoreText{ nullptr };     // Score notation, see Score.h
+	const char* scoreFilePath{ nullptr };
+	const char* jingleName{ nullptr };    // Built-in compile-time melody, see Melody.h
+	const char* drumsText{ nullptr };     // Drum pattern, see Drums.h
+	DrumSettings drums;
+	uint8_t channel{ 0 };               // 4 bits, 0 to 15
+	uint8_t instrument{ GeneralMidi::Instrument("Acoustic Guitar (nylon)") }; // 7 bits, 0 to 127
+	bool selectBank{ false };           // Send Bank Select before instrument
+	uint8_t bankMsb{ 0 };               // 7 bits, Control Change 0
+	uint8_t bankLsb{ 0 };               // 7 bits, Control Change 32
+	int8_t transpose{ 0 };              // Semitones, notes shifted out of range are dropped
+	Note defaultNote{ /*pitch: Middle C*/ 60, /*velocity*/ 90, /*durationMs*/ 2000 };
+
+	// Output
+	MidiBackend backend{ MidiBackend::WinMm };
+	UINT deviceId{ 0 };                 // System's Midi device is at index 0
+	std::vector<OutputDevice> devices;  // Several devices at once, replaces deviceId
+	bool hotPlug{ false };              // Reconnect device after it's unplugged
+	const char* outputPath{ nullptr };  // File backend only, "-" is stdout
+	ClockMode clockMode{ ClockMode::Realtime };
+	const char* latencyPath{ nullptr }; // Latency per device, see Latency.h
+	const char* statePath{ nullptr };   // Device state between runs, see DeviceState.h
+
+	// Message filtering, see Filter.h
+	const char* filterRules{ nullptr };
+	const char* filterPath{ nullptr };  // Rules file, reloaded when it changes
+
+	// Latency calibration
+	UINT inputDeviceId{ 0 };            // Midi In that output is looped back to
+	CalibrationSettings calibration;
+
+	// Standard Midi File transcoding
+	TranscodeSettings transcode;
+	const char* inputDirectory{ nullptr };
+	const char* outputDirectory{ nullptr };
+	uint32_t jobs{ 0 };                 // Worker threads, 0 is one per CPU
+
+	// Raw Midi byte stream decoding, see MidiStream.h
+	const char* rawInputPath{ nullptr };
+
+	// Diagnostics
+	const char* tracePath{ nullptr };     // Chrome trace JSON, see Trace.h
+	const char* metricsPath{ nullptr };   // Counters text file, see Metrics.h
+	uint32_t metricsIntervalMs{ 1000 };
+
+	// Load generator
+	GeneratorSettings generator;
+
+	// Benchmark
+	const char* benchmarkName{ nullptr }; // Benchmark name, or "all"
+	uint64_t benchmarkIterations{ 1000000 };
+};
+
+// Parses argv into options.
+// Returns false, and prints reason, on bad command line.
+bool ParseCommandLine(int argc, char* argv[], Options& options);
+
+void PrintUsage(FILE* file);
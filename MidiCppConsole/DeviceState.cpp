@@ -0,0 +1,389 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "DeviceState.h"
+
+#include "MidiStream.h"
+
+#include <array>
+#include <cstdio>
+
+namespace {
+
+	// Controllers with special handling, see Update()
+	const uint8_t DataEntryMsbControl = 6;
+	const uint8_t DataEntryLsbControl = 38;
+	const uint8_t DataIncrementControl = 96;
+	const uint8_t DataDecrementControl = 97;
+	const uint8_t NonRegisteredLsbControl = 98;
+	const uint8_t NonRegisteredMsbControl = 99;
+	const uint8_t RegisteredLsbControl = 100;
+	const uint8_t RegisteredMsbControl = 101;
+	const uint8_t ResetAllControllersControl = 121;
+	const uint8_t FirstChannelModeControl = 120;  // 120 to 127 are commands, not state
+	const uint8_t NullParameter = 127;            // Parameter number 127:127 selects none
+
+	const uint16_t PitchBendCenter = 8192;
+
+	// General Midi power-on values
+	constexpr std::array<uint8_t, 128> MakeDefaultControllers()
+	{
+		std::array<uint8_t, 128> controllers{};
+		controllers[7] = 100;   // Volume
+		controllers[8] = 64;    // Balance
+		controllers[10] = 64;   // Pan
+		controllers[11] = 127;  // Expression
+		controllers[NonRegisteredLsbControl] = NullParameter;
+		controllers[NonRegisteredMsbControl] = NullParameter;
+		controllers[RegisteredLsbControl] = NullParameter;
+		controllers[RegisteredMsbControl] = NullParameter;
+		return controllers;
+	}
+
+	constexpr std::array<uint8_t, 128> DefaultControllers = MakeDefaultControllers();
+
+	constexpr uint16_t DefaultRegisteredParameters[KeptRegisteredParameterCount] = {
+		2 << 7,          // Pitch bend range: 2 semitones, 0 cents
+		8192,            // Fine tuning: center
+		64 << 7,         // Coarse tuning: center
+		0,               // Tuning program
+		0,               // Tuning bank
+		64,              // Modulation depth range: 0 semitones, 64/128 semitone
+		0,               // MPE Configuration: no Member Channels
+	};
+
+	// Restored from their own fields, or not state at all
+	bool IsPlainController(uint8_t control)
+	{
+		switch (control)
+		{
+		case BankSelectMsbControl:
+		case BankSelectLsbControl:
+		case DataEntryMsbControl:
+		case DataEntryLsbControl:
+		case DataIncrementControl:
+		case DataDecrementControl:
+		case NonRegisteredLsbControl:
+		case NonRegisteredMsbControl:
+		case RegisteredLsbControl:
+		case RegisteredMsbControl:
+			return false;
+		default:
+			return control < FirstChannelModeControl;
+		}
+	}
+
+	void SetControllerKnown(ChannelState& state, uint8_t control, bool known)
+	{
+		const uint64_t bit = uint64_t{ 1 } << (control & 63);
+		uint64_t& word = state.knownControllers[control >> 6];
+		word = known ? word | bit : word & ~bit;
+	}
+
+	// Value differs from power-on value, so restore must send it
+	bool IsControllerChanged(const ChannelState& state, uint8_t control)
+	{
+		return state.IsControllerKnown(control) && state.controllers[control] != DefaultControllers[control];
+	}
+
+	// Registered Parameter that Data Entry goes to, or -1
+	int SelectedRegisteredParameter(const ChannelState& state)
+	{
+		if (state.nonRegisteredSelected
+			|| !state.IsControllerKnown(RegisteredMsbControl)
+			|| !state.IsControllerKnown(RegisteredLsbControl)
+			|| state.controllers[RegisteredMsbControl] != 0
+			|| state.controllers[RegisteredLsbControl] >= KeptRegisteredParameterCount)
+		{
+			return -1;
+		}
+		return state.controllers[RegisteredLsbControl];
+	}
+
+	void UpdateControl(ChannelState& state, uint8_t control, uint8_t value)
+	{
+		state.controllers[control] = value;
+		SetControllerKnown(state, control, true);
+
+		switch (control)
+		{
+		case RegisteredLsbControl:
+		case RegisteredMsbControl:
+			state.nonRegisteredSelected = false;
+			break;
+		case NonRegisteredLsbControl:
+		case NonRegisteredMsbControl:
+			state.nonRegisteredSelected = true;
+			break;
+		case DataEntryMsbControl:
+		case DataEntryLsbControl:
+		{
+			const int parameter = SelectedRegisteredParameter(state);
+			if (parameter < 0)
+			{
+				break;
+			}
+			uint16_t& parameterValue = state.registeredParameters[parameter];
+			parameterValue = control == DataEntryMsbControl
+				? static_cast<uint16_t>((value << 7) | (parameterValue & 0x7F))
+				: static_cast<uint16_t>((parameterValue & ~0x7F) | value);
+			state.knownRegisteredParameters |= static_cast<uint8_t>(1u << parameter);
+			break;
+		}
+		case ResetAllControllersControl:
+			// Recommended Practice RP-015: these go back to power-on values,
+			// bank, program, volume, pan, effects and parameter values stay
+			for (uint8_t reset : { uint8_t{ 1 }, uint8_t{ 11 }, uint8_t{ 64 }, uint8_t{ 65 }, uint8_t{ 66 }, uint8_t{ 67 },
+				NonRegisteredLsbControl, NonRegisteredMsbControl, RegisteredLsbControl, RegisteredMsbControl })
+			{
+				state.controllers[reset] = DefaultControllers[reset];
+				SetControllerKnown(state, reset, false);
+			}
+			state.nonRegisteredSelected = false;
+			state.pitchBend = PitchBendCenter;
+			state.channelPressure = 0;
+			state.known &= static_cast<uint8_t>(~(ChannelState::KnownPitchBend | ChannelState::KnownChannelPressure));
+			break;
+		}
+	}
+
+}
+
+ChannelState::ChannelState()
+{
+	for (size_t control = 0; control < DefaultControllers.size(); ++control)
+	{
+		controllers[control] = DefaultControllers[control];
+	}
+	for (uint8_t parameter = 0; parameter < KeptRegisteredParameterCount; ++parameter)
+	{
+		registeredParameters[parameter] = DefaultRegisteredParameters[parameter];
+	}
+	pitchBend = PitchBendCenter;
+}
+
+void DeviceState::Update(MidiMessage midiMessage)
+{
+	const uint8_t status = midiMessage.Status();
+	ChannelState& state = channels[status & 0x0F];
+	switch (status >> 4)
+	{
+	case ControlChangeSignature:
+		UpdateControl(state, midiMessage.Data1() & 0x7F, midiMessage.Data2() & 0x7F);
+		break;
+	case SetInstrumentSignature:
+		state.program = midiMessage.Data1() & 0x7F;
+		state.known |= ChannelState::KnownProgram;
+		break;
+	case 0b1101: // Channel Pressure
+		state.channelPressure = midiMessage.Data1() & 0x7F;
+		state.known |= ChannelState::KnownChannelPressure;
+		break;
+	case PitchBendSignature:
+		state.pitchBend = static_cast<uint16_t>((midiMessage.Data1() & 0x7F) | ((midiMessage.Data2() & 0x7F) << 7));
+		state.known |= ChannelState::KnownPitchBend;
+		break;
+	}
+}
+
+size_t DeviceState::AppendRestoreMessages(std::vector<MidiMessage>& midiMessages) const
+{
+	const size_t first = midiMessages.size();
+	for (uint8_t channel = 0; channel < 16; ++channel)
+	{
+		const ChannelState& state = channels[channel];
+		auto control = [&](uint8_t number, uint8_t value)
+		{
+			midiMessages.push_back(MakeControlChangeMessage(channel, number, value));
+		};
+
+		// Bank applies at next Program Change, so both go out together
+		const bool bankChanged = IsControllerChanged(state, BankSelectMsbControl) || IsControllerChanged(state, BankSelectLsbControl);
+		if (bankChanged)
+		{
+			for (uint8_t bankControl : { BankSelectMsbControl, BankSelectLsbControl })
+			{
+				if (state.IsControllerKnown(bankControl))
+				{
+					control(bankControl, state.controllers[bankControl]);
+				}
+			}
+		}
+		if ((state.known & ChannelState::KnownProgram) && (state.program != 0 || bankChanged))
+		{
+			midiMessages.push_back(MakeInstrumentMessage(channel, state.program));
+		}
+
+		// Each parameter: select it, then its value
+		bool parameterSent = false;
+		for (uint8_t parameter = 0; parameter < KeptRegisteredParameterCount; ++parameter)
+		{
+			const uint16_t value = state.registeredParameters[parameter];
+			if ((state.knownRegisteredParameters & (1u << parameter)) && value != DefaultRegisteredParameters[parameter])
+			{
+				control(RegisteredMsbControl, 0);
+				control(RegisteredLsbControl, parameter);
+				control(DataEntryMsbControl, static_cast<uint8_t>(value >> 7));
+				control(DataEntryLsbControl, static_cast<uint8_t>(value & 0x7F));
+				parameterSent = true;
+			}
+		}
+
+		// Then parameter that was selected last, so later Data Entry lands
+		// where it did before; "none" if that's what it was, after parameters above
+		const uint8_t selectMsb = state.nonRegisteredSelected ? NonRegisteredMsbControl : RegisteredMsbControl;
+		const uint8_t selectLsb = state.nonRegisteredSelected ? NonRegisteredLsbControl : RegisteredLsbControl;
+		if (IsControllerChanged(state, selectMsb) || IsControllerChanged(state, selectLsb))
+		{
+			control(selectMsb, state.controllers[selectMsb]);
+			control(selectLsb, state.controllers[selectLsb]);
+		}
+		else if (parameterSent)
+		{
+			control(RegisteredMsbControl, NullParameter);
+			control(RegisteredLsbControl, NullParameter);
+		}
+
+		for (uint8_t number = 0; number < FirstChannelModeControl; ++number)
+		{
+			if (IsPlainController(number) && IsControllerChanged(state, number))
+			{
+				control(number, state.controllers[number]);
+			}
+		}
+
+		if ((state.known & ChannelState::KnownPitchBend) && state.pitchBend != PitchBendCenter)
+		{
+			midiMessages.push_back(MidiMessage(static_cast<uint8_t>((PitchBendSignature << 4) | channel),
+				static_cast<uint8_t>(state.pitchBend & 0x7F), static_cast<uint8_t>(state.pitchBend >> 7)));
+		}
+		if ((state.known & ChannelState::KnownChannelPressure) && state.channelPressure != 0)
+		{
+			midiMessages.push_back(MidiMessage(static_cast<uint8_t>(0xD0 | channel), state.channelPressure));
+		}
+	}
+	return midiMessages.size() - first;
+}
+
+MidiResult DeviceState::Restore(MidiOutput& midiOutput, size_t& sentCount) const
+{
+	std::vector<MidiMessage> midiMessages;
+	AppendRestoreMessages(midiMessages);
+
+	// Messages go out back to back, flushed once at end:
+	// buffering backends send whole restore in one write
+	sentCount = 0;
+	MidiResult result;
+	for (MidiMessage midiMessage : midiMessages)
+	{
+		result = midiOutput.Send(midiMessage);
+		if (!result)
+		{
+			break;
+		}
+		++sentCount;
+	}
+	midiOutput.Flush();
+	return result;
+}
+
+void DeviceState::Clear()
+{
+	for (ChannelState& state : channels)
+	{
+		state = ChannelState();
+	}
+}
+
+StateMidiOutput::StateMidiOutput(std::unique_ptr<MidiOutput> midiOutput)
+	: midiOutput(std::move(midiOutput))
+{
+	connection = this->midiOutput->Connection();
+}
+
+MidiResult StateMidiOutput::Restore()
+{
+	connection = midiOutput->Connection();
+	size_t sentCount = 0;
+	MidiResult result = state.Restore(*midiOutput, sentCount);
+	restoredCount += sentCount;
+	return result;
+}
+
+MidiResult StateMidiOutput::Write(MidiMessage midiMessage)
+{
+	if (midiOutput->Connection() != connection)
+	{
+		// Device was opened again: it starts from power-on values.
+		// If restore fails, device is gone again: message isn't sent either
+		MidiResult result = Restore();
+		if (!result)
+		{
+			return result;
+		}
+	}
+
+	MidiResult result = midiOutput->Write(midiMessage);
+	if (result.Ok())
+	{
+		state.Update(midiMessage);
+	}
+	return result;
+}
+
+bool LoadDeviceState(const char* path, DeviceState& state)
+{
+	state.Clear();
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "rb") != 0 || file == nullptr)
+	{
+		// Nothing saved yet
+		return true;
+	}
+
+	MidiStreamDecoder decoder;
+	uint8_t buffer[4096];
+	MidiMessage midiMessages[sizeof(buffer)];
+	size_t count = 0;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		const size_t messageCount = decoder.Decode(buffer, count, midiMessages);
+		for (size_t i = 0; i < messageCount; ++i)
+		{
+			state.Update(midiMessages[i]);
+		}
+	}
+	const bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok)
+	{
+		fprintf(stderr, "Can't read state file: %s\n", path);
+	}
+	return ok;
+}
+
+bool SaveDeviceState(const char* path, const DeviceState& state)
+{
+	std::vector<MidiMessage> midiMessages;
+	state.AppendRestoreMessages(midiMessages);
+
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "wb") != 0 || file == nullptr)
+	{
+		fprintf(stderr, "Can't open state file: %s\n", path);
+		return false;
+	}
+	for (MidiMessage midiMessage : midiMessages)
+	{
+		// Same bytes as file backend writes
+		const uint8_t bytes[3] = { midiMessage.Status(), midiMessage.Data1(), midiMessage.Data2() };
+		fwrite(bytes, 1, MidiMessageLength(bytes[0]), file);
+	}
+	bool ok = ferror(file) == 0;
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+	{
+		fprintf(stderr, "Can't write state file: %s\n", path);
+	}
+	return ok;
+}
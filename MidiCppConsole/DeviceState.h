@@ -0,0 +1,105 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Last-sent state of every channel: bank, program, controllers,
+// pitch bend, channel pressure, and common Registered Parameters.
+// After synthesizer reboots (or is unplugged and plugged in again)
+// it's back at power-on defaults; Restore messages bring it back
+// to where it was, so playback continues with same sounds.
+//
+// Restore sends only values that differ from power-on defaults,
+// in order synthesizers need:
+//     Bank Select MSB, LSB, then Program Change (bank applies at Program Change)
+//     Registered Parameters: select, Data Entry, then select "none" again
+//     Other controllers, Pitch Bend, Channel Pressure
+// Notes aren't restored: they were cut off by reboot.
+
+// Registered Parameters 0 to 6 are kept: pitch bend range, fine tuning,
+// coarse tuning, tuning program, tuning bank, modulation depth range,
+// MPE Configuration (see Mpe.h)
+constexpr uint8_t KeptRegisteredParameterCount = 7;
+
+// One channel, about 160 bytes: whole device is 2.5 KB
+struct ChannelState {
+	uint8_t controllers[128];                  // Last value per controller
+	uint64_t knownControllers[2]{};            // Bit per controller: sent at least once
+	uint16_t registeredParameters[KeptRegisteredParameterCount]{};  // 14 bits: MSB << 7 | LSB
+	uint16_t pitchBend{ 0 };                   // 14 bits, 8192 is center
+	uint8_t program{ 0 };
+	uint8_t channelPressure{ 0 };
+	uint8_t known{ 0 };                        // ChannelState::Known* bits
+	uint8_t knownRegisteredParameters{ 0 };    // Bit per Registered Parameter
+	bool nonRegisteredSelected{ false };       // Data Entry goes to NRPN, which isn't kept
+
+	static constexpr uint8_t KnownProgram = 0x01;
+	static constexpr uint8_t KnownPitchBend = 0x02;
+	static constexpr uint8_t KnownChannelPressure = 0x04;
+
+	ChannelState();
+
+	bool IsControllerKnown(uint8_t control) const { return (knownControllers[control >> 6] >> (control & 63)) & 1; }
+};
+
+class DeviceState {
+public:
+	// Records message, as device applies it. Notes and system messages change nothing.
+	void Update(MidiMessage midiMessage);
+
+	// Appends messages that bring device from power-on defaults to this state.
+	// Returns number of messages appended.
+	size_t AppendRestoreMessages(std::vector<MidiMessage>& midiMessages) const;
+
+	// Sends restore messages, then flushes output once.
+	// Stops at first error. sentCount is number of messages sent.
+	MidiResult Restore(MidiOutput& midiOutput, size_t& sentCount) const;
+
+	// Nothing known, as if nothing was sent yet
+	void Clear();
+
+	const ChannelState& Channel(uint8_t channel) const { return channels[channel]; }
+
+private:
+	ChannelState channels[16];
+};
+
+// Wraps backend and records state of everything sent through it.
+// When backend's device is opened again (WinMm reopen, hot-plug reconnect),
+// state is restored before next message goes out.
+class StateMidiOutput : public MidiOutput {
+public:
+	explicit StateMidiOutput(std::unique_ptr<MidiOutput> midiOutput);
+
+	void Flush() override { midiOutput->Flush(); }
+	MidiResult Reopen() override { return midiOutput->Reopen(); }
+	uint32_t Connection() const override { return midiOutput->Connection(); }
+
+	// Sender thread only
+	DeviceState& State() { return state; }
+	MidiResult Restore();
+
+	uint64_t RestoredCount() const { return restoredCount; }
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	std::unique_ptr<MidiOutput> midiOutput;
+	DeviceState state;
+	uint32_t connection;         // Of backend, when state was last restored
+	uint64_t restoredCount{ 0 }; // Restore messages sent
+};
+
+// State file is restore messages as raw Midi bytes,
+// so --decode-raw prints it.
+// Missing file is empty state, not an error.
+// Returns false, and prints reason, if file can't be read or written.
+bool LoadDeviceState(const char* path, DeviceState& state);
+bool SaveDeviceState(const char* path, const DeviceState& state);
@@ -0,0 +1,216 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Drums.h"
+
+#include "Parse.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <optional>
+
+namespace {
+
+	bool ParseSteps(std::string_view steps, const DrumSettings& settings, DrumLane& lane)
+	{
+		for (char c : steps)
+		{
+			switch (c)
+			{
+			case 'x': lane.velocities.push_back(settings.velocity); break;
+			case 'X': lane.velocities.push_back(settings.accentVelocity); break;
+			case '.':
+			case '-': lane.velocities.push_back(0); break;
+			case '|': break;
+			default:
+				fprintf(stderr, "Drums: bad step '%c' in %.*s\n", c, static_cast<int>(steps.size()), steps.data());
+				return false;
+			}
+		}
+		if (lane.velocities.empty())
+		{
+			fprintf(stderr, "Drums: lane has no steps\n");
+			return false;
+		}
+		return true;
+	}
+
+	bool ParseDrum(std::string_view name, uint8_t& pitch)
+	{
+		if (ParseUnsigned<uint8_t>(name, 127, pitch))
+		{
+			return true;
+		}
+		std::optional<uint8_t> drum = GeneralMidi::FindDrum(name);
+		if (!drum)
+		{
+			fprintf(stderr, "Drums: unknown drum: %.*s\n", static_cast<int>(name.size()), name.data());
+			return false;
+		}
+		pitch = *drum;
+		return true;
+	}
+
+	bool ParseSetting(std::string_view word, std::string_view value, DrumPattern& pattern)
+	{
+		uint32_t* setting = word == "tempo" ? &pattern.tempo
+			: word == "swing" ? &pattern.swingPercent
+			: &pattern.bars;
+		uint32_t minValue = word == "swing" ? 50 : 1;
+		uint32_t maxValue = word == "tempo" ? 1000 : word == "swing" ? 75 : 100000;
+		if (!ParseUnsigned<uint32_t>(value, maxValue, *setting) || *setting < minValue)
+		{
+			fprintf(stderr, "Drums: bad %.*s: %.*s\n",
+				static_cast<int>(word.size()), word.data(), static_cast<int>(value.size()), value.data());
+			return false;
+		}
+		return true;
+	}
+
+	// Step time: every second step is pushed later by swing.
+	// Swing 50: pair of steps split 50:50, straight. Swing 66: 2:1, triplet feel.
+	int64_t StepTime(uint64_t step, double stepMicroseconds, uint32_t swingPercent)
+	{
+		double pairStart = static_cast<double>(step / 2) * 2 * stepMicroseconds;
+		double offset = step % 2 == 0 ? 0.0 : 2 * stepMicroseconds * swingPercent / 100.0;
+		return std::llround(pairStart + offset);
+	}
+
+}
+
+size_t DrumPattern::StepCount() const
+{
+	size_t stepCount = 0;
+	for (const DrumLane& lane : lanes)
+	{
+		stepCount = std::max(stepCount, lane.velocities.size());
+	}
+	return stepCount;
+}
+
+bool ParseDrumPattern(std::string_view text, const DrumSettings& settings, DrumPattern& pattern)
+{
+	while (true)
+	{
+		std::string_view token = NextToken(text);
+		if (token.empty())
+		{
+			break;
+		}
+
+		if (token == "tempo" || token == "swing" || token == "bars")
+		{
+			if (!ParseSetting(token, NextToken(text), pattern))
+			{
+				return false;
+			}
+			continue;
+		}
+
+		// name:steps, or name: steps (aligned columns)
+		size_t colon = token.find(':');
+		if (colon == std::string_view::npos)
+		{
+			fprintf(stderr, "Drums: expected drum:steps, got %.*s\n", static_cast<int>(token.size()), token.data());
+			return false;
+		}
+		std::string_view steps = token.substr(colon + 1);
+		if (steps.empty())
+		{
+			steps = NextToken(text);
+		}
+
+		DrumLane lane;
+		if (!ParseDrum(token.substr(0, colon), lane.pitch) || !ParseSteps(steps, settings, lane))
+		{
+			return false;
+		}
+		pattern.lanes.push_back(std::move(lane));
+	}
+
+	if (pattern.lanes.empty())
+	{
+		fprintf(stderr, "Drums: no lanes\n");
+		return false;
+	}
+	return true;
+}
+
+DrumStats RenderDrums(const DrumPattern& pattern, const DrumSettings& settings, std::vector<MidiEvent>& midiEvents)
+{
+	DrumStats stats;
+	const size_t firstEvent = midiEvents.size();
+	const uint64_t stepCount = static_cast<uint64_t>(pattern.StepCount()) * pattern.bars;
+	const double stepMicroseconds = 60e6 / pattern.tempo / pattern.stepsPerBeat;
+	const int64_t gateMicroseconds = static_cast<int64_t>(settings.gateMs) * 1000;
+
+	// NextStep: drums hit on last step with hits, waiting for their Note Offs
+	std::vector<uint8_t> sounding;
+	sounding.reserve(pattern.lanes.size());
+
+	for (uint64_t step = 0; step < stepCount; ++step)
+	{
+		const int64_t time = StepTime(step, stepMicroseconds, pattern.swingPercent);
+
+		bool noteOffsSent = false;
+		for (const DrumLane& lane : pattern.lanes)
+		{
+			uint8_t velocity = lane.velocities[step % lane.velocities.size()];
+			if (velocity == 0)
+			{
+				continue;
+			}
+
+			// Note Offs ride along with next step that has hits: no wakeup of their own
+			if (!noteOffsSent)
+			{
+				for (uint8_t pitch : sounding)
+				{
+					midiEvents.push_back({ time, MakeNoteMessage(settings.channel, pitch, 0) });
+				}
+				sounding.clear();
+				noteOffsSent = true;
+			}
+
+			++stats.hitCount;
+			midiEvents.push_back({ time, MakeNoteMessage(settings.channel, lane.pitch, velocity) });
+
+			switch (settings.noteOffs)
+			{
+			case DrumNoteOffs::PerHit:
+				midiEvents.push_back({ time + gateMicroseconds, MakeNoteMessage(settings.channel, lane.pitch, 0) });
+				break;
+			case DrumNoteOffs::NextStep:
+				sounding.push_back(lane.pitch);
+				break;
+			case DrumNoteOffs::None:
+				break;
+			}
+		}
+	}
+
+	// Last step's Note Offs, when pattern ends
+	const int64_t endTime = StepTime(stepCount, stepMicroseconds, pattern.swingPercent);
+	for (uint8_t pitch : sounding)
+	{
+		midiEvents.push_back({ endTime, MakeNoteMessage(settings.channel, pitch, 0) });
+	}
+
+	// PerHit Note Offs land between later hits
+	if (settings.noteOffs == DrumNoteOffs::PerHit)
+	{
+		std::stable_sort(midiEvents.begin() + firstEvent, midiEvents.end(),
+			[](const MidiEvent& a, const MidiEvent& b) { return a.timeMicroseconds < b.timeMicroseconds; });
+	}
+
+	stats.messageCount = midiEvents.size() - firstEvent;
+	for (size_t i = firstEvent; i < midiEvents.size(); ++i)
+	{
+		if (i == firstEvent || midiEvents[i].timeMicroseconds != midiEvents[i - 1].timeMicroseconds)
+		{
+			++stats.wakeupCount;
+		}
+	}
+	return stats;
+}
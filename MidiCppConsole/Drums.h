@@ -0,0 +1,71 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "GeneralMidi.h"
+#include "Player.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Drum patterns on General Midi percussion channel (channel 10, index 9).
+//
+// Pattern is grid of steps, one line (lane) per drum:
+//     tempo 100 swing 60 bars 2
+//     bass-drum-1:   x...x...x...x...
+//     acoustic-snare:....X.......X...
+//     closed-hi-hat: x.x.x.x.x.x.x.x.
+// x is hit, X is accented hit, . or - is rest, | is ignored (bar lines).
+// Step is sixteenth note. Shorter lanes repeat, so "x.." over 16 steps
+// plays three against four.
+// Drum names are General Midi names, see GeneralMidi.h,
+// or pitch numbers: 42:x.x.x.x.
+//
+// Percussion is one-shot: drum sound doesn't stop at Note Off.
+// Naive rendering still schedules Note Off some milliseconds after every hit,
+// so player wakes up twice per hit. DrumNoteOffs picks cheaper ways.
+
+struct DrumLane {
+	uint8_t pitch{ 0 };                // Drum: General Midi percussion key
+	std::vector<uint8_t> velocities;   // Per step, 0 is rest
+};
+
+struct DrumPattern {
+	std::vector<DrumLane> lanes;
+	uint32_t tempo{ 120 };            // Quarter notes per minute
+	uint32_t stepsPerBeat{ 4 };       // 4: step is sixteenth note
+	uint32_t swingPercent{ 50 };      // 50 is straight, 66 is triplet feel, up to 75
+	uint32_t bars{ 1 };               // Times pattern is played
+
+	// Steps in one pass of pattern: longest lane
+	size_t StepCount() const;
+};
+
+enum class DrumNoteOffs : uint8_t {
+	PerHit,    // Note Off gateMs after every hit: naive, two wakeups per hit
+	NextStep,  // Note Offs go out with next hits: one wakeup per step with hits
+	None,      // No Note Off: fewest messages, for synths that ignore them
+};
+
+struct DrumSettings {
+	uint8_t channel{ GeneralMidi::DrumChannel };
+	DrumNoteOffs noteOffs{ DrumNoteOffs::NextStep };
+	uint32_t gateMs{ 50 };            // PerHit only
+	uint8_t accentVelocity{ 127 };    // X
+	uint8_t velocity{ 90 };           // x
+};
+
+struct DrumStats {
+	uint64_t hitCount{ 0 };
+	uint64_t messageCount{ 0 };
+	uint64_t wakeupCount{ 0 };        // Distinct event times: player wakeups
+};
+
+// Parses pattern text, see top of file.
+// Returns false, and prints reason, on bad input.
+bool ParseDrumPattern(std::string_view text, const DrumSettings& settings, DrumPattern& pattern);
+
+// Appends pattern's events to midiEvents, sorted by time.
+DrumStats RenderDrums(const DrumPattern& pattern, const DrumSettings& settings, std::vector<MidiEvent>& midiEvents);
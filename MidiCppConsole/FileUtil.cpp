@@ -0,0 +1,32 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "FileUtil.h"
+
+#include <cstdio>
+
+bool LoadFile(const char* path, std::string& contents)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "rb") != 0 || file == nullptr)
+	{
+		fprintf(stderr, "Can't open file: %s\n", path);
+		return false;
+	}
+
+	contents.clear();
+	char buffer[64 * 1024];
+	size_t count = 0;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		contents.append(buffer, count);
+	}
+
+	bool ok = ferror(file) == 0;
+	fclose(file);
+	if (!ok)
+	{
+		fprintf(stderr, "Can't read file: %s\n", path);
+	}
+	return ok;
+}
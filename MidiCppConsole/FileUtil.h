@@ -0,0 +1,10 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <string>
+
+// Reads whole file into contents.
+// Returns false, and prints reason, if file can't be read.
+bool LoadFile(const char* path, std::string& contents);
@@ -0,0 +1,355 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Filter.h"
+
+#include "FileUtil.h"
+#include "Parse.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+	const uint8_t AllDataRow = 16;
+
+	// Message types, by upper 4 bits of Status byte: bit per signature 0x8 to 0xE.
+	// System messages are split by Status byte instead.
+	struct FilterType {
+		std::string_view name;
+		uint8_t signatures;     // Bit (signature - 8)
+		uint8_t firstSystem;    // Status byte range, for system types
+		uint8_t lastSystem;
+	};
+
+	constexpr uint8_t SignatureBit(uint8_t signature) { return static_cast<uint8_t>(1u << (signature - 0b1000)); }
+
+	constexpr FilterType FilterTypes[] = {
+		{ "note-off", SignatureBit(0b1000), 0, 0 },
+		{ "note-on", SignatureBit(0b1001), 0, 0 },
+		{ "notes", SignatureBit(0b1000) | SignatureBit(0b1001), 0, 0 },
+		{ "poly-aftertouch", SignatureBit(0b1010), 0, 0 },
+		{ "channel-pressure", SignatureBit(0b1101), 0, 0 },
+		{ "aftertouch", SignatureBit(0b1010) | SignatureBit(0b1101), 0, 0 },
+		{ "control-change", SignatureBit(0b1011), 0, 0 },
+		{ "program-change", SignatureBit(0b1100), 0, 0 },
+		{ "pitch-bend", SignatureBit(0b1110), 0, 0 },
+		{ "system-common", 0, 0xF0, 0xF7 },
+		{ "real-time", 0, 0xF8, 0xFF },
+	};
+
+	void DropStatus(MidiFilterTable& table, uint32_t status)
+	{
+		table.statusBits[status >> 6] &= ~(uint64_t{ 1 } << (status & 63));
+	}
+
+	// channel < 0: all channels
+	void DropType(MidiFilterTable& table, const FilterType& type, int channel)
+	{
+		for (uint32_t signature = 0b1000; signature <= 0b1110; ++signature)
+		{
+			if ((type.signatures & SignatureBit(static_cast<uint8_t>(signature))) == 0)
+			{
+				continue;
+			}
+			for (uint32_t c = 0; c < 16; ++c)
+			{
+				if (channel < 0 || static_cast<uint32_t>(channel) == c)
+				{
+					DropStatus(table, (signature << 4) | c);
+				}
+			}
+		}
+		if (type.signatures == 0)
+		{
+			for (uint32_t status = type.firstSystem; status <= type.lastSystem; ++status)
+			{
+				DropStatus(table, status);
+			}
+		}
+	}
+
+	void DropControl(MidiFilterTable& table, uint8_t control, int channel)
+	{
+		for (uint32_t c = 0; c < 16; ++c)
+		{
+			if (channel < 0 || static_cast<uint32_t>(channel) == c)
+			{
+				table.data1Bits[c][control >> 6] &= ~(uint64_t{ 1 } << (control & 63));
+			}
+		}
+	}
+
+	bool BadRule(std::string_view what, std::string_view token)
+	{
+		fprintf(stderr, "Filter: %.*s: %.*s\n",
+			static_cast<int>(what.size()), what.data(), static_cast<int>(token.size()), token.data());
+		return false;
+	}
+
+	// "channel N" after rule, if it's there
+	bool ParseRuleChannel(std::string_view& text, int& channel)
+	{
+		channel = -1;
+		std::string_view rest = text;
+		if (NextToken(rest, ",") != "channel")
+		{
+			return true;
+		}
+		std::string_view token = NextToken(rest, ",");
+		uint8_t value = 0;
+		if (!ParseUnsigned<uint8_t>(token, 15, value))
+		{
+			return BadRule("bad channel, 0 to 15", token);
+		}
+		channel = value;
+		text = rest;
+		return true;
+	}
+
+	// Comments are cut out line by line before rules are split into tokens
+	std::string StripComments(std::string_view text)
+	{
+		std::string stripped;
+		stripped.reserve(text.size());
+		bool comment = false;
+		for (char c : text)
+		{
+			comment = c == '#' ? true : c == '\n' ? false : comment;
+			stripped += comment ? ' ' : c;
+		}
+		return stripped;
+	}
+
+}
+
+MidiFilterTable::MidiFilterTable()
+{
+	for (uint64_t& bits : statusBits)
+	{
+		bits = ~uint64_t{ 0 };
+	}
+	for (uint32_t status = 0; status < 256; ++status)
+	{
+		// Control Change: controllers of its channel. Others: any first data byte.
+		data1Row[status] = static_cast<uint8_t>((status >> 4) == ControlChangeSignature ? status & 0x0F : AllDataRow);
+	}
+	for (auto& row : data1Bits)
+	{
+		row[0] = ~uint64_t{ 0 };
+		row[1] = ~uint64_t{ 0 };
+	}
+}
+
+bool ParseMidiFilter(std::string_view text, MidiFilterTable& table)
+{
+	const std::string stripped = StripComments(text);
+	std::string_view rules = stripped;
+	while (true)
+	{
+		std::string_view token = NextToken(rules, ",");
+		if (token.empty())
+		{
+			return true;
+		}
+
+		int channel = -1;
+		if (token == "mute")
+		{
+			std::string_view value = NextToken(rules, ",");
+			uint8_t mutedChannel = 0;
+			if (!ParseUnsigned<uint8_t>(value, 15, mutedChannel))
+			{
+				return BadRule("bad channel, 0 to 15", value);
+			}
+			for (uint32_t signature = 0b1000; signature <= 0b1110; ++signature)
+			{
+				DropStatus(table, (signature << 4) | mutedChannel);
+			}
+			continue;
+		}
+		if (token != "drop")
+		{
+			return BadRule("expected drop or mute", token);
+		}
+
+		std::string_view what = NextToken(rules, ",");
+		if (what == "control")
+		{
+			std::string_view value = NextToken(rules, ",");
+			uint8_t control = 0;
+			if (!ParseUnsigned<uint8_t>(value, 127, control))
+			{
+				return BadRule("bad controller, 0 to 127", value);
+			}
+			if (!ParseRuleChannel(rules, channel))
+			{
+				return false;
+			}
+			DropControl(table, control, channel);
+			continue;
+		}
+
+		const FilterType* type = nullptr;
+		for (const FilterType& candidate : FilterTypes)
+		{
+			if (candidate.name == what)
+			{
+				type = &candidate;
+			}
+		}
+		if (type == nullptr)
+		{
+			return BadRule("unknown message type", what);
+		}
+		if (!ParseRuleChannel(rules, channel))
+		{
+			return false;
+		}
+		if (channel >= 0 && type->signatures == 0)
+		{
+			return BadRule("system messages have no channel", what);
+		}
+		DropType(table, *type, channel);
+	}
+}
+
+MidiFilter::MidiFilter()
+{
+	Publish(MidiFilterTable());
+}
+
+void MidiFilter::Publish(const MidiFilterTable& table)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	tables.push_back(std::make_unique<MidiFilterTable>(table));
+	current.store(tables.back().get(), std::memory_order_release);
+}
+
+size_t MidiFilter::Process(MidiEvent* midiEvents, size_t count) const
+{
+	const MidiFilterTable& table = Current();
+	size_t kept = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const MidiEvent midiEvent = midiEvents[i];
+		midiEvents[kept] = midiEvent;
+		kept += static_cast<size_t>(table.KeepBit(midiEvent.midiMessage));
+	}
+	return kept;
+}
+
+FilterMidiOutput::FilterMidiOutput(std::unique_ptr<MidiOutput> midiOutput, const MidiFilter& filter)
+	: midiOutput(std::move(midiOutput)), filter(filter)
+{
+}
+
+MidiResult FilterMidiOutput::Write(MidiMessage midiMessage)
+{
+	if (!filter.Current().Keeps(midiMessage))
+	{
+		// Note On with velocity 0 is Note Off
+		const uint8_t signature = midiMessage.Status() >> 4;
+		const bool noteOff = signature == NoteOffSignature || (signature == NoteOnSignature && midiMessage.Data2() == 0);
+		if (!noteOff || !noteTracker.IsSounding(midiMessage.Status() & 0x0F, midiMessage.Data1() & 0x7F))
+		{
+			++droppedCount;
+			return MidiResult();
+		}
+	}
+
+	MidiResult result = midiOutput->Write(midiMessage);
+	if (result.Ok())
+	{
+		noteTracker.Update(midiMessage);
+	}
+	return result;
+}
+
+std::unique_ptr<MidiFilterFileWatcher> MidiFilterFileWatcher::Start(const char* path, MidiFilter& filter, uint32_t pollIntervalMs)
+{
+	std::unique_ptr<MidiFilterFileWatcher> watcher(new MidiFilterFileWatcher(path, filter, pollIntervalMs));
+	if (!watcher->Reload(/*initial*/ true))
+	{
+		return nullptr;
+	}
+
+	MidiFilterFileWatcher* self = watcher.get();
+	watcher->thread = std::thread([self]()
+		{
+			std::unique_lock<std::mutex> lock(self->mutex);
+			while (!self->wakeUp.wait_for(lock, std::chrono::milliseconds(self->pollIntervalMs), [self]() { return self->stop; }))
+			{
+				lock.unlock();
+				if (self->Reload(/*initial*/ false))
+				{
+					fprintf(stderr, "Filter reloaded: %s\n", self->path.string().c_str());
+				}
+				lock.lock();
+			}
+		});
+	return watcher;
+}
+
+MidiFilterFileWatcher::MidiFilterFileWatcher(const char* path, MidiFilter& filter, uint32_t pollIntervalMs)
+	: path(path), filter(filter), pollIntervalMs(pollIntervalMs)
+{
+}
+
+MidiFilterFileWatcher::~MidiFilterFileWatcher()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wakeUp.notify_one();
+	if (thread.joinable())
+	{
+		thread.join();
+	}
+}
+
+bool MidiFilterFileWatcher::Reload(bool initial)
+{
+	std::error_code errorCode;
+	std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(path, errorCode);
+	if (errorCode)
+	{
+		// Editors save by replacing file: it can be missing for a moment
+		if (initial)
+		{
+			fprintf(stderr, "Can't open file: %s\n", path.string().c_str());
+		}
+		return false;
+	}
+	if (!initial && writeTime == lastWriteTime)
+	{
+		return false;
+	}
+
+	// Write time is recorded only once file is published: file caught
+	// half-written (or locked by editor) is read again on next poll,
+	// even if its write time doesn't change after that
+	std::string text;
+	if (!LoadFile(path.string().c_str(), text))
+	{
+		fprintf(stderr, "Filter not changed: %s\n", path.string().c_str());
+		return false;
+	}
+	if (!initial && text == rejectedText)
+	{
+		// Already reported
+		return false;
+	}
+	MidiFilterTable table;
+	if (!ParseMidiFilter(text, table))
+	{
+		fprintf(stderr, "Filter not changed: %s\n", path.string().c_str());
+		rejectedText = std::move(text);
+		return false;
+	}
+	filter.Publish(table);
+	lastWriteTime = writeTime;
+	rejectedText.clear();
+	return true;
+}
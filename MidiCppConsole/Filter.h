@@ -0,0 +1,157 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+#include "Panic.h"
+#include "Player.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Blocks Midi Messages operators don't want, for example aftertouch
+// flooding a synthesizer, or a channel that should stay silent.
+//
+// Rules, separated by spaces, commas or new lines, # starts comment:
+//     drop aftertouch                  : message type, on all channels
+//     drop pitch-bend channel 2        : message type, on one channel (0 to 15)
+//     drop control 1                   : one controller (Modulation Wheel)
+//     drop control 64 channel 9        : one controller, on one channel
+//     mute 3                           : every channel message on channel 3
+// Types: note-off, note-on, notes, poly-aftertouch, channel-pressure,
+// aftertouch (both), control-change, program-change, pitch-bend,
+// system-common, real-time.
+//
+// Rules are compiled into MidiFilterTable: one bit per Status byte
+// (type and channel at once), and for Control Change one bit per
+// controller and channel. Deciding a message is two table lookups
+// and an AND, same cost whatever rules say, no branch.
+
+struct MidiFilterTable {
+	uint64_t statusBits[4];        // Bit per Status byte, set keeps
+	uint8_t data1Row[256];         // Row of data1Bits per Status byte
+	uint64_t data1Bits[17][2];     // Bit per first data byte, set keeps.
+	                               // Rows 0 to 15: controllers of channel, row 16: all set
+
+	// Keeps everything
+	MidiFilterTable();
+
+	// 1 keeps message, 0 drops it
+	uint64_t KeepBit(MidiMessage midiMessage) const
+	{
+		const uint32_t status = midiMessage.dataDWord & 0xFF;
+		const uint32_t data1 = (midiMessage.dataDWord >> 8) & 0x7F;
+		return (statusBits[status >> 6] >> (status & 63))
+			& (data1Bits[data1Row[status]][data1 >> 6] >> (data1 & 63))
+			& 1;
+	}
+
+	bool Keeps(MidiMessage midiMessage) const { return KeepBit(midiMessage) != 0; }
+};
+
+// Parses rules, see top of file, into table (which starts keeping everything).
+// Returns false, and prints reason, on bad rules.
+bool ParseMidiFilter(std::string_view text, MidiFilterTable& table);
+
+// Filter whose rules can be replaced while other threads use it.
+//
+// Swap is RCU style, as in HotPlugMidiOutput: users read current table
+// with one atomic load, Publish() stores new one with one atomic store.
+// Users never take lock and never wait. Replaced tables stay alive
+// until MidiFilter is destroyed, so user can finish with table it loaded.
+// Rules change a few times per run at most, so that's cheap.
+class MidiFilter {
+public:
+	MidiFilter();
+
+	MidiFilter(const MidiFilter&) = delete;
+	MidiFilter& operator=(const MidiFilter&) = delete;
+
+	// Rules from next load on. Any thread.
+	void Publish(const MidiFilterTable& table);
+
+	const MidiFilterTable& Current() const { return *current.load(std::memory_order_acquire); }
+
+	// Pipeline stage (see Pipeline.h), through std::ref(filter)
+	bool operator()(MidiEvent& midiEvent) const { return Current().Keeps(midiEvent.midiMessage); }
+
+	// Batch in place: one table load per batch, and no branch per event.
+	// Every event is written to next free slot, which moves only when event is kept.
+	// Kept events stay in order at front. Returns number of kept events.
+	size_t Process(MidiEvent* midiEvents, size_t count) const;
+
+	void Process(std::vector<MidiEvent>& midiEvents) const
+	{
+		midiEvents.resize(Process(midiEvents.data(), midiEvents.size()));
+	}
+
+private:
+	std::atomic<const MidiFilterTable*> current{ nullptr };
+
+	// Only Publish() uses these
+	std::mutex mutex;
+	std::vector<std::unique_ptr<MidiFilterTable>> tables;  // Every table ever published
+};
+
+// Wraps backend, and drops messages filter doesn't keep, as they're sent.
+// Note Off of note that went through still goes through,
+// even if rules changed since: notes don't get stuck.
+class FilterMidiOutput : public MidiOutput {
+public:
+	FilterMidiOutput(std::unique_ptr<MidiOutput> midiOutput, const MidiFilter& filter);
+
+	void Flush() override { midiOutput->Flush(); }
+	MidiResult Reopen() override { return midiOutput->Reopen(); }
+	uint32_t Connection() const override { return midiOutput->Connection(); }
+
+	uint64_t DroppedCount() const { return droppedCount; }
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	std::unique_ptr<MidiOutput> midiOutput;
+	const MidiFilter& filter;
+	NoteTracker noteTracker;   // Notes that went through
+	uint64_t droppedCount{ 0 };
+};
+
+// Reloads rules file into filter when file changes, checked every pollIntervalMs.
+// Bad rules are reported, and filter keeps previous ones.
+class MidiFilterFileWatcher {
+public:
+	// Loads file once first. Returns nullptr, and prints reason, if that fails.
+	static std::unique_ptr<MidiFilterFileWatcher> Start(const char* path, MidiFilter& filter, uint32_t pollIntervalMs = 250);
+
+	~MidiFilterFileWatcher();
+
+	MidiFilterFileWatcher(const MidiFilterFileWatcher&) = delete;
+	MidiFilterFileWatcher& operator=(const MidiFilterFileWatcher&) = delete;
+
+private:
+	MidiFilterFileWatcher(const char* path, MidiFilter& filter, uint32_t pollIntervalMs);
+
+	// Loads and publishes file: initial load always,
+	// later ones if file changed since last publish
+	bool Reload(bool initial);
+
+	std::filesystem::path path;
+	MidiFilter& filter;
+	std::filesystem::file_time_type lastWriteTime{};  // Of last published file
+	std::string rejectedText;                          // Last text that didn't parse, reported once
+
+	uint32_t pollIntervalMs;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stop{ false };
+};
@@ -0,0 +1,345 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+// General Midi instrument and drum names, and name lookup.
+// Reference: https://midi.org/general-midi
+//
+// Tables and their hash indexes are built at compile time,
+// so lookup does no table construction and no memory allocation:
+//     GeneralMidi::FindInstrument("Acoustic Guitar (nylon)")  // 24
+//     GeneralMidi::FindInstrument("acoustic-guitar-nylon")    // 24
+//     GeneralMidi::FindDrum("Closed Hi-Hat")                  // 42
+//
+// Names match ignoring case, spaces and punctuation:
+// only letters and digits are compared.
+
+namespace GeneralMidi {
+
+	// Program Change number is index
+	constexpr std::array<std::string_view, 128> InstrumentNames = {
+		// Piano
+		"Acoustic Grand Piano", "Bright Acoustic Piano", "Electric Grand Piano", "Honky-tonk Piano",
+		"Electric Piano 1", "Electric Piano 2", "Harpsichord", "Clavi",
+		// Chromatic Percussion
+		"Celesta", "Glockenspiel", "Music Box", "Vibraphone",
+		"Marimba", "Xylophone", "Tubular Bells", "Dulcimer",
+		// Organ
+		"Drawbar Organ", "Percussive Organ", "Rock Organ", "Church Organ",
+		"Reed Organ", "Accordion", "Harmonica", "Tango Accordion",
+		// Guitar
+		"Acoustic Guitar (nylon)", "Acoustic Guitar (steel)", "Electric Guitar (jazz)", "Electric Guitar (clean)",
+		"Electric Guitar (muted)", "Overdriven Guitar", "Distortion Guitar", "Guitar Harmonics",
+		// Bass
+		"Acoustic Bass", "Electric Bass (finger)", "Electric Bass (pick)", "Fretless Bass",
+		"Slap Bass 1", "Slap Bass 2", "Synth Bass 1", "Synth Bass 2",
+		// Strings
+		"Violin", "Viola", "Cello", "Contrabass",
+		"Tremolo Strings", "Pizzicato Strings", "Orchestral Harp", "Timpani",
+		// Ensemble
+		"String Ensemble 1", "String Ensemble 2", "Synth Strings 1", "Synth Strings 2",
+		"Choir Aahs", "Voice Oohs", "Synth Voice", "Orchestra Hit",
+		// Brass
+		"Trumpet", "Trombone", "Tuba", "Muted Trumpet",
+		"French Horn", "Brass Section", "Synth Brass 1", "Synth Brass 2",
+		// Reed
+		"Soprano Sax", "Alto Sax", "Tenor Sax", "Baritone Sax",
+		"Oboe", "English Horn", "Bassoon", "Clarinet",
+		// Pipe
+		"Piccolo", "Flute", "Recorder", "Pan Flute",
+		"Blown Bottle", "Shakuhachi", "Whistle", "Ocarina",
+		// Synth Lead
+		"Lead 1 (square)", "Lead 2 (sawtooth)", "Lead 3 (calliope)", "Lead 4 (chiff)",
+		"Lead 5 (charang)", "Lead 6 (voice)", "Lead 7 (fifths)", "Lead 8 (bass + lead)",
+		// Synth Pad
+		"Pad 1 (new age)", "Pad 2 (warm)", "Pad 3 (polysynth)", "Pad 4 (choir)",
+		"Pad 5 (bowed)", "Pad 6 (metallic)", "Pad 7 (halo)", "Pad 8 (sweep)",
+		// Synth Effects
+		"FX 1 (rain)", "FX 2 (soundtrack)", "FX 3 (crystal)", "FX 4 (atmosphere)",
+		"FX 5 (brightness)", "FX 6 (goblins)", "FX 7 (echoes)", "FX 8 (sci-fi)",
+		// Ethnic
+		"Sitar", "Banjo", "Shamisen", "Koto",
+		"Kalimba", "Bag pipe", "Fiddle", "Shanai",
+		// Percussive
+		"Tinkle Bell", "Agogo", "Steel Drums", "Woodblock",
+		"Taiko Drum", "Melodic Tom", "Synth Drum", "Reverse Cymbal",
+		// Sound Effects
+		"Guitar Fret Noise", "Breath Noise", "Seashore", "Bird Tweet",
+		"Telephone Ring", "Helicopter", "Applause", "Gunshot",
+	};
+
+	// Drums play on channel 10 (index 9), pitch picks drum
+	constexpr uint8_t DrumChannel = 9;
+
+	constexpr uint8_t FirstDrumPitch = 35;
+
+	// Pitch is FirstDrumPitch + index
+	constexpr std::array<std::string_view, 47> DrumNames = {
+		"Acoustic Bass Drum", "Bass Drum 1", "Side Stick", "Acoustic Snare",
+		"Hand Clap", "Electric Snare", "Low Floor Tom", "Closed Hi-Hat",
+		"High Floor Tom", "Pedal Hi-Hat", "Low Tom", "Open Hi-Hat",
+		"Low-Mid Tom", "Hi-Mid Tom", "Crash Cymbal 1", "High Tom",
+		"Ride Cymbal 1", "Chinese Cymbal", "Ride Bell", "Tambourine",
+		"Splash Cymbal", "Cowbell", "Crash Cymbal 2", "Vibraslap",
+		"Ride Cymbal 2", "Hi Bongo", "Low Bongo", "Mute Hi Conga",
+		"Open Hi Conga", "Low Conga", "High Timbale", "Low Timbale",
+		"High Agogo", "Low Agogo", "Cabasa", "Maracas",
+		"Short Whistle", "Long Whistle", "Short Guiro", "Long Guiro",
+		"Claves", "Hi Wood Block", "Low Wood Block", "Mute Cuica",
+		"Open Cuica", "Mute Triangle", "Open Triangle",
+	};
+
+	//
+	// Perfect hash
+	//
+	// Every name gets its own slot, found with two hash steps and no probing:
+	//     bucket = hash % BucketCount
+	//     slot   = Mix(hash + seeds[bucket]) % SlotCount
+	// Seeds are searched at compile time, bucket by bucket, biggest bucket
+	// first, until all names of bucket land in free slots.
+	// Lookup hashes key once, reads one seed and one slot,
+	// and compares key with name in that slot.
+	//
+
+	// Lowercase letter or digit, 0 for characters that are skipped.
+	// Table, not comparisons: names mix letters, spaces and punctuation
+	// in no pattern branch predictor could learn.
+	constexpr std::array<char, 256> NormalizedChars = [] {
+		std::array<char, 256> table{};
+		for (int c = 0; c < 256; ++c)
+		{
+			if (c >= 'A' && c <= 'Z')
+			{
+				table[c] = static_cast<char>(c - 'A' + 'a');
+			}
+			else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+			{
+				table[c] = static_cast<char>(c);
+			}
+		}
+		return table;
+	}();
+
+	constexpr char NormalizeChar(char c)
+	{
+		return NormalizedChars[static_cast<uint8_t>(c)];
+	}
+
+	// FNV-1a of letters and digits, lowercase
+	constexpr uint32_t HashName(std::string_view name)
+	{
+		uint32_t hash = 2166136261u;
+		for (char c : name)
+		{
+			char normalized = NormalizeChar(c);
+			uint32_t next = (hash ^ static_cast<uint8_t>(normalized)) * 16777619u;
+			hash = normalized != 0 ? next : hash;
+		}
+		return hash;
+	}
+
+	// Letters and digits of both names are same, ignoring case
+	constexpr bool NamesMatch(std::string_view a, std::string_view b)
+	{
+		// Usual case: exact spelling
+		if (a == b)
+		{
+			return true;
+		}
+
+		size_t i = 0;
+		size_t j = 0;
+		while (true)
+		{
+			while (i < a.size() && NormalizeChar(a[i]) == 0)
+			{
+				++i;
+			}
+			while (j < b.size() && NormalizeChar(b[j]) == 0)
+			{
+				++j;
+			}
+			if (i == a.size() || j == b.size())
+			{
+				return i == a.size() && j == b.size();
+			}
+			if (NormalizeChar(a[i++]) != NormalizeChar(b[j++]))
+			{
+				return false;
+			}
+		}
+	}
+
+	// Spreads bits of hash + seed over whole word (Murmur3 finalizer)
+	constexpr uint32_t MixHash(uint32_t hash)
+	{
+		hash ^= hash >> 16;
+		hash *= 0x85EBCA6Bu;
+		hash ^= hash >> 13;
+		hash *= 0xC2B2AE35u;
+		hash ^= hash >> 16;
+		return hash;
+	}
+
+	template <size_t NameCount, size_t BucketCount, size_t SlotCount>
+	struct NameIndex {
+		static_assert(NameCount < 0xFF, "Slot stores name index in 8 bits");
+
+		static constexpr uint8_t EmptySlot = 0xFF;
+
+		std::array<uint32_t, BucketCount> seeds{};
+		std::array<uint8_t, SlotCount> slots{};
+
+		constexpr explicit NameIndex(const std::array<std::string_view, NameCount>& names)
+		{
+			for (uint8_t& slot : slots)
+			{
+				slot = EmptySlot;
+			}
+
+			std::array<uint32_t, NameCount> hashes{};
+			std::array<size_t, BucketCount> bucketSizes{};
+			size_t biggestBucket = 0;
+			for (size_t i = 0; i < NameCount; ++i)
+			{
+				hashes[i] = HashName(names[i]);
+				size_t size = ++bucketSizes[hashes[i] % BucketCount];
+				biggestBucket = size > biggestBucket ? size : biggestBucket;
+			}
+
+			// Big buckets are hardest to place, so they go while table is emptiest
+			for (size_t size = biggestBucket; size > 0; --size)
+			{
+				for (size_t bucket = 0; bucket < BucketCount; ++bucket)
+				{
+					if (bucketSizes[bucket] == size)
+					{
+						PlaceBucket(hashes, bucket);
+					}
+				}
+			}
+		}
+
+		constexpr void PlaceBucket(const std::array<uint32_t, NameCount>& hashes, size_t bucket)
+		{
+			for (uint32_t seed = 0; seed < 100000; ++seed)
+			{
+				// Try seed: every name of bucket needs free slot of its own
+				std::array<uint8_t, SlotCount> trial = slots;
+				bool placed = true;
+				for (size_t i = 0; i < NameCount && placed; ++i)
+				{
+					if (hashes[i] % BucketCount == bucket)
+					{
+						uint8_t& slot = trial[MixHash(hashes[i] + seed) % SlotCount];
+						placed = slot == EmptySlot;
+						slot = static_cast<uint8_t>(i);
+					}
+				}
+				if (placed)
+				{
+					seeds[bucket] = seed;
+					slots = trial;
+					return;
+				}
+			}
+			throw "No perfect hash seed found, make SlotCount bigger";
+		}
+
+		constexpr std::optional<uint8_t> Find(
+			const std::array<std::string_view, NameCount>& names,
+			std::string_view name) const
+		{
+			uint32_t hash = HashName(name);
+			uint8_t index = slots[MixHash(hash + seeds[hash % BucketCount]) % SlotCount];
+			if (index == EmptySlot || !NamesMatch(names[index], name))
+			{
+				return std::nullopt;
+			}
+			return index;
+		}
+	};
+
+	// Twice as many slots as names keeps seed search short
+	constexpr NameIndex<InstrumentNames.size(), 64, 256> InstrumentIndex(InstrumentNames);
+	constexpr NameIndex<DrumNames.size(), 32, 128> DrumIndex(DrumNames);
+
+	// Program Change number of instrument, or nothing if name isn't General Midi instrument
+	constexpr std::optional<uint8_t> FindInstrument(std::string_view name)
+	{
+		return InstrumentIndex.Find(InstrumentNames, name);
+	}
+
+	// Drum pitch, or nothing if name isn't General Midi drum
+	constexpr std::optional<uint8_t> FindDrum(std::string_view name)
+	{
+		std::optional<uint8_t> index = DrumIndex.Find(DrumNames, name);
+		if (!index)
+		{
+			return std::nullopt;
+		}
+		return static_cast<uint8_t>(FirstDrumPitch + *index);
+	}
+
+	constexpr std::string_view InstrumentName(uint8_t program)
+	{
+		return InstrumentNames[program & 0x7F];
+	}
+
+	// Instrument number by name, for constants. Unknown name doesn't compile.
+	consteval uint8_t Instrument(std::string_view name)
+	{
+		std::optional<uint8_t> program = FindInstrument(name);
+		if (!program)
+		{
+			throw "Unknown General Midi instrument";
+		}
+		return *program;
+	}
+
+	// Drum pitch by name, for constants. Unknown name doesn't compile.
+	consteval uint8_t Drum(std::string_view name)
+	{
+		std::optional<uint8_t> pitch = FindDrum(name);
+		if (!pitch)
+		{
+			throw "Unknown General Midi drum";
+		}
+		return *pitch;
+	}
+
+	// Compile-time checks: table order, and every name finds itself
+	static_assert(Instrument("Acoustic Guitar (nylon)") == 24, "Guitar");
+	static_assert(Instrument("acoustic-guitar-nylon") == 24, "Case and punctuation ignored");
+	static_assert(Instrument("Gunshot") == 127, "Last instrument");
+	static_assert(Drum("Acoustic Bass Drum") == 35 && Drum("Closed Hi-Hat") == 42 && Drum("Open Triangle") == 81, "Drum map");
+	static_assert(!FindInstrument("Kazoo") && !FindInstrument(""), "Unknown names");
+
+	constexpr bool AllNamesFound()
+	{
+		for (size_t i = 0; i < InstrumentNames.size(); ++i)
+		{
+			if (FindInstrument(InstrumentNames[i]) != i)
+			{
+				return false;
+			}
+		}
+		for (size_t i = 0; i < DrumNames.size(); ++i)
+		{
+			if (FindDrum(DrumNames[i]) != FirstDrumPitch + i)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+	static_assert(AllNamesFound(), "Every name has slot of its own");
+
+}
@@ -0,0 +1,231 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Generator.h"
+
+#include "Metrics.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+	// Small, fast random numbers (SplitMix64).
+	// std::mt19937 is several times slower, and at millions of
+	// Midi Messages per second random numbers would dominate.
+	class FastRandom {
+	public:
+		explicit FastRandom(uint64_t seed) : state(seed) {}
+
+		uint64_t Next()
+		{
+			uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+			z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+			z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+			return z ^ (z >> 31);
+		}
+
+		uint8_t Pick(ValueRange range, Distribution distribution)
+		{
+			uint64_t span = static_cast<uint64_t>(range.last - range.first) + 1;
+			uint64_t random = Next();
+			uint64_t offset = 0;
+			if (distribution == Distribution::Uniform)
+			{
+				offset = ((random >> 32) * span) >> 32;
+			}
+			else
+			{
+				// Average of four 16-bit random numbers is close to normal
+				// (Irwin-Hall distribution), and costs only one Next()
+				uint64_t sum = (random & 0xFFFF) + ((random >> 16) & 0xFFFF)
+					+ ((random >> 32) & 0xFFFF) + (random >> 48);
+				offset = (sum * span) >> 18;
+			}
+			return static_cast<uint8_t>(range.first + offset);
+		}
+
+	private:
+		uint64_t state;
+	};
+
+	// Produces Note On / Note Off stream, never more than polyphony notes sounding.
+	class NoteStream {
+	public:
+		explicit NoteStream(const GeneratorSettings& settings)
+			: settings(settings), random(settings.seed), noteOffs(settings.polyphony)
+		{
+		}
+
+		MidiMessage Next()
+		{
+			if (soundingCount == noteOffs.size())
+			{
+				// Stop oldest note to make room
+				MidiMessage noteOff = noteOffs[oldest];
+				oldest = oldest + 1 == noteOffs.size() ? 0 : oldest + 1;
+				--soundingCount;
+				return noteOff;
+			}
+
+			uint8_t channel = random.Pick(settings.channels, Distribution::Uniform);
+			uint8_t pitch = random.Pick(settings.pitches, settings.distribution);
+			uint8_t velocity = random.Pick(settings.velocities, settings.distribution);
+
+			size_t slot = oldest + soundingCount;
+			if (slot >= noteOffs.size())
+			{
+				slot -= noteOffs.size();
+			}
+			noteOffs[slot] = MakeNoteMessage(channel, pitch, 0);
+			++soundingCount;
+			return MakeNoteMessage(channel, pitch, velocity);
+		}
+
+		// Stops all notes still sounding.
+		// Returns number of Note Offs that couldn't be sent.
+		uint64_t Flush(MidiOutput& midiOutput)
+		{
+			uint64_t failedCount = 0;
+			while (soundingCount > 0)
+			{
+				if (!midiOutput.Send(noteOffs[oldest]))
+				{
+					++failedCount;
+				}
+				oldest = oldest + 1 == noteOffs.size() ? 0 : oldest + 1;
+				--soundingCount;
+			}
+			return failedCount;
+		}
+
+	private:
+		const GeneratorSettings& settings;
+		FastRandom random;
+		std::vector<MidiMessage> noteOffs; // Ring buffer of sounding notes
+		size_t oldest{ 0 };
+		size_t soundingCount{ 0 };
+	};
+
+	const uint64_t NanosecondsPerSecond = 1000000000;
+
+	// Deadline of message index, in whole nanoseconds from start, rounded up:
+	// index / rate seconds. Whole seconds and remainder are split, so
+	// products stay far from overflow (rate is at most 1e9).
+	uint64_t MessageDeadline(uint64_t index, uint64_t rate)
+	{
+		return index / rate * NanosecondsPerSecond
+			+ ((index % rate) * NanosecondsPerSecond + rate - 1) / rate;
+	}
+
+	// Number of messages whose deadline is at or before elapsed nanoseconds.
+	// Same formula as MessageDeadline(), turned around: after sleeping until
+	// MessageDeadline(sent), at least sent + 1 messages are due.
+	uint64_t DueMessages(uint64_t elapsed, uint64_t rate)
+	{
+		return elapsed / NanosecondsPerSecond * rate
+			+ (elapsed % NanosecondsPerSecond) * rate / NanosecondsPerSecond + 1;
+	}
+
+}
+
+GeneratorStats RunGenerator(
+	MidiOutput& midiOutput,
+	Clock& clock,
+	const GeneratorSettings& settings)
+{
+	// After a long stall, clock is re-read at least every batch,
+	// so lateness numbers stay honest
+	const uint64_t MaxBatch = 4096;
+	const uint64_t LateThresholdNanoseconds = 1000000;
+
+	NoteStream noteStream(settings);
+	GeneratorStats stats;
+
+	const uint64_t total = settings.rate * settings.seconds;
+	const int64_t start = clock.Now().count();
+	double latenessSum = 0;
+	double latenessMax = 0;
+
+	uint64_t sent = 0;
+	while (sent < total)
+	{
+		// Absolute deadline of next message.
+		// Integer nanoseconds: clock wakes exactly at deadline, and
+		// next message is due then, so every wakeup sends at least one
+		const uint64_t deadline = MessageDeadline(sent, settings.rate);
+		uint64_t now = static_cast<uint64_t>(std::max<int64_t>(0, clock.Now().count() - start));
+		if (now < deadline)
+		{
+			clock.SleepUntil(std::chrono::nanoseconds(start + static_cast<int64_t>(deadline)));
+			now = std::max(deadline, static_cast<uint64_t>(clock.Now().count() - start));
+		}
+
+		// Everything due by now goes out back to back
+		uint64_t due = DueMessages(now, settings.rate);
+		due = std::min({ due, total, sent + MaxBatch });
+
+		// Lateness of messages sent in this batch, each is "now - own deadline"
+		uint64_t count = due - sent;
+		const double firstLateness = static_cast<double>(now - deadline);
+		const double lastLateness = static_cast<double>(now - MessageDeadline(due - 1, settings.rate));
+		latenessSum += static_cast<double>(count) * (firstLateness + lastLateness) / 2;
+		latenessMax = std::max(latenessMax, firstLateness);
+		if (now - deadline > LateThresholdNanoseconds)
+		{
+			uint64_t lateEnd = DueMessages(now - LateThresholdNanoseconds - 1, settings.rate);
+			uint64_t lateCount = std::min(lateEnd, due) - sent;
+			stats.lateMessageCount += lateCount;
+			CountMetric(Metric::LateEvents, lateCount);
+		}
+		UpdateQueueHighWater(count);
+
+		TraceCounter("wakeup lateness (ns)", static_cast<int64_t>(now - deadline));
+		TraceCounter("queue depth", static_cast<int64_t>(count));
+		TraceScope traceScope("send batch");
+		for (; sent < due; ++sent)
+		{
+			if (!midiOutput.Send(noteStream.Next()))
+			{
+				++stats.failedMessageCount;
+			}
+		}
+		midiOutput.Flush();
+	}
+
+	// Run lasts full settings.seconds, last message has its share of time too
+	clock.SleepUntil(std::chrono::nanoseconds(start + static_cast<int64_t>(MessageDeadline(total, settings.rate))));
+
+	stats.messageCount = sent;
+	stats.elapsedSeconds = static_cast<double>(clock.Now().count() - start) / 1e9;
+	if (stats.elapsedSeconds > 0)
+	{
+		stats.achievedRate = static_cast<double>(sent) / stats.elapsedSeconds;
+	}
+	if (sent > 0)
+	{
+		stats.meanLatenessMicroseconds = latenessSum / static_cast<double>(sent) / 1000;
+	}
+	stats.maxLatenessMicroseconds = latenessMax / 1000;
+
+	stats.failedMessageCount += noteStream.Flush(midiOutput);
+	midiOutput.Flush();
+	return stats;
+}
+
+void PrintGeneratorStats(FILE* file, const GeneratorSettings& settings, const GeneratorStats& stats)
+{
+	fprintf(file, "Generated %llu Midi Messages in %.3f seconds\n",
+		static_cast<unsigned long long>(stats.messageCount), stats.elapsedSeconds);
+	fprintf(file, "Rate: target %llu/s, achieved %.0f/s\n",
+		static_cast<unsigned long long>(settings.rate), stats.achievedRate);
+	fprintf(file, "Timing error: mean %.1f us, max %.1f us, %llu messages late by over 1 ms\n",
+		stats.meanLatenessMicroseconds, stats.maxLatenessMicroseconds,
+		static_cast<unsigned long long>(stats.lateMessageCount));
+	if (stats.failedMessageCount > 0)
+	{
+		fprintf(file, "Failed: %llu Midi Messages couldn't be sent\n",
+			static_cast<unsigned long long>(stats.failedMessageCount));
+	}
+}
@@ -0,0 +1,54 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "Clock.h"
+#include "MidiOutput.h"
+
+#include <cstdint>
+
+enum class Distribution {
+	Uniform,  // Every value in range equally likely
+	Normal,   // Values cluster around middle of range, like real melodies
+};
+
+// Inclusive range of Midi values, for example pitches 36 to 96
+struct ValueRange {
+	uint8_t first;
+	uint8_t last;
+};
+
+// Synthetic load: stream of "Note On" and "Note Off" Midi Messages.
+struct GeneratorSettings {
+	uint64_t rate{ 1000 };      // Midi Messages per second
+	uint64_t seconds{ 1 };      // How long to generate
+	ValueRange channels{ 0, 15 };
+	ValueRange pitches{ 36, 96 };
+	ValueRange velocities{ 1, 127 };
+	Distribution distribution{ Distribution::Uniform };
+	uint32_t polyphony{ 8 };    // Max notes sounding at once
+	uint64_t seed{ 1 };
+};
+
+struct GeneratorStats {
+	uint64_t messageCount{ 0 };
+	double elapsedSeconds{ 0 };
+	double achievedRate{ 0 };       // Midi Messages per second
+	double meanLatenessMicroseconds{ 0 };
+	double maxLatenessMicroseconds{ 0 };
+	uint64_t lateMessageCount{ 0 }; // Sent more than 1 ms after deadline
+	uint64_t failedMessageCount{ 0 }; // Backend couldn't deliver
+};
+
+// Sends settings.rate * settings.seconds Midi Messages.
+// Every message has absolute deadline: start + index / rate.
+// Messages that are due are sent back to back, then generator sleeps
+// until next deadline, so sleep errors never accumulate.
+// Notes still sounding at the end are stopped (not counted in stats).
+GeneratorStats RunGenerator(
+	MidiOutput& midiOutput,
+	Clock& clock,
+	const GeneratorSettings& settings);
+
+void PrintGeneratorStats(FILE* file, const GeneratorSettings& settings, const GeneratorStats& stats);
@@ -0,0 +1,316 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Latency.h"
+
+#include "Parse.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+bool MidiInput::Receive(
+	std::chrono::nanoseconds timeout,
+	MidiMessage& midiMessage,
+	std::chrono::steady_clock::time_point& arrival)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!arrived.wait_for(lock, timeout, [this] { return !arrivals.empty(); }))
+	{
+		return false;
+	}
+	midiMessage = arrivals.front().midiMessage;
+	arrival = arrivals.front().time;
+	arrivals.pop_front();
+	return true;
+}
+
+void MidiInput::Deliver(MidiMessage midiMessage)
+{
+	// Timestamp first: waiting for lock isn't part of round trip
+	std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		arrivals.push_back({ midiMessage, time });
+	}
+	arrived.notify_one();
+}
+
+namespace {
+
+	// Called by Windows on its own thread, for every incoming message
+	void CALLBACK MidiInCallback(HMIDIIN, UINT message, DWORD_PTR instance, DWORD_PTR param1, DWORD_PTR)
+	{
+		if (message != MIM_DATA)
+		{
+			// Open, close, System Exclusive: not probes
+			return;
+		}
+		// param1 is packed same way as midiOutShortMsg() takes it
+		MidiMessage midiMessage;
+		midiMessage.dataDWord = static_cast<uint32_t>(param1);
+		reinterpret_cast<MidiInput*>(instance)->Deliver(midiMessage);
+	}
+
+	const uint8_t ProbeControl = 119; // Undefined controller, synths ignore it
+
+	double Percentile(const std::vector<double>& sorted, double fraction)
+	{
+		size_t index = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+		return sorted[std::min(sorted.size(), std::max<size_t>(index, 1)) - 1];
+	}
+
+	LatencyStats Summarize(uint32_t sentCount, std::vector<double>& roundTrips)
+	{
+		LatencyStats stats;
+		stats.sentCount = sentCount;
+		stats.receivedCount = static_cast<uint32_t>(roundTrips.size());
+		if (roundTrips.empty())
+		{
+			return stats;
+		}
+
+		std::sort(roundTrips.begin(), roundTrips.end());
+		double sum = 0;
+		for (double roundTrip : roundTrips)
+		{
+			sum += roundTrip;
+		}
+		stats.meanMicroseconds = sum / static_cast<double>(roundTrips.size());
+
+		double squares = 0;
+		for (double roundTrip : roundTrips)
+		{
+			squares += (roundTrip - stats.meanMicroseconds) * (roundTrip - stats.meanMicroseconds);
+		}
+		stats.jitterMicroseconds = std::sqrt(squares / static_cast<double>(roundTrips.size()));
+
+		stats.minMicroseconds = roundTrips.front();
+		stats.medianMicroseconds = Percentile(roundTrips, 0.5);
+		stats.p99Microseconds = Percentile(roundTrips, 0.99);
+		stats.maxMicroseconds = roundTrips.back();
+		return stats;
+	}
+
+	std::string ToUtf8(const WCHAR* text)
+	{
+		int size = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+		if (size <= 1)
+		{
+			return {};
+		}
+		std::string result(static_cast<size_t>(size), '\0');
+		WideCharToMultiByte(CP_UTF8, 0, text, -1, result.data(), size, nullptr, nullptr);
+		result.resize(static_cast<size_t>(size) - 1); // Terminating zero
+		return result;
+	}
+
+}
+
+MidiExpected<std::unique_ptr<WinMmMidiInput>> WinMmMidiInput::Open(UINT deviceId)
+{
+	std::unique_ptr<WinMmMidiInput> midiInput(new WinMmMidiInput());
+	MidiResult result(midiInOpen(
+		/*out*/ &midiInput->hMidiIn,
+		/*uDeviceID*/ deviceId,
+		/*dwCallback*/ reinterpret_cast<DWORD_PTR>(&MidiInCallback),
+		/*dwInstance*/ reinterpret_cast<DWORD_PTR>(static_cast<MidiInput*>(midiInput.get())),
+		/*fdwOpen*/ CALLBACK_FUNCTION
+	));
+	if (!result)
+	{
+		midiInput->hMidiIn = nullptr;
+		return result;
+	}
+
+	// Messages only arrive after start
+	result = MidiResult(midiInStart(midiInput->hMidiIn));
+	if (!result)
+	{
+		return result;
+	}
+	return midiInput;
+}
+
+WinMmMidiInput::~WinMmMidiInput()
+{
+	if (hMidiIn != nullptr)
+	{
+		midiInStop(hMidiIn);
+		midiInReset(hMidiIn);
+		midiInClose(hMidiIn);
+	}
+}
+
+MidiResult LoopbackMidiOutput::Write(MidiMessage midiMessage)
+{
+	input.Deliver(midiMessage);
+	return MidiResult();
+}
+
+MidiExpected<LatencyStats> CalibrateLatency(
+	MidiOutput& midiOutput,
+	MidiInput& midiInput,
+	const CalibrationSettings& settings)
+{
+	std::vector<double> roundTrips;
+	roundTrips.reserve(settings.probeCount);
+	const std::chrono::milliseconds timeout(settings.timeoutMs);
+	const std::chrono::milliseconds interval(settings.intervalMs);
+
+	for (uint32_t i = 0; i < settings.probeCount; ++i)
+	{
+		// Probe carries its number, so late probes aren't taken for current one
+		const MidiMessage probe = MakeControlChangeMessage(settings.channel, ProbeControl, static_cast<uint8_t>(i & 0x7F));
+		const std::chrono::steady_clock::time_point sendTime = std::chrono::steady_clock::now();
+		MidiResult result = midiOutput.Send(probe);
+		midiOutput.Flush();
+		if (!result)
+		{
+			return result;
+		}
+
+		const std::chrono::steady_clock::time_point deadline = sendTime + timeout;
+		MidiMessage midiMessage;
+		std::chrono::steady_clock::time_point arrival;
+		while (midiInput.Receive(deadline - std::chrono::steady_clock::now(), midiMessage, arrival))
+		{
+			if (midiMessage.dataDWord == probe.dataDWord)
+			{
+				roundTrips.push_back(std::chrono::duration<double, std::micro>(arrival - sendTime).count());
+				break;
+			}
+		}
+
+		std::this_thread::sleep_until(sendTime + interval);
+	}
+
+	return Summarize(settings.probeCount, roundTrips);
+}
+
+void PrintLatencyStats(FILE* file, const LatencyStats& stats)
+{
+	fprintf(file, "Probes: %u sent, %u received, %u lost\n",
+		stats.sentCount, stats.receivedCount, stats.sentCount - stats.receivedCount);
+	if (stats.receivedCount == 0)
+	{
+		return;
+	}
+	fprintf(file, "Round trip: min %.1f us, median %.1f us, mean %.1f us, p99 %.1f us, max %.1f us\n",
+		stats.minMicroseconds, stats.medianMicroseconds, stats.meanMicroseconds,
+		stats.p99Microseconds, stats.maxMicroseconds);
+	fprintf(file, "Jitter: %.1f us\n", stats.jitterMicroseconds);
+}
+
+bool LoadLatencyProfiles(const char* path, std::vector<LatencyProfile>& profiles)
+{
+	profiles.clear();
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "rb") != 0 || file == nullptr)
+	{
+		return true;
+	}
+	std::string contents;
+	char buffer[4096];
+	size_t count = 0;
+	while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+	{
+		contents.append(buffer, count);
+	}
+	fclose(file);
+
+	std::string_view text(contents);
+	unsigned line = 0;
+	while (!text.empty())
+	{
+		++line;
+		size_t lineEnd = text.find('\n');
+		std::string_view lineText = text.substr(0, lineEnd);
+		text = lineEnd == std::string_view::npos ? std::string_view() : text.substr(lineEnd + 1);
+		if (!lineText.empty() && lineText.back() == '\r')
+		{
+			lineText.remove_suffix(1);
+		}
+		if (lineText.empty())
+		{
+			continue;
+		}
+
+		size_t space = lineText.find(' ');
+		LatencyProfile profile{};
+		if (space == std::string_view::npos
+			|| !ParseSigned<int64_t>(lineText.substr(0, space), -10000000, 10000000, profile.latencyMicroseconds))
+		{
+			fprintf(stderr, "Latency file %s, line %u: expected <microseconds> <device name>\n", path, line);
+			return false;
+		}
+		profile.deviceName = lineText.substr(space + 1);
+		profiles.push_back(std::move(profile));
+	}
+	return true;
+}
+
+bool SaveLatencyProfile(const char* path, const LatencyProfile& profile)
+{
+	std::vector<LatencyProfile> profiles;
+	if (!LoadLatencyProfiles(path, profiles))
+	{
+		return false;
+	}
+	auto existing = std::find_if(profiles.begin(), profiles.end(),
+		[&](const LatencyProfile& p) { return p.deviceName == profile.deviceName; });
+	if (existing != profiles.end())
+	{
+		*existing = profile;
+	}
+	else
+	{
+		profiles.push_back(profile);
+	}
+
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "wb") != 0 || file == nullptr)
+	{
+		fprintf(stderr, "Can't open latency file: %s\n", path);
+		return false;
+	}
+	for (const LatencyProfile& p : profiles)
+	{
+		fprintf(file, "%lld %s\n", static_cast<long long>(p.latencyMicroseconds), p.deviceName.c_str());
+	}
+	bool ok = ferror(file) == 0;
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+	{
+		fprintf(stderr, "Can't write latency file: %s\n", path);
+	}
+	return ok;
+}
+
+std::optional<int64_t> FindLatency(const std::vector<LatencyProfile>& profiles, const std::string& deviceName)
+{
+	for (const LatencyProfile& profile : profiles)
+	{
+		if (profile.deviceName == deviceName)
+		{
+			return profile.latencyMicroseconds;
+		}
+	}
+	return std::nullopt;
+}
+
+std::string LatencyDeviceName(MidiBackend backend, UINT deviceId)
+{
+	if (backend != MidiBackend::WinMm)
+	{
+		// Other backends are calibrated against in-process loopback
+		return "Loopback";
+	}
+	MIDIOUTCAPSW caps{};
+	if (midiOutGetDevCapsW(deviceId, &caps, sizeof(caps)) != MMSYSERR_NOERROR)
+	{
+		return {};
+	}
+	return ToUtf8(caps.szPname);
+}
@@ -0,0 +1,131 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+
+#include <Windows.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Output latency calibration.
+//
+// Time from midiOutShortMsg() until synthesizer plays note differs per
+// device: a few milliseconds for hardware on USB, tens of milliseconds for
+// software synthesizers with big audio buffers.
+// To measure it, connect device's Midi Out back to a Midi In
+// (cable, or virtual loopback port), send probe messages and time
+// their return. Round trip includes input delay too, so result is
+// upper bound of output latency; for loopback ports it's what a
+// synthesizer listening on the same port sees.
+//
+// Measured latency is saved per device name, and scheduler sends
+// every message that much earlier (see MidiOutput::SetLatency()).
+
+// Midi Messages coming in, with time they arrived
+class MidiInput {
+public:
+	virtual ~MidiInput() = default;
+
+	// Waits for next message, up to timeout.
+	// Returns false on timeout.
+	bool Receive(
+		std::chrono::nanoseconds timeout,
+		MidiMessage& midiMessage,
+		std::chrono::steady_clock::time_point& arrival);
+
+	// Called by driver thread (or by loopback output) for every message
+	void Deliver(MidiMessage midiMessage);
+
+private:
+	struct Arrival {
+		MidiMessage midiMessage;
+		std::chrono::steady_clock::time_point time;
+	};
+
+	std::mutex mutex;
+	std::condition_variable arrived;
+	std::deque<Arrival> arrivals;
+};
+
+// Windows Midi input device, midiInOpen()
+class WinMmMidiInput : public MidiInput {
+public:
+	// Opens and starts device
+	static MidiExpected<std::unique_ptr<WinMmMidiInput>> Open(UINT deviceId);
+
+	~WinMmMidiInput() override;
+
+private:
+	WinMmMidiInput() = default;
+
+	HMIDIIN hMidiIn{ nullptr };
+};
+
+// In-process stand-in for loopback cable: every message sent
+// arrives on input right away. Measures cost of delivery path itself,
+// and lets calibration run without Midi hardware.
+class LoopbackMidiOutput : public MidiOutput {
+public:
+	explicit LoopbackMidiOutput(MidiInput& input) : input(input) {}
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	MidiInput& input;
+};
+
+struct CalibrationSettings {
+	uint32_t probeCount{ 100 };
+	uint32_t intervalMs{ 10 };   // Between probes, so they don't queue up
+	uint32_t timeoutMs{ 500 };   // Probe not back by then is lost
+	uint8_t channel{ 15 };       // Probes are Control Change 119 (undefined), silent
+};
+
+struct LatencyStats {
+	uint32_t sentCount{ 0 };
+	uint32_t receivedCount{ 0 };
+	double minMicroseconds{ 0 };
+	double medianMicroseconds{ 0 };
+	double meanMicroseconds{ 0 };
+	double p99Microseconds{ 0 };
+	double maxMicroseconds{ 0 };
+	double jitterMicroseconds{ 0 };  // Standard deviation
+};
+
+// Sends probes one by one and waits for each to come back.
+// Messages that aren't current probe (other traffic, late probes) are skipped.
+// Returns first send failure.
+MidiExpected<LatencyStats> CalibrateLatency(
+	MidiOutput& midiOutput,
+	MidiInput& midiInput,
+	const CalibrationSettings& settings);
+
+void PrintLatencyStats(FILE* file, const LatencyStats& stats);
+
+// Latency file: one line per device, "<microseconds> <device name>"
+struct LatencyProfile {
+	int64_t latencyMicroseconds;
+	std::string deviceName;  // UTF-8
+};
+
+// Missing file is not an error: nothing calibrated yet
+bool LoadLatencyProfiles(const char* path, std::vector<LatencyProfile>& profiles);
+
+// Replaces device's line, or adds it
+bool SaveLatencyProfile(const char* path, const LatencyProfile& profile);
+
+std::optional<int64_t> FindLatency(const std::vector<LatencyProfile>& profiles, const std::string& deviceName);
+
+// Name that latency file uses for device of backend
+std::string LatencyDeviceName(MidiBackend backend, UINT deviceId);
@@ -0,0 +1,109 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "GeneralMidi.h"
+#include "MidiMessage.h"
+#include "Parse.h"
+#include "Player.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Melodies built entirely at compile time.
+// Result is std::array of timed Midi Messages baked into the executable:
+// playback does no parsing and no memory allocation.
+//
+// Example:
+//   constexpr MelodyNote Notes[] = { { NotePitch("C4"), 90, 250 }, { NotePitch("G4"), 90, 500 } };
+//   constexpr auto Jingle = MakeMelody(/*channel*/ 0, /*instrument*/ 24, Notes);
+//   PlayEvents(midiOutput, clock, Jingle.data(), Jingle.size());
+
+struct MelodyNote {
+	uint8_t pitch;        // 7 bits, 0 to 127
+	uint8_t velocity;     // 7 bits, 0 to 127. 0 is a rest
+	uint32_t durationMs;
+};
+
+// Note name to Midi pitch at compile time: "C4" is Middle C (60), "F#3" is 54, "Bb-1" is 10.
+// Bad name doesn't compile when used in constant expression.
+template <size_t Length>
+constexpr uint8_t NotePitch(const char(&name)[Length])
+{
+	NoteName note = ParseNoteName(std::string_view(name, Length - 1));
+	if (note.error != nullptr)
+	{
+		throw note.error;
+	}
+	if (note.length != Length - 1)
+	{
+		throw "Note name has extra characters";
+	}
+	return note.pitch;
+}
+
+// Compiles notes, played one after another, into timed Midi Messages:
+// Select Midi Instrument, then "Note On" and "Note Off" for every note.
+// Same output as CompileNotes(), but at compile time.
+template <size_t NoteCount>
+constexpr std::array<MidiEvent, 1 + 2 * NoteCount> MakeMelody(
+	uint8_t channel,
+	uint8_t instrument,
+	const MelodyNote(&notes)[NoteCount])
+{
+	std::array<MidiEvent, 1 + 2 * NoteCount> midiEvents{};
+	midiEvents[0] = MidiEvent{ 0, MakeInstrumentMessage(channel, instrument) };
+
+	int64_t timeMicroseconds = 0;
+	for (size_t i = 0; i < NoteCount; ++i)
+	{
+		midiEvents[1 + 2 * i] = MidiEvent{ timeMicroseconds, MakeNoteMessage(channel, notes[i].pitch, notes[i].velocity) };
+		timeMicroseconds += static_cast<int64_t>(notes[i].durationMs) * 1000;
+		midiEvents[2 + 2 * i] = MidiEvent{ timeMicroseconds, MakeNoteMessage(channel, notes[i].pitch, 0) };
+	}
+	return midiEvents;
+}
+
+//
+// Built-in jingles
+//
+
+namespace Jingles {
+
+	// Rising Guitar arpeggio, C major
+	constexpr MelodyNote StartupNotes[] = {
+		{ NotePitch("C4"), 90, 150 },
+		{ NotePitch("E4"), 90, 150 },
+		{ NotePitch("G4"), 90, 150 },
+		{ NotePitch("C5"), 100, 600 },
+	};
+	constexpr auto Startup = MakeMelody(/*channel*/ 0, GeneralMidi::Instrument("Acoustic Guitar (nylon)"), StartupNotes);
+
+	// Falling Guitar arpeggio, C minor
+	constexpr MelodyNote ShutdownNotes[] = {
+		{ NotePitch("C5"), 90, 150 },
+		{ NotePitch("G4"), 90, 150 },
+		{ NotePitch("Eb4"), 90, 150 },
+		{ NotePitch("C4"), 80, 600 },
+	};
+	constexpr auto Shutdown = MakeMelody(/*channel*/ 0, GeneralMidi::Instrument("Acoustic Guitar (nylon)"), ShutdownNotes);
+
+	// "Twinkle Twinkle Little Star", first line, on Piano
+	constexpr MelodyNote TwinkleNotes[] = {
+		{ NotePitch("C4"), 90, 400 }, { NotePitch("C4"), 90, 400 },
+		{ NotePitch("G4"), 90, 400 }, { NotePitch("G4"), 90, 400 },
+		{ NotePitch("A4"), 90, 400 }, { NotePitch("A4"), 90, 400 },
+		{ NotePitch("G4"), 90, 800 },
+	};
+	constexpr auto Twinkle = MakeMelody(/*channel*/ 0, GeneralMidi::Instrument("Acoustic Grand Piano"), TwinkleNotes);
+
+	// Compile-time checks
+	static_assert(NotePitch("C4") == 60, "Middle C");
+	static_assert(NotePitch("Bb-1") == 10, "Lowest octave");
+	static_assert(Startup.size() == 9, "Instrument + 4 Note On + 4 Note Off");
+	static_assert(Startup[1].midiMessage.dataDWord == MakeNoteMessage(0, 60, 90).dataDWord, "First note");
+	static_assert(Startup[8].timeMicroseconds == 1050000, "Last Note Off");
+
+}
@@ -0,0 +1,157 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Metrics.h"
+
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	// Blocks outlive their threads, so counts of finished threads stay in totals
+	std::mutex metricsMutex;
+	std::vector<std::unique_ptr<ThreadMetrics>> allThreadMetrics;
+
+	const char* const MetricNames[] = {
+		"midi_messages_sent_total{type=\"note_off\"}",
+		"midi_messages_sent_total{type=\"note_on\"}",
+		"midi_messages_sent_total{type=\"aftertouch\"}",
+		"midi_messages_sent_total{type=\"control_change\"}",
+		"midi_messages_sent_total{type=\"program_change\"}",
+		"midi_messages_sent_total{type=\"channel_pressure\"}",
+		"midi_messages_sent_total{type=\"pitch_bend\"}",
+		"midi_messages_sent_total{type=\"system\"}",
+		"midi_messages_dropped_total",
+		"midi_events_late_total",
+		"midi_send_errors_total",
+		"midi_device_reopens_total",
+	};
+	static_assert(sizeof(MetricNames) / sizeof(MetricNames[0]) == static_cast<size_t>(Metric::Count), "Name for every metric");
+
+	// Metrics dump thread
+	struct MetricsDump {
+		std::string path;
+		uint32_t intervalMs{ 0 };
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable wakeUp;
+		bool stop{ false };
+	};
+	std::unique_ptr<MetricsDump> metricsDump;
+
+	void DumpMetrics(const std::string& path)
+	{
+		// Write next to target, then rename over it
+		std::string temporaryPath = path + ".tmp";
+		FILE* file = nullptr;
+		if (fopen_s(&file, temporaryPath.c_str(), "wb") != 0 || file == nullptr)
+		{
+			return;
+		}
+		WriteMetrics(file, ReadMetrics());
+		bool ok = ferror(file) == 0;
+		fclose(file);
+
+		std::error_code error;
+		if (ok)
+		{
+			std::filesystem::rename(temporaryPath, path, error);
+		}
+	}
+
+}
+
+ThreadMetrics* RegisterMetricsThread()
+{
+	// Value-initialized: all counters start at 0
+	auto metrics = std::make_unique<ThreadMetrics>();
+
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	threadMetrics = metrics.get();
+	allThreadMetrics.push_back(std::move(metrics));
+	return threadMetrics;
+}
+
+MetricsSnapshot ReadMetrics()
+{
+	MetricsSnapshot snapshot;
+
+	std::lock_guard<std::mutex> lock(metricsMutex);
+	for (const std::unique_ptr<ThreadMetrics>& metrics : allThreadMetrics)
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(Metric::Count); ++i)
+		{
+			snapshot.counters[i] += metrics->counters[i].load(std::memory_order_relaxed);
+		}
+		for (uint32_t i = 0; i < MetricErrorCodeCount; ++i)
+		{
+			snapshot.errorCodes[i] += metrics->errorCodes[i].load(std::memory_order_relaxed);
+		}
+		uint64_t highWater = metrics->queueHighWater.load(std::memory_order_relaxed);
+		if (highWater > snapshot.queueHighWater)
+		{
+			snapshot.queueHighWater = highWater;
+		}
+	}
+	return snapshot;
+}
+
+void WriteMetrics(FILE* file, const MetricsSnapshot& snapshot)
+{
+	for (uint32_t i = 0; i < static_cast<uint32_t>(Metric::Count); ++i)
+	{
+		fprintf(file, "%s %llu\n", MetricNames[i], static_cast<unsigned long long>(snapshot.counters[i]));
+	}
+	fprintf(file, "midi_queue_high_water %llu\n", static_cast<unsigned long long>(snapshot.queueHighWater));
+	for (uint32_t i = 0; i < MetricErrorCodeCount; ++i)
+	{
+		if (snapshot.errorCodes[i] > 0)
+		{
+			// Windows Midi error code (MMRESULT), see mmeapi.h
+			fprintf(file, "midi_send_errors_total{code=\"%u\"} %llu\n", i, static_cast<unsigned long long>(snapshot.errorCodes[i]));
+		}
+	}
+}
+
+void StartMetricsDump(const char* path, uint32_t intervalMs)
+{
+	metricsDump = std::make_unique<MetricsDump>();
+	metricsDump->path = path;
+	metricsDump->intervalMs = intervalMs > MinMetricsIntervalMs ? intervalMs : MinMetricsIntervalMs;
+
+	MetricsDump* dump = metricsDump.get();
+	dump->thread = std::thread([dump]()
+		{
+			std::unique_lock<std::mutex> lock(dump->mutex);
+			while (!dump->stop)
+			{
+				lock.unlock();
+				DumpMetrics(dump->path);
+				lock.lock();
+				dump->wakeUp.wait_for(lock, std::chrono::milliseconds(dump->intervalMs), [dump]() { return dump->stop; });
+			}
+		});
+}
+
+void StopMetricsDump()
+{
+	if (!metricsDump)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(metricsDump->mutex);
+		metricsDump->stop = true;
+	}
+	metricsDump->wakeUp.notify_one();
+	metricsDump->thread.join();
+
+	DumpMetrics(metricsDump->path);
+	metricsDump.reset();
+}
@@ -0,0 +1,148 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiMessage.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+// Live counters for operators: messages sent per type, drops,
+// late events, queue high-water mark and backend error codes.
+//
+// Every thread counts into its own cache-line aligned block,
+// so threads never fight over same cache line and counting
+// needs no locked instruction. Reading sums all blocks.
+
+enum class Metric : uint32_t {
+	// Messages sent, by Status byte signature (upper 4 bits 0b1000 to 0b1111)
+	SentNoteOff,
+	SentNoteOn,
+	SentAftertouch,
+	SentControlChange,
+	SentInstrument,
+	SentChannelPressure,
+	SentPitchBend,
+	SentSystem,
+
+	DroppedMessages,   // Messages backend couldn't deliver
+	LateEvents,        // Events sent more than 1 ms after deadline
+	SendErrors,        // Backend calls that returned error
+	DeviceReopens,     // Device reopened after it went away
+
+	Count
+};
+
+// Windows Midi error codes (MMRESULT) are small numbers,
+// larger ones are counted in last slot
+const uint32_t MetricErrorCodeCount = 128;
+
+struct alignas(64) ThreadMetrics {
+	std::atomic<uint64_t> counters[static_cast<uint32_t>(Metric::Count)];
+	std::atomic<uint64_t> errorCodes[MetricErrorCodeCount];
+	std::atomic<uint64_t> queueHighWater;
+};
+
+inline thread_local ThreadMetrics* threadMetrics = nullptr;
+
+// Slow path: first count on this thread allocates its block
+ThreadMetrics* RegisterMetricsThread();
+
+inline ThreadMetrics& CurrentThreadMetrics()
+{
+	ThreadMetrics* metrics = threadMetrics;
+	return metrics != nullptr ? *metrics : *RegisterMetricsThread();
+}
+
+// Only owner thread writes its counters: plain load and store,
+// no read-modify-write needed
+inline void AddToCounter(std::atomic<uint64_t>& counter, uint64_t value)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+inline void CountMetric(Metric metric, uint64_t value = 1)
+{
+	AddToCounter(CurrentThreadMetrics().counters[static_cast<uint32_t>(metric)], value);
+}
+
+// Counts by Status byte signature alone
+inline void CountSentStatus(uint8_t statusByte)
+{
+	// 0b1000 (Note Off) is first, 0b1111 (System) is last
+	uint32_t type = static_cast<uint32_t>(statusByte >> 4) - 0b1000;
+	if (type < 8)
+	{
+		AddToCounter(CurrentThreadMetrics().counters[type], 1);
+	}
+}
+
+// Note On with velocity 0 is Note Off, and is counted as Note Off:
+// this project turns notes off that way, so note_off counts them all
+inline void CountSentMessage(MidiMessage midiMessage)
+{
+	uint8_t statusByte = midiMessage.Status();
+	if ((statusByte >> 4) == NoteOnSignature && midiMessage.Data2() == 0)
+	{
+		statusByte = static_cast<uint8_t>((NoteOffSignature << 4) | (statusByte & 0x0F));
+	}
+	CountSentStatus(statusByte);
+}
+
+// Universal MIDI Packet (see Ump.h): System, Midi 1.0 and Midi 2.0
+// Channel Voice packets (Message Types 1, 2 and 4) have Status byte
+// in same place, so they are counted as Midi 1.0 messages.
+// Types 1 and 2 carry Midi 1.0 data bytes too. Midi 2.0 Note On
+// with velocity 0 is still Note On, so type 4 is counted by Status byte.
+inline void CountSentUmp(uint32_t word0)
+{
+	uint32_t messageType = word0 >> 28;
+	if (messageType == 0x1 || messageType == 0x2)
+	{
+		CountSentMessage(MidiMessage(static_cast<uint8_t>(word0 >> 16), static_cast<uint8_t>(word0 >> 8), static_cast<uint8_t>(word0)));
+	}
+	else if (messageType == 0x4)
+	{
+		CountSentStatus(static_cast<uint8_t>(word0 >> 16));
+	}
+}
+
+inline void CountSendError(uint32_t errorCode)
+{
+	ThreadMetrics& metrics = CurrentThreadMetrics();
+	AddToCounter(metrics.counters[static_cast<uint32_t>(Metric::SendErrors)], 1);
+	AddToCounter(metrics.errorCodes[errorCode < MetricErrorCodeCount ? errorCode : MetricErrorCodeCount - 1], 1);
+}
+
+inline void UpdateQueueHighWater(uint64_t depth)
+{
+	std::atomic<uint64_t>& highWater = CurrentThreadMetrics().queueHighWater;
+	if (depth > highWater.load(std::memory_order_relaxed))
+	{
+		highWater.store(depth, std::memory_order_relaxed);
+	}
+}
+
+// Sum over all threads
+struct MetricsSnapshot {
+	uint64_t counters[static_cast<uint32_t>(Metric::Count)]{};
+	uint64_t errorCodes[MetricErrorCodeCount]{};
+	uint64_t queueHighWater{ 0 };
+};
+
+MetricsSnapshot ReadMetrics();
+
+// Text format, one "name value" per line, Prometheus style
+void WriteMetrics(FILE* file, const MetricsSnapshot& snapshot);
+
+// Background thread that rewrites file every intervalMs,
+// so operators can watch it (for example "type" or Prometheus textfile collector).
+// File is replaced atomically: readers never see half-written file.
+// Shorter intervals than MinMetricsIntervalMs would spend a core on rewriting file.
+constexpr uint32_t MinMetricsIntervalMs = 10;
+void StartMetricsDump(const char* path, uint32_t intervalMs);
+
+// Stops thread and writes final values
+void StopMetricsDump();
@@ -2,126 +2,555 @@
 // Licensed under the MIT license.
 
 // REQUIREMENTS!
-// 
+//
 // Add following lib file to C++ Linker:
 // winmm.lib
 // For example, in Visual Studio:
 // Project > Properties > Configuration Properties > Linker > Input > Additional Dependencies
 // Add: winmm.lib
 
-#include <Windows.h>
+#include "Benchmark.h"
+#include "Clock.h"
+#include "CommandLine.h"
+#include "DeviceState.h"
+#include "FileUtil.h"
+#include "Filter.h"
+#include "Generator.h"
+#include "Latency.h"
+#include "Melody.h"
+#include "Metrics.h"
+#include "MidiDevices.h"
+#include "MidiOutput.h"
+#include "MidiStream.h"
+#include "Panic.h"
+#include "Pipeline.h"
+#include "Programs.h"
+#include "Player.h"
+#include "Score.h"
+#include "Trace.h"
+#include "Transcode.h"
 
-#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <exception>
-#include <iostream>
+#include <string>
 #include <thread>
+#include <vector>
 
-// Midi Message is 4 bytes.
-// Windows Midi midiOutShortMsg() Api passes
-// those 4 bytes as DWORD type.
-// Use C++ Union structure to easily overlap DWORD onto 
-// Midi's 4 bytes and initialize these bytes to 0
-union MidiMessage {
-	BYTE dataByte[4];
-	DWORD dataDWord{ 0 }; // Note: because it's a "union", this also zeros out all 4 bytes in bData array
-};
-
-// Plays Midi Note
-// To Stop playing, set velocity parameter to 0
-void SendMidiNote(
-	HMIDIOUT hMidiOut,
-	uint8_t channel,  // 4 bits, 0 to 15
-	uint8_t pitch,    // 7 bits, 0 to 127
-	uint8_t velocity  // 7 bits, 0 to 127
-)
+// Prints why playback couldn't send everything.
+// Returns process exit code.
+int ReportPlayResult(MidiResult result)
 {
-	// "Note On" Protocol:
-	// [0] Status byte     : 0b 1001 CCCC
-	//     Note On Signature   : 0b 1001
-	//     Channel 4-bits      : 0b CCCC
-	// [1] Pitch 7-bits    : 0b 0PPP PPPP
-	// [2] Velocity 7-bits : 0b 0VVV VVVV
-	// [3] Unused          : 0b 0000 0000
-	// Reference: https://www.cs.cmu.edu/~music/cmsip/readings/MIDI%20tutorial%20for%20programmers.html
-
-	// To Turn "Note Off", simply pass 0 as Velocity (Volume)
-
-	const uint8_t NoteOnSignature = 0b1001;
-	uint8_t statusByte = NoteOnSignature;      // 0b 0000 1001
-	statusByte = statusByte << 4;              // 0b 1001 0000
-	statusByte = statusByte | channel;         // 0b 1001 CCCC
-
-	MidiMessage midiMessage;
-	midiMessage.dataByte[0] = statusByte;  // MIDI Status byte
-	midiMessage.dataByte[1] = pitch;       // First MIDI data byte
-	midiMessage.dataByte[2] = velocity;    // Second MIDI data byte
-	// Byte [3] is unused
-
-	midiOutShortMsg(hMidiOut, midiMessage.dataDWord);
+	if (!result)
+	{
+		fprintf(stderr, "Can't send Midi Message: %s (%u)\n", result.Message(), result.Code());
+		return 1;
+	}
+	return 0;
+}
+
+// Measures device's latency over Midi loopback, and saves it.
+// Returns process exit code.
+int RunCalibration(const Options& options)
+{
+	std::unique_ptr<MidiInput> midiInput;
+	std::unique_ptr<MidiOutput> midiOutput;
+	if (options.backend == MidiBackend::WinMm)
+	{
+		midiOutput = CreateMidiOutput(options.backend, options.deviceId, nullptr);
+		if (!midiOutput)
+		{
+			return 1;
+		}
+		MidiExpected<std::unique_ptr<WinMmMidiInput>> winMmMidiInput = WinMmMidiInput::Open(options.inputDeviceId);
+		if (!winMmMidiInput)
+		{
+			fprintf(stderr, "Can't open Midi input device %u: %s (%u)\n",
+				options.inputDeviceId, winMmMidiInput.Error().Message(), winMmMidiInput.Error().Code());
+			return 1;
+		}
+		midiInput = std::move(*winMmMidiInput);
+	}
+	else
+	{
+		// No device to loop back: measure in-process delivery instead
+		midiInput = std::make_unique<MidiInput>();
+		midiOutput = std::make_unique<LoopbackMidiOutput>(*midiInput);
+	}
+
+	std::string deviceName = LatencyDeviceName(options.backend, options.deviceId);
+	printf("Calibrate: %s, %u probes\n", deviceName.c_str(), options.calibration.probeCount);
+	MidiExpected<LatencyStats> stats = CalibrateLatency(*midiOutput, *midiInput, options.calibration);
+	if (!stats)
+	{
+		return ReportPlayResult(stats.Error());
+	}
+	PrintLatencyStats(stdout, *stats);
+	if ((*stats).receivedCount == 0)
+	{
+		fputs("No probes came back: is Midi Out connected to Midi In?\n", stderr);
+		return 1;
+	}
+
+	if (options.latencyPath != nullptr)
+	{
+		// Median: one slow probe (scheduler hiccup) doesn't shift everything
+		LatencyProfile profile{ std::llround((*stats).medianMicroseconds), deviceName };
+		if (!SaveLatencyProfile(options.latencyPath, profile))
+		{
+			return 1;
+		}
+		printf("Saved latency %lld us to %s\n", static_cast<long long>(profile.latencyMicroseconds), options.latencyPath);
+	}
+	return 0;
 }
 
-void SelectMidiInstrument(
-	HMIDIOUT hMidiOut,
-	uint8_t channel,       // 4 bits, 0 to 15
-	uint8_t instrument     // 7 bits, 0 to 127
-)
+// Converts directory of Standard Midi Files.
+// Returns process exit code.
+int RunTranscode(const Options& options)
 {
-	// "Select Midi Instrument" Protocol:
-	// [0] Status byte          : 0b 1100 CCCC
-	//     Select Instrument Signature      : 0b 1100
-	//     Channel 4-bits                   : 0b CCCC
-	// [1] Instrument 7-bits    : 0b 0III IIII
-	// [2] Unused               : 0b 0000 0000
-	// [3] Unused               : 0b 0000 0000
-
-	const uint8_t SetInstrumentSignature = 0b1100;
-	uint8_t statusByte = SetInstrumentSignature; // 0b 0000 1100
-	statusByte = statusByte << 4;                // 0b 1100 0000
-	statusByte |= channel;                       // 0b 1100 CCCC
-
-	MidiMessage midiMessage;
-	midiMessage.dataByte[0] = statusByte;       // MIDI Status byte
-	midiMessage.dataByte[1] = instrument;       // First MIDI data byte
-	// Bytes [2] and [3] are unused
-
-	midiOutShortMsg(hMidiOut, midiMessage.dataDWord);
+	if (options.inputDirectory == nullptr || options.outputDirectory == nullptr)
+	{
+		fputs("Transcode requires --input-dir and --output-dir\n", stderr);
+		return 1;
+	}
+	std::vector<std::filesystem::path> inputPaths = ListSmfFiles(options.inputDirectory);
+	if (inputPaths.empty())
+	{
+		fprintf(stderr, "No Standard Midi Files in %s\n", options.inputDirectory);
+		return 1;
+	}
+	std::error_code errorCode;
+	std::filesystem::create_directories(options.outputDirectory, errorCode);
+	if (errorCode)
+	{
+		fprintf(stderr, "Can't create directory: %s\n", options.outputDirectory);
+		return 1;
+	}
+
+	uint32_t jobs = options.jobs != 0 ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+	TranscodeStats stats = TranscodeFiles(inputPaths, options.outputDirectory, options.transcode, jobs);
+	PrintTranscodeStats(stdout, stats);
+	return stats.failedCount > 0 ? 1 : 0;
 }
 
-int main()
+// Prints Midi Messages of raw Midi byte stream, one per line.
+// File is read in pieces: decoder carries messages cut between pieces.
+// Returns process exit code.
+int RunDecode(const Options& options)
 {
-	HMIDIOUT hMidiOut;
-
-	// Open Midi Handle
-	midiOutOpen(
-		/*out*/ &hMidiOut,
-		/*uDeviceID*/ 0, // System's Midi device is at index 0
-		/*dwCallback*/ NULL,
-		/*dwInstance*/ NULL,
-		/*fdwOpen*/ CALLBACK_NULL
-	);
-
-	std::cout << "Select Midi Instrument: Guitar\n";
-	SelectMidiInstrument(hMidiOut, /*channel*/ 0, /*instrument: Guitar*/ 24);
-
-	std::cout << "Start Playing Note: Middle C\n";
-	SendMidiNote(
-		hMidiOut,
-		/*channel*/ 0,
-		/*pitch (Note): Middle C*/ 60,
-		/*velocity (Volume)*/ 90);
-
-	std::cout << "Continue Playing for 2 Seconds\n";
-	std::this_thread::sleep_for(std::chrono::milliseconds(2000)); 
-
-	std::cout << "Stop Playing Note\n";
-	SendMidiNote(
-		hMidiOut,
-		/*channel*/ 0,
-		/*pitch*/ 60,
-		/*velocity (Volume): Min*/ 0); 
-
-	// Close Midi Handle
-	midiOutClose(hMidiOut);
+	FILE* input = nullptr;
+	if (fopen_s(&input, options.rawInputPath, "rb") != 0 || input == nullptr)
+	{
+		fprintf(stderr, "Can't open file: %s\n", options.rawInputPath);
+		return 1;
+	}
+	FILE* output = stdout;
+	if (options.outputPath != nullptr && strcmp(options.outputPath, "-") != 0
+		&& (fopen_s(&output, options.outputPath, "wb") != 0 || output == nullptr))
+	{
+		fprintf(stderr, "Can't open output file: %s\n", options.outputPath);
+		fclose(input);
+		return 1;
+	}
 
+	MidiStreamDecoder decoder;
+	std::vector<uint8_t> bytes(64 * 1024);
+	std::vector<MidiMessage> midiMessages(bytes.size());
+	size_t count = 0;
+	while ((count = fread(bytes.data(), 1, bytes.size(), input)) > 0)
+	{
+		size_t messageCount = decoder.Decode(bytes.data(), count, midiMessages.data());
+		for (size_t i = 0; i < messageCount; ++i)
+		{
+			const MidiMessage midiMessage = midiMessages[i];
+			switch (MidiMessageLength(midiMessage.Status()))
+			{
+			case 1: fprintf(output, "%02X\n", midiMessage.Status()); break;
+			case 2: fprintf(output, "%02X %02X\n", midiMessage.Status(), midiMessage.Data1()); break;
+			default: fprintf(output, "%02X %02X %02X\n", midiMessage.Status(), midiMessage.Data1(), midiMessage.Data2()); break;
+			}
+		}
+	}
+	bool ok = ferror(input) == 0;
+	fclose(input);
+	if (output != stdout)
+	{
+		ok = fclose(output) == 0 && ok;
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "Can't read %s, or write output\n", options.rawInputPath);
+		return 1;
+	}
+
+	const MidiStreamStats& stats = decoder.Stats();
+	fprintf(stderr, "Decoded %llu Midi Messages, skipped %llu System Exclusive (%llu bytes), dropped %llu bytes\n",
+		static_cast<unsigned long long>(stats.messageCount), static_cast<unsigned long long>(stats.sysExCount),
+		static_cast<unsigned long long>(stats.sysExBytes), static_cast<unsigned long long>(stats.droppedBytes));
 	return 0;
 }
+
+// Plays or generates Midi, as options say.
+// Returns process exit code.
+int Run(Options& options)
+{
+	// Rules file is watched while playing, so messages are checked as they're sent.
+	// Fixed rules filter whole event list once, before playing (below);
+	// generator makes events as it goes, so they're checked as sent there too.
+	MidiFilter filter;
+	std::unique_ptr<MidiFilterFileWatcher> filterWatcher;
+	if (options.filterRules != nullptr)
+	{
+		MidiFilterTable table;
+		if (!ParseMidiFilter(options.filterRules, table))
+		{
+			return 1;
+		}
+		filter.Publish(table);
+	}
+	if (options.filterPath != nullptr)
+	{
+		filterWatcher = MidiFilterFileWatcher::Start(options.filterPath, filter);
+		if (!filterWatcher)
+		{
+			return 1;
+		}
+	}
+	const bool filterAsSent = options.filterPath != nullptr
+		|| (options.filterRules != nullptr && options.runMode == RunMode::Generate);
+	std::vector<const FilterMidiOutput*> filterOutputs;
+	auto filterAsSentOutput = [&](std::unique_ptr<MidiOutput> output) -> std::unique_ptr<MidiOutput>
+	{
+		if (filterAsSent)
+		{
+			std::unique_ptr<FilterMidiOutput> filterOutput = std::make_unique<FilterMidiOutput>(std::move(output), filter);
+			filterOutputs.push_back(filterOutput.get());
+			output = std::move(filterOutput);
+		}
+		return output;
+	};
+	auto printFilteredAsSent = [&](FILE* console)
+	{
+		if (filterAsSent)
+		{
+			uint64_t droppedCount = 0;
+			for (const FilterMidiOutput* filterOutput : filterOutputs)
+			{
+				droppedCount += filterOutput->DroppedCount();
+			}
+			fprintf(console, "Filtered out %llu Midi Messages\n", static_cast<unsigned long long>(droppedCount));
+		}
+	};
+
+	// --devices: first one is main output
+	const UINT deviceId = options.devices.empty() ? options.deviceId : options.devices[0].deviceId;
+	std::unique_ptr<MidiOutput> midiOutput = CreateMidiOutput(
+		options.backend, deviceId, options.outputPath, options.hotPlug);
+	if (!midiOutput)
+	{
+		return 1;
+	}
+
+	// Programs, controllers and bends sent are remembered,
+	// and sent again when device is opened again
+	std::unique_ptr<StateMidiOutput> stateOutput = std::make_unique<StateMidiOutput>(std::move(midiOutput));
+	StateMidiOutput& deviceState = *stateOutput;
+	midiOutput = std::move(stateOutput);
+
+	// Notes still sounding get Note Off on Ctrl+C, console close or exception
+	midiOutput = filterAsSentOutput(std::make_unique<PanicMidiOutput>(std::move(midiOutput)));
+
+	// Other devices play same events. Only main output is silenced on Ctrl+C:
+	// console handler protects one PanicMidiOutput.
+	// Memory and file backends have one place for messages, so devices share it.
+	std::vector<std::unique_ptr<MidiOutput>> otherOutputs;
+	std::vector<MidiOutput*> midiOutputs{ midiOutput.get() };
+	for (size_t i = 1; i < options.devices.size(); ++i)
+	{
+		std::unique_ptr<MidiOutput> otherOutput = options.backend == MidiBackend::WinMm
+			? CreateMidiOutput(options.backend, options.devices[i].deviceId, nullptr, options.hotPlug)
+			: std::make_unique<SharedMidiOutput>(*midiOutput);
+		if (!otherOutput)
+		{
+			return 1;
+		}
+		if (options.backend == MidiBackend::WinMm)
+		{
+			otherOutput = filterAsSentOutput(std::make_unique<StateMidiOutput>(std::move(otherOutput)));
+		}
+		midiOutputs.push_back(otherOutput.get());
+		otherOutputs.push_back(std::move(otherOutput));
+	}
+
+	// Status goes to stderr when Midi bytes are piped to stdout
+	FILE* console = options.backend == MidiBackend::File || options.backend == MidiBackend::UmpFile ? stderr : stdout;
+
+	// Synthesizer may have been rebooted since last run: bring it back
+	// to state it had, in one flush, before anything else is sent
+	if (options.statePath != nullptr)
+	{
+		if (!LoadDeviceState(options.statePath, deviceState.State()))
+		{
+			return 1;
+		}
+		MidiResult result = deviceState.Restore();
+		fprintf(console, "Restored device state: %llu Midi Messages\n", static_cast<unsigned long long>(deviceState.RestoredCount()));
+		if (!result)
+		{
+			return ReportPlayResult(result);
+		}
+	}
+	const uint64_t loadedRestoredCount = deviceState.RestoredCount();
+	auto finish = [&](int exitCode)
+	{
+		if (deviceState.RestoredCount() != loadedRestoredCount)
+		{
+			fprintf(console, "Restored device state after reconnect: %llu Midi Messages\n",
+				static_cast<unsigned long long>(deviceState.RestoredCount() - loadedRestoredCount));
+		}
+		if (options.statePath != nullptr && !SaveDeviceState(options.statePath, deviceState.State()))
+		{
+			return 1;
+		}
+		return exitCode;
+	};
+
+	if (options.runMode == RunMode::Generate)
+	{
+		Clock clock(options.clockMode);
+		GeneratorStats stats = RunGenerator(*midiOutput, clock, options.generator);
+		PrintGeneratorStats(console, options.generator, stats);
+		printFilteredAsSent(console);
+		return finish(stats.failedMessageCount > 0 ? 1 : 0);
+	}
+
+	// One device: events go out early by its calibrated latency.
+	// Several: faster devices are held back to match slowest.
+	if (options.latencyPath != nullptr || !options.devices.empty())
+	{
+		std::vector<LatencyProfile> profiles;
+		if (options.latencyPath != nullptr && !LoadLatencyProfiles(options.latencyPath, profiles))
+		{
+			return 1;
+		}
+		for (size_t i = 0; i < midiOutputs.size(); ++i)
+		{
+			const OutputDevice* device = options.devices.empty() ? nullptr : &options.devices[i];
+			std::string deviceName = LatencyDeviceName(options.backend, device != nullptr ? device->deviceId : options.deviceId);
+			std::optional<int64_t> latency = device != nullptr && device->latencyMs
+				? std::optional<int64_t>(static_cast<int64_t>(*device->latencyMs) * 1000)
+				: FindLatency(profiles, deviceName);
+			if (latency)
+			{
+				midiOutputs[i]->SetLatency(std::chrono::microseconds(*latency));
+				fprintf(console, "Output latency: %lld us (%s)\n", static_cast<long long>(*latency), deviceName.c_str());
+			}
+			else if (options.latencyPath != nullptr)
+			{
+				fprintf(console, "No latency calibrated for %s\n", deviceName.c_str());
+			}
+		}
+	}
+
+	// Bank applies from next Program Change on,
+	// so it goes out before melody's Program Change
+	uint64_t configuredCount = 0;
+	if (options.selectBank)
+	{
+		ProgramSelection selections[16];
+		selections[options.channel] = { options.bankMsb, options.bankLsb, options.instrument };
+		fprintf(console, "Select Bank: %u:%u\n", options.bankMsb, options.bankLsb);
+		for (MidiOutput* output : midiOutputs)
+		{
+			ChannelPrograms programs(*output);
+			MidiResult result = programs.Configure(selections, static_cast<uint16_t>(1u << options.channel));
+			configuredCount += programs.Stats().sentCount;
+			if (!result)
+			{
+				return ReportPlayResult(result);
+			}
+		}
+	}
+
+	if (options.jingleName != nullptr)
+	{
+		// Jingles are built at compile time: nothing to parse or allocate
+		const MidiEvent* jingle = nullptr;
+		size_t count = 0;
+		if (strcmp(options.jingleName, "startup") == 0)
+		{
+			jingle = Jingles::Startup.data();
+			count = Jingles::Startup.size();
+		}
+		else if (strcmp(options.jingleName, "shutdown") == 0)
+		{
+			jingle = Jingles::Shutdown.data();
+			count = Jingles::Shutdown.size();
+		}
+		else if (strcmp(options.jingleName, "twinkle") == 0)
+		{
+			jingle = Jingles::Twinkle.data();
+			count = Jingles::Twinkle.size();
+		}
+		else
+		{
+			fprintf(stderr, "Unknown jingle: %s\n", options.jingleName);
+			return 1;
+		}
+
+		fprintf(console, "Play jingle: %s\n", options.jingleName);
+		Clock clock(options.clockMode);
+		return finish(ReportPlayResult(PlayEvents(midiOutputs.data(), midiOutputs.size(), clock, jingle, count)));
+	}
+
+	// Whole melody is converted to timed Midi Messages up front,
+	// so playback only sleeps and sends
+	std::vector<MidiEvent> midiEvents;
+	if (options.drumsText != nullptr)
+	{
+		DrumPattern pattern;
+		if (!ParseDrumPattern(options.drumsText, options.drums, pattern))
+		{
+			return 1;
+		}
+		DrumStats stats = RenderDrums(pattern, options.drums, midiEvents);
+		fprintf(console, "Drums: %llu hits, %llu wakeups\n",
+			static_cast<unsigned long long>(stats.hitCount), static_cast<unsigned long long>(stats.wakeupCount));
+	}
+	else if (options.scoreText != nullptr || options.scoreFilePath != nullptr)
+	{
+		std::string text;
+		if (options.scoreText != nullptr)
+		{
+			text = options.scoreText;
+		}
+		else if (!LoadFile(options.scoreFilePath, text))
+		{
+			return 1;
+		}
+
+		ScoreDefaults defaults;
+		defaults.channel = options.channel;
+		defaults.instrument = options.instrument;
+		defaults.velocity = options.defaultNote.velocity;
+		if (!CompileScore(text, defaults, midiEvents))
+		{
+			return 1;
+		}
+	}
+	else
+	{
+		if (options.notesFilePath != nullptr)
+		{
+			std::string text;
+			if (!LoadFile(options.notesFilePath, text)
+				|| !ParseNoteList(text, options.defaultNote, options.notes))
+			{
+				return 1;
+			}
+		}
+		if (options.notes.empty())
+		{
+			// Original example: Middle C, for 2 seconds
+			options.notes.push_back(options.defaultNote);
+		}
+		midiEvents = CompileNotes(options.channel, options.instrument, options.notes);
+	}
+
+	if (options.transpose != 0 || options.selectBank)
+	{
+		// Instrument was already selected together with bank
+		RedundancyElision elision;
+		if (options.selectBank)
+		{
+			elision.instruments[options.channel] = options.instrument;
+		}
+		MakePipeline(Transpose{ options.transpose }, elision).Process(midiEvents);
+	}
+
+	if (options.filterRules != nullptr)
+	{
+		const size_t count = midiEvents.size();
+		filter.Process(midiEvents);
+		fprintf(console, "Filtered out %zu Midi Messages\n", count - midiEvents.size());
+	}
+
+	if (options.drumsText == nullptr)
+	{
+		fprintf(console, "Select Midi Instrument: %u (%.*s)\n", options.instrument,
+			static_cast<int>(GeneralMidi::InstrumentName(options.instrument).size()), GeneralMidi::InstrumentName(options.instrument).data());
+	}
+	fprintf(console, "Play %.1f seconds\n", midiEvents.empty() ? 0.0 : static_cast<double>(midiEvents.back().timeMicroseconds) / 1e6);
+
+	Clock clock(options.clockMode);
+	MidiResult result = PlayEvents(midiOutputs.data(), midiOutputs.size(), clock, midiEvents.data(), midiEvents.size());
+
+	// Bank selection and state restores went out too
+	uint64_t sentCount = midiEvents.size() * midiOutputs.size() + configuredCount + deviceState.RestoredCount();
+	fprintf(console, "Sent %llu Midi Messages\n", static_cast<unsigned long long>(sentCount));
+	printFilteredAsSent(console);
+
+	return finish(ReportPlayResult(result));
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+	if (!ParseCommandLine(argc, argv, options))
+	{
+		PrintUsage(stderr);
+		return 1;
+	}
+
+	switch (options.runMode)
+	{
+	case RunMode::Help:
+		PrintUsage(stdout);
+		return 0;
+	case RunMode::Benchmark:
+		return RunBenchmarks(options.benchmarkName, options.benchmarkIterations) ? 0 : 1;
+	case RunMode::ListDevices:
+		PrintMidiDevices(stdout, ListMidiDevices());
+		return 0;
+	case RunMode::Calibrate:
+		return RunCalibration(options);
+	case RunMode::Transcode:
+		return RunTranscode(options);
+	case RunMode::Decode:
+		return RunDecode(options);
+	case RunMode::Play:
+	case RunMode::Generate:
+		break;
+	}
+
+	if (options.tracePath != nullptr)
+	{
+		StartTrace();
+	}
+	if (options.metricsPath != nullptr)
+	{
+		StartMetricsDump(options.metricsPath, options.metricsIntervalMs);
+	}
+
+	int exitCode = 1;
+	try
+	{
+		exitCode = Run(options);
+	}
+	catch (const std::exception& exception)
+	{
+		// Caught here so stack unwinds, and sounding notes get Note Off
+		fprintf(stderr, "Error: %s\n", exception.what());
+	}
+
+	StopMetricsDump();
+
+	if (options.tracePath != nullptr && !WriteTrace(options.tracePath))
+	{
+		exitCode = 1;
+	}
+	return exitCode;
+}
@@ -0,0 +1,213 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "MidiDevices.h"
+
+std::vector<MidiDeviceInfo> ListMidiDevices()
+{
+	std::vector<MidiDeviceInfo> devices;
+	UINT count = midiOutGetNumDevs();
+	for (UINT deviceId = 0; deviceId < count; ++deviceId)
+	{
+		MIDIOUTCAPSW caps{};
+		if (midiOutGetDevCapsW(deviceId, &caps, sizeof(caps)) == MMSYSERR_NOERROR)
+		{
+			devices.push_back({ deviceId, caps.szPname });
+		}
+	}
+	return devices;
+}
+
+void PrintMidiDevices(FILE* file, const std::vector<MidiDeviceInfo>& devices)
+{
+	for (const MidiDeviceInfo& device : devices)
+	{
+		fprintf(file, "%u: %ls\n", device.deviceId, device.name.c_str());
+	}
+	if (devices.empty())
+	{
+		fputs("No Midi output devices\n", file);
+	}
+}
+
+namespace {
+
+	const MidiDeviceInfo* FindDevice(const std::vector<MidiDeviceInfo>& devices, const std::wstring& name)
+	{
+		for (const MidiDeviceInfo& device : devices)
+		{
+			if (device.name == name)
+			{
+				return &device;
+			}
+		}
+		return nullptr;
+	}
+
+}
+
+MidiExpected<std::unique_ptr<MidiOutput>> HotPlugMidiOutput::Open(UINT deviceId, uint32_t pollIntervalMs)
+{
+	MIDIOUTCAPSW caps{};
+	MidiResult result(midiOutGetDevCapsW(deviceId, &caps, sizeof(caps)));
+	if (!result)
+	{
+		return result;
+	}
+
+	MidiExpected<std::unique_ptr<MidiOutput>> output = WinMmMidiOutput::Open(deviceId);
+	if (!output)
+	{
+		return output.Error();
+	}
+	return std::unique_ptr<MidiOutput>(new HotPlugMidiOutput({ deviceId, caps.szPname }, std::move(*output), pollIntervalMs));
+}
+
+HotPlugMidiOutput::HotPlugMidiOutput(const MidiDeviceInfo& device, std::unique_ptr<MidiOutput> output, uint32_t pollIntervalMs)
+	: deviceName(device.name), knownDevices(ListMidiDevices()), pollIntervalMs(pollIntervalMs)
+{
+	current.store(output.get(), std::memory_order_release);
+	outputs.push_back(std::move(output));
+
+	thread = std::thread([this]()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!wakeUp.wait_for(lock, std::chrono::milliseconds(this->pollIntervalMs), [this]() { return stop; }))
+			{
+				lock.unlock();
+				Poll();
+				lock.lock();
+			}
+		});
+}
+
+HotPlugMidiOutput::~HotPlugMidiOutput()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wakeUp.notify_one();
+	thread.join();
+}
+
+MidiResult HotPlugMidiOutput::Write(MidiMessage midiMessage)
+{
+	// Sequentially consistent with Disconnect: either this load sees
+	// backend unpublished, or monitor sees writer and keeps handle open
+	writers.fetch_add(1);
+	MidiOutput* output = current.load();
+	if (output == nullptr)
+	{
+		writers.fetch_sub(1, std::memory_order_release);
+		return MidiResult(MIDIERR_NODEVICE);
+	}
+
+	MidiResult result = output->Write(midiMessage);
+	// Failure of backend that was already replaced is old news:
+	// reconnecting again would only restore state twice
+	if (result.IsDisconnect() && current.load(std::memory_order_relaxed) == output)
+	{
+		writeFailed.store(true, std::memory_order_relaxed);
+	}
+	writers.fetch_sub(1, std::memory_order_release);
+	return result;
+}
+
+bool HotPlugMidiOutput::Disconnect()
+{
+	MidiOutput* output = current.exchange(nullptr);
+	if (output != nullptr)
+	{
+		retired.push_back(output);
+	}
+
+	// Sends take microseconds: wait a little, then leave it to next poll
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+	while (writers.load(std::memory_order_acquire) != 0)
+	{
+		if (std::chrono::steady_clock::now() >= deadline)
+		{
+			return false;
+		}
+		std::this_thread::yield();
+	}
+
+	for (MidiOutput* retiredOutput : retired)
+	{
+		// Only WinMm backends are ever opened here
+		static_cast<WinMmMidiOutput*>(retiredOutput)->Close();
+	}
+	retired.clear();
+	return true;
+}
+
+void HotPlugMidiOutput::Flush()
+{
+	writers.fetch_add(1);
+	MidiOutput* output = current.load();
+	if (output != nullptr)
+	{
+		output->Flush();
+	}
+	writers.fetch_sub(1, std::memory_order_release);
+}
+
+void HotPlugMidiOutput::Poll()
+{
+	std::vector<MidiDeviceInfo> devices = ListMidiDevices();
+
+	// Report changes, so operator sees why sound stopped or came back
+	for (const MidiDeviceInfo& device : devices)
+	{
+		if (FindDevice(knownDevices, device.name) == nullptr)
+		{
+			fprintf(stderr, "Midi device added: %u: %ls\n", device.deviceId, device.name.c_str());
+		}
+	}
+	for (const MidiDeviceInfo& device : knownDevices)
+	{
+		if (FindDevice(devices, device.name) == nullptr)
+		{
+			fprintf(stderr, "Midi device removed: %ls\n", device.name.c_str());
+		}
+	}
+	knownDevices = std::move(devices);
+
+	const MidiDeviceInfo* device = FindDevice(knownDevices, deviceName);
+	bool connected = current.load(std::memory_order_relaxed) != nullptr;
+	bool failed = writeFailed.exchange(false, std::memory_order_relaxed);
+
+	if (device == nullptr)
+	{
+		if (connected || !retired.empty())
+		{
+			// Sends fail fast with MIDIERR_NODEVICE until device is back
+			Disconnect();
+		}
+		return;
+	}
+
+	if (!connected || failed)
+	{
+		// Device may have new index now, and old handle is dead.
+		// Old handle is closed before new one is opened: drivers that allow
+		// one handle refuse second one (MMSYSERR_ALLOCATED)
+		if (!Disconnect())
+		{
+			// Sender still uses old handle; try again on next poll
+			return;
+		}
+		MidiExpected<std::unique_ptr<MidiOutput>> output = WinMmMidiOutput::Open(device->deviceId);
+		if (!output)
+		{
+			// Try again on next poll
+			return;
+		}
+		current.store(output.Value().get(), std::memory_order_release);
+		outputs.push_back(std::move(*output));
+		connection.fetch_add(1, std::memory_order_release);
+		CountMetric(Metric::DeviceReopens);
+		fprintf(stderr, "Midi device connected: %u: %ls\n", device->deviceId, device->name.c_str());
+	}
+}
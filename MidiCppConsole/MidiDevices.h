@@ -0,0 +1,102 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+
+#include <Windows.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Windows Midi output device, as listed by midiOutGetDevCaps.
+// Device index changes when other devices are added or removed,
+// name stays same.
+struct MidiDeviceInfo {
+	UINT deviceId;
+	std::wstring name;
+};
+
+std::vector<MidiDeviceInfo> ListMidiDevices();
+
+// Prints "index: name" line per device
+void PrintMidiDevices(FILE* file, const std::vector<MidiDeviceInfo>& devices);
+
+// Windows Midi device that may be unplugged and plugged in again.
+//
+// Background thread polls device list. When device goes away,
+// messages are dropped (and counted); when device with same name
+// comes back, it's opened and swapped in.
+//
+// Swap is RCU style: sender reads current backend with one atomic load,
+// monitor thread publishes new backend with one atomic store.
+// Sender never takes lock and never waits for monitor.
+// Replaced backends stay alive until HotPlugMidiOutput is destroyed,
+// so sender can finish with backend it already loaded.
+// Their handles are closed only when no send is in flight (writers is 0),
+// so in-flight write never sees handle closed under it.
+// Hot-plug happens a few times per run at most, so that's cheap.
+class HotPlugMidiOutput : public MidiOutput {
+public:
+	// Opens device, and remembers its name to find it again
+	static MidiExpected<std::unique_ptr<MidiOutput>> Open(UINT deviceId, uint32_t pollIntervalMs = 500);
+
+	~HotPlugMidiOutput() override;
+
+	void Flush() override;
+
+	// Monitor thread reconnects, not sender
+	MidiResult Reopen() override { return MidiResult(MMSYSERR_NOTSUPPORTED); }
+
+	// Counts reconnects by monitor thread
+	uint32_t Connection() const override { return connection.load(std::memory_order_acquire); }
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	HotPlugMidiOutput(const MidiDeviceInfo& device, std::unique_ptr<MidiOutput> output, uint32_t pollIntervalMs);
+
+	// Monitor thread: compares device list with previous one,
+	// reports changes and connects or disconnects device
+	void Poll();
+
+	// Unpublishes current backend and closes handles of replaced backends.
+	// Returns false if a send is still in flight: handles stay open
+	// until next poll, and new handle mustn't be opened yet.
+	bool Disconnect();
+
+	std::atomic<MidiOutput*> current{ nullptr };
+
+	// Set by sender when device stopped answering, so monitor reconnects
+	// even if device came back before it noticed it was gone
+	std::atomic<bool> writeFailed{ false };
+
+	std::atomic<uint32_t> connection{ 0 };
+
+	// Sends and flushes in flight. Monitor closes replaced handles only at 0.
+	std::atomic<uint32_t> writers{ 0 };
+
+	// Only monitor thread uses these, after constructor
+	std::wstring deviceName;
+	std::vector<MidiDeviceInfo> knownDevices;
+	// Every backend ever opened. Objects stay alive for sender that may
+	// still be using one; handles are closed once sender is done.
+	std::vector<std::unique_ptr<MidiOutput>> outputs;
+	// Unpublished backends whose handles are still open
+	std::vector<MidiOutput*> retired;
+
+	uint32_t pollIntervalMs;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeUp;
+	bool stop{ false };
+};
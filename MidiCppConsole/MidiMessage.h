@@ -0,0 +1,158 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <Windows.h>
+
+#include <cstdint>
+
+// Midi Message is 4 bytes.
+// Windows Midi midiOutShortMsg() Api passes
+// those 4 bytes as DWORD type:
+// [0] Status byte          : bits 0 to 7 (lowest)
+// [1] First MIDI data byte : bits 8 to 15
+// [2] Second MIDI data byte: bits 16 to 23
+// [3] Unused, 0            : bits 24 to 31
+//
+// Bytes are packed into DWORD with shifts.
+// Overlapping byte array onto DWORD (C++ union) would read a union
+// member other than the one last written, which is undefined behavior,
+// and would put Status byte in lowest bits only on little-endian CPUs.
+// Shifts are correct on every CPU, work in constexpr code
+// (see Melody.h), and compilers turn them into single 32-bit store.
+struct MidiMessage {
+	DWORD dataDWord{ 0 };
+
+	constexpr MidiMessage() = default;
+
+	constexpr MidiMessage(
+		uint8_t statusByte,  // [0] MIDI Status byte
+		uint8_t data1,       // [1] First MIDI data byte
+		uint8_t data2 = 0)   // [2] Second MIDI data byte
+		// [3] is unused
+		: dataDWord(static_cast<DWORD>(statusByte)
+			| (static_cast<DWORD>(data1) << 8)
+			| (static_cast<DWORD>(data2) << 16))
+	{
+	}
+
+	constexpr uint8_t Status() const { return static_cast<uint8_t>(dataDWord); }
+	constexpr uint8_t Data1() const { return static_cast<uint8_t>(dataDWord >> 8); }
+	constexpr uint8_t Data2() const { return static_cast<uint8_t>(dataDWord >> 16); }
+};
+
+static_assert(sizeof(MidiMessage) == 4, "MidiMessage must stay 4 bytes, same as midiOutShortMsg() DWORD");
+
+// Midi Status byte signatures (upper 4 bits of Status byte)
+constexpr uint8_t NoteOffSignature = 0b1000;
+constexpr uint8_t NoteOnSignature = 0b1001;
+constexpr uint8_t ControlChangeSignature = 0b1011;
+constexpr uint8_t SetInstrumentSignature = 0b1100;
+constexpr uint8_t PitchBendSignature = 0b1110;
+
+// Builds "Note On" Midi Message.
+// To Turn "Note Off", simply pass 0 as Velocity (Volume)
+constexpr MidiMessage MakeNoteMessage(
+	uint8_t channel,  // 4 bits, 0 to 15
+	uint8_t pitch,    // 7 bits, 0 to 127
+	uint8_t velocity  // 7 bits, 0 to 127
+)
+{
+	// "Note On" Protocol:
+	// [0] Status byte     : 0b 1001 CCCC
+	//     Note On Signature   : 0b 1001
+	//     Channel 4-bits      : 0b CCCC
+	// [1] Pitch 7-bits    : 0b 0PPP PPPP
+	// [2] Velocity 7-bits : 0b 0VVV VVVV
+	// [3] Unused          : 0b 0000 0000
+	// Reference: https://www.cs.cmu.edu/~music/cmsip/readings/MIDI%20tutorial%20for%20programmers.html
+
+	uint8_t statusByte = NoteOnSignature;      // 0b 0000 1001
+	statusByte = statusByte << 4;              // 0b 1001 0000
+	statusByte = statusByte | channel;         // 0b 1001 CCCC
+
+	return MidiMessage(statusByte, pitch, velocity);
+}
+
+// Builds "Select Midi Instrument" (Program Change) Midi Message.
+constexpr MidiMessage MakeInstrumentMessage(
+	uint8_t channel,       // 4 bits, 0 to 15
+	uint8_t instrument     // 7 bits, 0 to 127
+)
+{
+	// "Select Midi Instrument" Protocol:
+	// [0] Status byte          : 0b 1100 CCCC
+	//     Select Instrument Signature      : 0b 1100
+	//     Channel 4-bits                   : 0b CCCC
+	// [1] Instrument 7-bits    : 0b 0III IIII
+	// [2] Unused               : 0b 0000 0000
+	// [3] Unused               : 0b 0000 0000
+
+	uint8_t statusByte = SetInstrumentSignature; // 0b 0000 1100
+	statusByte = statusByte << 4;                // 0b 1100 0000
+	statusByte |= channel;                       // 0b 1100 CCCC
+
+	return MidiMessage(statusByte, instrument);
+}
+
+// Control numbers of Control Change messages used by this project
+constexpr uint8_t BankSelectMsbControl = 0;
+constexpr uint8_t BankSelectLsbControl = 32;
+constexpr uint8_t AllNotesOffControl = 123;
+
+// Builds "Control Change" Midi Message.
+constexpr MidiMessage MakeControlChangeMessage(
+	uint8_t channel,  // 4 bits, 0 to 15
+	uint8_t control,  // 7 bits, 0 to 127, for example AllNotesOffControl
+	uint8_t value     // 7 bits, 0 to 127
+)
+{
+	// "Control Change" Protocol:
+	// [0] Status byte     : 0b 1011 CCCC
+	//     Control Change Signature : 0b 1011
+	//     Channel 4-bits           : 0b CCCC
+	// [1] Control 7-bits  : 0b 0NNN NNNN
+	// [2] Value 7-bits    : 0b 0VVV VVVV
+	// [3] Unused          : 0b 0000 0000
+
+	uint8_t statusByte = ControlChangeSignature; // 0b 0000 1011
+	statusByte = statusByte << 4;                // 0b 1011 0000
+	statusByte |= channel;                       // 0b 1011 CCCC
+
+	return MidiMessage(statusByte, control, value);
+}
+
+// Number of bytes Midi Message occupies on the wire,
+// based on its Status byte.
+// For example, "Note On" is 3 bytes, "Select Midi Instrument" is 2 bytes.
+constexpr uint32_t MidiMessageLength(uint8_t statusByte)
+{
+	switch (statusByte >> 4)
+	{
+	case 0b1100: // Select Midi Instrument
+	case 0b1101: // Channel Pressure
+		return 2;
+	case 0b1111: // System messages
+		switch (statusByte)
+		{
+		case 0xF1: // Time Code Quarter Frame
+		case 0xF3: // Song Select
+			return 2;
+		case 0xF2: // Song Position
+			return 3;
+		default:   // Tune Request, Real-Time messages
+			return 1;
+		}
+	default:     // Note Off, Note On, Aftertouch, Control Change, Pitch Bend
+		return 3;
+	}
+}
+
+// Compile-time checks: Middle C "Note On", and Guitar on channel 0
+static_assert(MakeNoteMessage(0, 60, 90).dataDWord == 0x005A3C90, "Note On packing");
+static_assert(MakeInstrumentMessage(0, 24).dataDWord == 0x000018C0, "Select Midi Instrument packing");
+static_assert(MakeControlChangeMessage(0, AllNotesOffControl, 0).dataDWord == 0x00007BB0, "All Notes Off packing");
+static_assert(MakeNoteMessage(15, 127, 1).Status() == 0x9F, "Status byte is lowest byte");
+static_assert(MakeNoteMessage(15, 127, 1).Data1() == 127, "First data byte");
+static_assert(MakeNoteMessage(15, 127, 1).Data2() == 1, "Second data byte");
@@ -0,0 +1,290 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "MidiOutput.h"
+
+#include "MidiDevices.h"
+#include "Trace.h"
+#include "Ump.h"
+
+#include <fcntl.h>
+#include <io.h>
+
+MidiResult MidiOutput::SendFailed(MidiMessage midiMessage, MidiResult result)
+{
+	CountSendError(result.Code());
+	if (result.IsDisconnect() && Reopen().Ok())
+	{
+		// Device is back (driver restarted, cable plugged in again)
+		CountMetric(Metric::DeviceReopens);
+		result = Write(midiMessage);
+		if (result.Ok())
+		{
+			CountSentMessage(midiMessage);
+			return result;
+		}
+		CountSendError(result.Code());
+	}
+	CountMetric(Metric::DroppedMessages);
+	return result;
+}
+
+MidiResult MidiOutput::SendUmp(const uint32_t* words, size_t wordCount)
+{
+	MidiResult firstError;
+	size_t i = 0;
+	while (i < wordCount)
+	{
+		size_t packetWordCount = UmpWordCount(words[i]);
+		if (i + packetWordCount > wordCount)
+		{
+			break;
+		}
+
+		MidiMessage midiMessages[4];
+		size_t count = TranslatePacketToMidi1(words + i, midiMessages);
+		for (size_t j = 0; j < count; ++j)
+		{
+			MidiResult result = Send(midiMessages[j]);
+			if (!result && firstError.Ok())
+			{
+				firstError = result;
+			}
+		}
+		i += packetWordCount;
+	}
+	return firstError;
+}
+
+namespace {
+
+	MMRESULT OpenMidiHandle(UINT deviceId, HMIDIOUT& hMidiOut)
+	{
+		// Open Midi Handle
+		return midiOutOpen(
+			/*out*/ &hMidiOut,
+			/*uDeviceID*/ deviceId,
+			/*dwCallback*/ NULL,
+			/*dwInstance*/ NULL,
+			/*fdwOpen*/ CALLBACK_NULL
+		);
+	}
+
+}
+
+MidiExpected<std::unique_ptr<MidiOutput>> WinMmMidiOutput::Open(UINT deviceId)
+{
+	HMIDIOUT hMidiOut{};
+	MidiResult result(OpenMidiHandle(deviceId, hMidiOut));
+	if (!result)
+	{
+		return result;
+	}
+	return std::unique_ptr<MidiOutput>(new WinMmMidiOutput(deviceId, hMidiOut));
+}
+
+WinMmMidiOutput::WinMmMidiOutput(UINT deviceId, HMIDIOUT hMidiOut)
+	: deviceId(deviceId), hMidiOut(hMidiOut)
+{
+}
+
+WinMmMidiOutput::~WinMmMidiOutput()
+{
+	Close();
+}
+
+void WinMmMidiOutput::Close()
+{
+	// Close Midi Handle
+	HMIDIOUT handle = hMidiOut.exchange(nullptr, std::memory_order_relaxed);
+	if (handle != nullptr)
+	{
+		midiOutClose(handle);
+	}
+}
+
+MidiResult WinMmMidiOutput::Reopen()
+{
+	const std::chrono::milliseconds RetryInterval(500);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (now < nextReopen)
+	{
+		return MidiResult(MIDIERR_NODEVICE);
+	}
+	nextReopen = now + RetryInterval;
+
+	Close();
+	HMIDIOUT handle{};
+	MidiResult result(OpenMidiHandle(deviceId, handle));
+	if (result.Ok())
+	{
+		hMidiOut.store(handle, std::memory_order_relaxed);
+		++connection;
+	}
+	return result;
+}
+
+MidiResult WinMmMidiOutput::Write(MidiMessage midiMessage)
+{
+	TraceScope traceScope("midiOutShortMsg");
+	HMIDIOUT handle = hMidiOut.load(std::memory_order_relaxed);
+	if (handle == nullptr)
+	{
+		return MidiResult(MIDIERR_NODEVICE);
+	}
+	return MidiResult(midiOutShortMsg(handle, midiMessage.dataDWord));
+}
+
+MidiResult MemoryMidiOutput::Write(MidiMessage midiMessage)
+{
+	midiMessages.push_back(midiMessage);
+	return MidiResult();
+}
+
+MidiResult NullMidiOutput::Write(MidiMessage /*midiMessage*/)
+{
+	++count;
+	return MidiResult();
+}
+
+FileMidiOutput::FileMidiOutput(FILE* file, bool ownsFile)
+	: file(file), ownsFile(ownsFile)
+{
+}
+
+FileMidiOutput::~FileMidiOutput()
+{
+	if (ownsFile)
+	{
+		fclose(file);
+	}
+	else
+	{
+		fflush(file);
+	}
+}
+
+MidiResult FileMidiOutput::Write(MidiMessage midiMessage)
+{
+	// Bytes in wire order, whatever CPU byte order is
+	const uint8_t bytes[3] = { midiMessage.Status(), midiMessage.Data1(), midiMessage.Data2() };
+
+	// FILE is buffered, so this doesn't call OS for every message
+	size_t length = MidiMessageLength(bytes[0]);
+	if (fwrite(bytes, 1, length, file) != length)
+	{
+		// Disk full, or pipe reader went away
+		return MidiResult(MMSYSERR_ERROR);
+	}
+	return MidiResult();
+}
+
+void FileMidiOutput::Flush()
+{
+	fflush(file);
+}
+
+UmpFileMidiOutput::UmpFileMidiOutput(FILE* file, bool ownsFile, uint8_t group)
+	: FileMidiOutput(file, ownsFile), group(group)
+{
+}
+
+MidiResult UmpFileMidiOutput::Write(MidiMessage midiMessage)
+{
+	uint32_t words[2];
+	size_t wordCount = TranslateToMidi2(midiMessage, group, words);
+	return WriteWords(words, wordCount);
+}
+
+MidiResult UmpFileMidiOutput::SendUmp(const uint32_t* words, size_t wordCount)
+{
+	// Native path: packets go out as they are
+	MidiResult result = WriteWords(words, wordCount);
+	if (!result)
+	{
+		CountSendError(result.Code());
+		CountMetric(Metric::DroppedMessages);
+		return result;
+	}
+	for (size_t i = 0; i < wordCount; i += UmpWordCount(words[i]))
+	{
+		CountSentUmp(words[i]);
+	}
+	return result;
+}
+
+MidiResult UmpFileMidiOutput::WriteWords(const uint32_t* words, size_t wordCount)
+{
+	for (size_t i = 0; i < wordCount; ++i)
+	{
+		// Big-endian, whatever CPU byte order is
+		const uint8_t bytes[4] = {
+			static_cast<uint8_t>(words[i] >> 24),
+			static_cast<uint8_t>(words[i] >> 16),
+			static_cast<uint8_t>(words[i] >> 8),
+			static_cast<uint8_t>(words[i]) };
+		if (fwrite(bytes, 1, sizeof(bytes), file) != sizeof(bytes))
+		{
+			return MidiResult(MMSYSERR_ERROR);
+		}
+	}
+	return MidiResult();
+}
+
+std::unique_ptr<MidiOutput> CreateMidiOutput(
+	MidiBackend backend,
+	UINT deviceId,
+	const char* outputPath,
+	bool hotPlug)
+{
+	switch (backend)
+	{
+	case MidiBackend::WinMm:
+	{
+		MidiExpected<std::unique_ptr<MidiOutput>> midiOutput = hotPlug
+			? HotPlugMidiOutput::Open(deviceId)
+			: WinMmMidiOutput::Open(deviceId);
+		if (!midiOutput)
+		{
+			fprintf(stderr, "Can't open Midi device %u: %s (%u)\n",
+				deviceId, midiOutput.Error().Message(), midiOutput.Error().Code());
+			return nullptr;
+		}
+		return std::move(*midiOutput);
+	}
+	case MidiBackend::Memory:
+		return std::make_unique<MemoryMidiOutput>();
+	case MidiBackend::Null:
+		return std::make_unique<NullMidiOutput>();
+	case MidiBackend::File:
+	case MidiBackend::UmpFile:
+	{
+		if (outputPath == nullptr)
+		{
+			fputs("File backend requires --output\n", stderr);
+			return nullptr;
+		}
+		FILE* file = nullptr;
+		bool ownsFile = true;
+		if (outputPath[0] == '-' && outputPath[1] == '\0')
+		{
+			// Pipe: stdout must not translate '\n' bytes into "\r\n"
+			_setmode(_fileno(stdout), _O_BINARY);
+			file = stdout;
+			ownsFile = false;
+		}
+		else if (fopen_s(&file, outputPath, "wb") != 0 || file == nullptr)
+		{
+			fprintf(stderr, "Can't open output file: %s\n", outputPath);
+			return nullptr;
+		}
+
+		if (backend == MidiBackend::UmpFile)
+		{
+			return std::make_unique<UmpFileMidiOutput>(file, ownsFile);
+		}
+		return std::make_unique<FileMidiOutput>(file, ownsFile);
+	}
+	}
+	return nullptr;
+}
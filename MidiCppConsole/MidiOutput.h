@@ -0,0 +1,223 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiMessage.h"
+#include "Metrics.h"
+#include "MidiResult.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+// Where Midi Messages go.
+// Default is System's Midi device, same as original example.
+// Other backends let the same binary record Midi or generate load
+// without any sound hardware.
+enum class MidiBackend {
+	WinMm,   // Windows Midi device, midiOutShortMsg()
+	Memory,  // Keep Midi Messages in memory
+	Null,    // Count and drop Midi Messages
+	File,    // Write raw Midi bytes to a file or pipe
+	UmpFile, // Write Midi 2.0 Universal MIDI Packets to a file or pipe
+};
+
+// Base class for all backends.
+// Send() lets backend's Write() deliver message, counts it for metrics
+// (see Metrics.h) and returns result. Success path is small and inline,
+// everything else is in SendFailed().
+class MidiOutput {
+public:
+	virtual ~MidiOutput() = default;
+
+	MidiResult Send(MidiMessage midiMessage)
+	{
+		MidiResult result = Write(midiMessage);
+		if (result.Ok())
+		{
+			CountSentMessage(midiMessage);
+			return result;
+		}
+		return SendFailed(midiMessage, result);
+	}
+
+	// Sends Universal MIDI Packets (see Ump.h), whole packets only.
+	// Backends that speak Midi 2.0 take packets as they are,
+	// others get them translated to Midi 1.0 messages.
+	// Returns first failure, remaining packets are still sent.
+	virtual MidiResult SendUmp(const uint32_t* words, size_t wordCount);
+
+	// Pushes buffered Midi Messages out, for backends that buffer.
+	// Called when sender is about to wait for next deadline.
+	virtual void Flush() {}
+
+	// Closes and opens device again, after it went away.
+	// Backends without device return MMSYSERR_NOTSUPPORTED.
+	virtual MidiResult Reopen() { return MidiResult(MMSYSERR_NOTSUPPORTED); }
+
+	// Changes every time device is opened again: device state
+	// (programs, controllers) may be lost, see DeviceState.h.
+	// Backends without device stay at 0.
+	virtual uint32_t Connection() const { return 0; }
+
+	// Time from Send() until device plays message, measured by
+	// calibration (see Latency.h). PlayEvents() sends events this much early.
+	std::chrono::microseconds Latency() const { return latency; }
+	void SetLatency(std::chrono::microseconds value) { latency = value; }
+
+protected:
+	virtual MidiResult Write(MidiMessage midiMessage) = 0;
+
+	// Wrappers forward Write() to backend they wrap
+	friend class FilterMidiOutput;
+	friend class HotPlugMidiOutput;
+	friend class PanicMidiOutput;
+	friend class SharedMidiOutput;
+	friend class StateMidiOutput;
+
+private:
+	// Counts error; on disconnect, reopens device and retries once
+	__declspec(noinline) MidiResult SendFailed(MidiMessage midiMessage, MidiResult result);
+
+	std::chrono::microseconds latency{ 0 };
+};
+
+// Windows Midi device
+class WinMmMidiOutput : public MidiOutput {
+public:
+	// Opens device, System's Midi device is at index 0
+	static MidiExpected<std::unique_ptr<MidiOutput>> Open(UINT deviceId);
+
+	~WinMmMidiOutput() override;
+
+	MidiResult Reopen() override;
+	uint32_t Connection() const override { return connection; }
+
+	// Closes handle; Write() fails with MIDIERR_NODEVICE until Reopen().
+	// Another thread may be in Write() meanwhile (see HotPlugMidiOutput):
+	// it gets error from closed handle, object itself stays valid.
+	void Close();
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	WinMmMidiOutput(UINT deviceId, HMIDIOUT hMidiOut);
+
+	UINT deviceId;
+	std::atomic<HMIDIOUT> hMidiOut;
+	uint32_t connection{ 0 };  // Successful reopens
+
+	// While device is gone, every Send() would try to reopen it:
+	// limit attempts, so a dead device doesn't stall playback
+	std::chrono::steady_clock::time_point nextReopen{};
+};
+
+// Keeps all Midi Messages, for example to inspect them after playback
+class MemoryMidiOutput : public MidiOutput {
+public:
+	std::vector<MidiMessage> midiMessages;
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+};
+
+// Drops all Midi Messages, only counts them
+class NullMidiOutput : public MidiOutput {
+public:
+	uint64_t count{ 0 };
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+};
+
+// Writes Midi Messages as raw Midi bytes, same bytes as Midi cable carries.
+// For example, "Note On" is 3 bytes: 0x90 0x3C 0x5A
+class FileMidiOutput : public MidiOutput {
+public:
+	FileMidiOutput(FILE* file, bool ownsFile);
+	~FileMidiOutput() override;
+
+	void Flush() override;
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+	FILE* file;
+
+private:
+	bool ownsFile;
+};
+
+// Writes Universal MIDI Packets, Midi 2.0 Protocol.
+// Words are big-endian, as in Midi Clip File.
+// Midi 1.0 messages are translated to Midi 2.0, see TranslateToMidi2().
+class UmpFileMidiOutput : public FileMidiOutput {
+public:
+	UmpFileMidiOutput(FILE* file, bool ownsFile, uint8_t group = 0);
+
+	MidiResult SendUmp(const uint32_t* words, size_t wordCount) override;
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	MidiResult WriteWords(const uint32_t* words, size_t wordCount);
+
+	uint8_t group;
+};
+
+// Second handle to another output, with its own latency.
+// Lets memory and file backends stand in for several devices:
+// messages of all of them land in one place, in send order.
+// Shared output must outlive this one.
+class SharedMidiOutput : public MidiOutput {
+public:
+	explicit SharedMidiOutput(MidiOutput& midiOutput) : midiOutput(midiOutput) {}
+
+	void Flush() override { midiOutput.Flush(); }
+	uint32_t Connection() const override { return midiOutput.Connection(); }
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override { return midiOutput.Write(midiMessage); }
+
+private:
+	MidiOutput& midiOutput;
+};
+
+// Creates backend.
+// outputPath is only used by File and UmpFile backends, "-" means stdout.
+// hotPlug is only used by WinMm backend: device is watched and
+// reconnected after it's unplugged, see MidiDevices.h.
+// Returns nullptr, and prints reason, if backend can't be created
+// (for example, Midi device can't be opened).
+std::unique_ptr<MidiOutput> CreateMidiOutput(
+	MidiBackend backend,
+	UINT deviceId,
+	const char* outputPath,
+	bool hotPlug = false);
+
+// Plays Midi Note
+// To Stop playing, set velocity parameter to 0
+inline MidiResult SendMidiNote(
+	MidiOutput& midiOutput,
+	uint8_t channel,  // 4 bits, 0 to 15
+	uint8_t pitch,    // 7 bits, 0 to 127
+	uint8_t velocity  // 7 bits, 0 to 127
+)
+{
+	return midiOutput.Send(MakeNoteMessage(channel, pitch, velocity));
+}
+
+inline MidiResult SelectMidiInstrument(
+	MidiOutput& midiOutput,
+	uint8_t channel,       // 4 bits, 0 to 15
+	uint8_t instrument     // 7 bits, 0 to 127
+)
+{
+	return midiOutput.Send(MakeInstrumentMessage(channel, instrument));
+}
@@ -0,0 +1,75 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <Windows.h>
+
+#include <utility>
+
+// Result of Windows Midi call, which returns MMRESULT error code.
+// MMSYSERR_NOERROR (0) is success.
+// Small and trivially copyable: returned in a register, checking it is
+// one compare, so success path costs nothing extra.
+class [[nodiscard]] MidiResult {
+public:
+	constexpr MidiResult() = default;
+	constexpr explicit MidiResult(MMRESULT code) : code(code) {}
+
+	constexpr bool Ok() const { return code == MMSYSERR_NOERROR; }
+	constexpr explicit operator bool() const { return Ok(); }
+	constexpr MMRESULT Code() const { return code; }
+
+	// Device went away (unplugged, driver restarted):
+	// closing and opening it again may help
+	constexpr bool IsDisconnect() const
+	{
+		return code == MMSYSERR_NODRIVER
+			|| code == MMSYSERR_INVALHANDLE
+			|| code == MIDIERR_NODEVICE;
+	}
+
+	// Short English description, for example "device not ready"
+	const char* Message() const
+	{
+		switch (code)
+		{
+		case MMSYSERR_NOERROR: return "ok";
+		case MMSYSERR_ERROR: return "unspecified error";
+		case MMSYSERR_BADDEVICEID: return "bad device id";
+		case MMSYSERR_ALLOCATED: return "device already in use";
+		case MMSYSERR_INVALHANDLE: return "invalid handle";
+		case MMSYSERR_NODRIVER: return "no driver";
+		case MMSYSERR_NOMEM: return "out of memory";
+		case MMSYSERR_NOTSUPPORTED: return "not supported";
+		case MMSYSERR_INVALPARAM: return "invalid parameter";
+		case MIDIERR_NOTREADY: return "device not ready";
+		case MIDIERR_NODEVICE: return "no device";
+		case MIDIERR_BADOPENMODE: return "bad open mode";
+		default: return "error";
+		}
+	}
+
+private:
+	MMRESULT code{ MMSYSERR_NOERROR };
+};
+
+// Value, or MidiResult saying why there is no value.
+// Like C++23 std::expected, trimmed to what this project needs.
+template <typename T>
+class [[nodiscard]] MidiExpected {
+public:
+	MidiExpected(T value) : value(std::move(value)) {}
+	MidiExpected(MidiResult error) : error(error) {}
+
+	bool Ok() const { return error.Ok(); }
+	explicit operator bool() const { return Ok(); }
+	MidiResult Error() const { return error; }
+
+	T& Value() { return value; }
+	T& operator*() { return value; }
+
+private:
+	T value{};
+	MidiResult error;
+};
@@ -0,0 +1,202 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "MidiStream.h"
+
+#include <array>
+#include <bit>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIDI_STREAM_SSE2 1
+#endif
+
+namespace {
+
+	// What Status byte does, one entry per byte value.
+	// Lower 2 bits: data bytes that follow. Upper bits: kind.
+	const uint8_t StatusDataMask = 0x03;
+	const uint8_t StatusRealTime = 0x10;    // 0xF8 to 0xFF: goes out as is, changes nothing
+	const uint8_t StatusSysExStart = 0x20;  // 0xF0
+	const uint8_t StatusSysExEnd = 0x40;    // 0xF7
+	const uint8_t StatusIgnored = 0x80;     // Undefined: 0xF4, 0xF5, and Real-Time 0xF9, 0xFD
+
+	constexpr std::array<uint8_t, 256> MakeStatusTable()
+	{
+		std::array<uint8_t, 256> table{};
+		for (uint32_t byte = 0x80; byte <= 0xFF; ++byte)
+		{
+			const uint8_t statusByte = static_cast<uint8_t>(byte);
+			switch (statusByte)
+			{
+			case 0xF0: table[byte] = StatusSysExStart; break;
+			case 0xF7: table[byte] = StatusSysExEnd; break;
+			case 0xF4: case 0xF5: table[byte] = StatusIgnored; break;
+			case 0xF9: case 0xFD: table[byte] = StatusRealTime | StatusIgnored; break;
+			default:
+				table[byte] = static_cast<uint8_t>(MidiMessageLength(statusByte) - 1);
+				if (statusByte >= 0xF8)
+				{
+					table[byte] |= StatusRealTime;
+				}
+				break;
+			}
+		}
+		return table;
+	}
+
+	constexpr std::array<uint8_t, 256> StatusTable = MakeStatusTable();
+
+	static_assert(StatusTable[0x90] == 2 && StatusTable[0xC5] == 1 && StatusTable[0xF2] == 2, "Data byte counts");
+	static_assert(StatusTable[0xF8] == StatusRealTime && StatusTable[0xF6] == 0, "Real-Time and Tune Request");
+
+}
+
+size_t MidiStreamDecoder::Decode(const uint8_t* bytes, size_t count, MidiMessage* midiMessages)
+{
+	const uint8_t* position = bytes;
+	const uint8_t* const end = bytes + count;
+	MidiMessage* output = midiMessages;
+
+	while (position != end)
+	{
+		if (inSysEx)
+		{
+			// Whole dump is skipped in one scan, up to End of Exclusive (or Real-Time)
+			const uint8_t* statusByte = FindMidiStatusByte(position, end);
+			stats.sysExBytes += static_cast<uint64_t>(statusByte - position);
+			position = statusByte;
+			if (position == end)
+			{
+				break;
+			}
+		}
+
+		const uint8_t byte = *position;
+		if (byte & 0x80)
+		{
+			++position;
+			const uint8_t entry = StatusTable[byte];
+			if (entry & StatusRealTime)
+			{
+				// Doesn't end System Exclusive, or break message it lands in
+				if ((entry & StatusIgnored) == 0)
+				{
+					*output++ = MidiMessage(byte, 0);
+				}
+				continue;
+			}
+
+			// Message cut short by this Status byte is lost
+			stats.droppedBytes += dataCount;
+			dataCount = 0;
+			if (inSysEx)
+			{
+				// End of Exclusive, or any other Status byte, ends System Exclusive
+				inSysEx = false;
+				++stats.sysExCount;
+				if (entry & StatusSysExEnd)
+				{
+					continue;
+				}
+			}
+			if (entry & (StatusSysExEnd | StatusIgnored))
+			{
+				stats.droppedBytes += (entry & StatusSysExEnd) ? 1u : 0u;
+				status = 0;
+				continue;
+			}
+			if (entry & StatusSysExStart)
+			{
+				inSysEx = true;
+				status = 0;
+				continue;
+			}
+
+			status = byte;
+			dataLength = entry & StatusDataMask;
+			if (dataLength == 0)
+			{
+				// Tune Request
+				*output++ = MidiMessage(byte, 0);
+				status = 0;
+			}
+			continue;
+		}
+
+		if (status == 0)
+		{
+			++stats.droppedBytes;
+			++position;
+			continue;
+		}
+
+		if (dataCount == 0 && status < 0xF0)
+		{
+			// Fast path: data bytes up to next Status byte are whole messages
+			// of same channel status (running status)
+			const uint8_t* runEnd = FindMidiStatusByte(position, end);
+			if (dataLength == 2)
+			{
+				for (; runEnd - position >= 2; position += 2)
+				{
+					*output++ = MidiMessage(status, position[0], position[1]);
+				}
+			}
+			else
+			{
+				for (; position != runEnd; ++position)
+				{
+					*output++ = MidiMessage(status, position[0]);
+				}
+			}
+			if (position == runEnd)
+			{
+				continue;
+			}
+		}
+
+		data[dataCount++] = *position++;
+		if (dataCount == dataLength)
+		{
+			*output++ = MidiMessage(status, data[0], dataLength == 2 ? data[1] : 0);
+			dataCount = 0;
+			if (status >= 0xF0)
+			{
+				// System Common messages cancel running status
+				status = 0;
+			}
+		}
+	}
+
+	const size_t messageCount = static_cast<size_t>(output - midiMessages);
+	stats.messageCount += messageCount;
+	return messageCount;
+}
+
+const uint8_t* FindMidiStatusByte(const uint8_t* position, const uint8_t* end)
+{
+#ifdef MIDI_STREAM_SSE2
+	while (end - position >= 16)
+	{
+		// Top bit of every byte, 16 at once: set bits are Status bytes
+		const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(position));
+		const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(block));
+		if (mask != 0)
+		{
+			return position + std::countr_zero(mask);
+		}
+		position += 16;
+	}
+#endif
+	return FindMidiStatusByteScalar(position, end);
+}
+
+const uint8_t* FindMidiStatusByteScalar(const uint8_t* position, const uint8_t* end)
+{
+	while (position != end && (*position & 0x80) == 0)
+	{
+		++position;
+	}
+	return position;
+}
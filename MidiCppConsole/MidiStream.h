@@ -0,0 +1,62 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiMessage.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw Midi byte stream (what travels on Midi cable, what file backend
+// writes, what capture tools save) to packed Midi Messages.
+//
+// Stream is Status bytes (top bit set) followed by data bytes (top bit clear):
+//     90 3C 5A        : Note On, Middle C
+//     3E 5A           : running status: another Note On, Status byte left out
+//     F8              : Real-Time (Timing Clock), can come anywhere,
+//                       even between data bytes of other message
+//     F0 ... F7       : System Exclusive, any number of data bytes
+//
+// Every Status byte is looked up in one 256-entry table (data byte count,
+// Real-Time, System Exclusive), instead of switch per byte.
+// Runs of data bytes are found by scanning for next byte with top bit set,
+// 16 bytes at a time with SSE2: recorded streams are mostly long running
+// status runs and System Exclusive dumps, which are then copied out
+// without looking at every byte twice.
+
+// Decoded stream counts, since decoder was created
+struct MidiStreamStats {
+	uint64_t messageCount{ 0 };    // Midi Messages written, Real-Time included
+	uint64_t sysExCount{ 0 };      // System Exclusive messages skipped
+	uint64_t sysExBytes{ 0 };      // Their data bytes
+	uint64_t droppedBytes{ 0 };    // Data bytes without Status byte, stray End of Exclusive
+};
+
+// Keeps state between calls: stream can be cut anywhere,
+// for example into capture buffers, and decodes same as in one piece.
+class MidiStreamDecoder {
+public:
+	// Decodes bytes, appends Midi Messages.
+	// midiMessages must have room for count: every message takes at least 1 byte.
+	// System Exclusive isn't short message: it's skipped and counted.
+	// Returns number of Midi Messages written.
+	size_t Decode(const uint8_t* bytes, size_t count, MidiMessage* midiMessages);
+
+	const MidiStreamStats& Stats() const { return stats; }
+
+private:
+	uint8_t status{ 0 };       // Message being read, 0 if none; channel Status byte stays for running status
+	uint8_t dataLength{ 0 };   // Data bytes status takes
+	uint8_t dataCount{ 0 };    // Data bytes read so far
+	uint8_t data[2]{};
+	bool inSysEx{ false };
+	MidiStreamStats stats;
+};
+
+// First byte with top bit set (Status byte) in [position, end), or end.
+// 16 bytes at a time with SSE2, where CPU has it.
+const uint8_t* FindMidiStatusByte(const uint8_t* position, const uint8_t* end);
+
+// Same, byte at a time: for comparison in benchmarks
+const uint8_t* FindMidiStatusByteScalar(const uint8_t* position, const uint8_t* end);
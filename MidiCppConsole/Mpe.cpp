@@ -0,0 +1,232 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Mpe.h"
+
+namespace {
+
+	// Last sent values before anything was sent: never equal to real value
+	const uint16_t UnknownPitchBend = 0xFFFF;
+	const uint8_t UnknownValue = 0xFF;
+
+	const uint8_t ManagerChannel = 0;
+	const uint8_t TimbreControl = 74;
+
+}
+
+MpeZone::MpeZone(MidiOutput& midiOutput, uint8_t memberChannelCount)
+	: midiOutput(midiOutput), memberChannelCount(memberChannelCount < 15 ? memberChannelCount : 15)
+{
+	for (uint8_t channel = 0; channel < 16; ++channel)
+	{
+		channels[channel].pitchBend = UnknownPitchBend;
+		channels[channel].pressure = UnknownValue;
+		channels[channel].timbre = UnknownValue;
+	}
+	for (uint8_t channel = 1; channel <= this->memberChannelCount; ++channel)
+	{
+		PushBack(freeChannels, channel);
+	}
+}
+
+MidiResult MpeZone::Configure()
+{
+	// RPN 6 (MPE Configuration): Controls 101 and 100 select it,
+	// Data Entry MSB (Control 6) is Member Channel count
+	MidiResult result = CountSent(midiOutput.Send(MakeControlChangeMessage(ManagerChannel, 101, 0)));
+	if (result)
+	{
+		result = CountSent(midiOutput.Send(MakeControlChangeMessage(ManagerChannel, 100, 6)));
+	}
+	if (result)
+	{
+		result = CountSent(midiOutput.Send(MakeControlChangeMessage(ManagerChannel, 6, memberChannelCount)));
+	}
+	return result;
+}
+
+MidiExpected<MpeNote> MpeZone::NoteOn(uint8_t pitch, uint8_t velocity, const MpeExpression& expression)
+{
+	if (memberChannelCount == 0)
+	{
+		return MidiResult(MMSYSERR_INVALPARAM);
+	}
+
+	if (freeChannels.first == NoChannel)
+	{
+		// Every channel is sounding: oldest note makes room
+		ChannelState& oldest = channels[soundingChannels.first];
+		MpeNote stolen{ soundingChannels.first, oldest.pitch, oldest.generation };
+		++stats.stolenCount;
+		MidiResult result = NoteOff(stolen);
+		if (!result)
+		{
+			return result;
+		}
+	}
+
+	uint8_t channel = freeChannels.first;
+	Remove(freeChannels, channel);
+	PushBack(soundingChannels, channel);
+
+	ChannelState& state = channels[channel];
+	++state.generation;
+	state.pitch = pitch;
+	state.sounding = true;
+	MpeNote note{ channel, pitch, state.generation };
+
+	// Expression first, so note starts with right pitch and timbre
+	MidiResult result = SetPitchBend(note, expression.pitchBend);
+	if (result)
+	{
+		result = SetTimbre(note, expression.timbre);
+	}
+	if (result)
+	{
+		result = SetPressure(note, expression.pressure);
+	}
+	if (result)
+	{
+		result = CountSent(SendMidiNote(midiOutput, channel, pitch, velocity));
+	}
+	if (!result)
+	{
+		state.sounding = false;
+		Remove(soundingChannels, channel);
+		PushBack(freeChannels, channel);
+		return result;
+	}
+	return note;
+}
+
+MidiResult MpeZone::NoteOff(const MpeNote& note)
+{
+	if (!IsCurrent(note))
+	{
+		return MidiResult();
+	}
+
+	ChannelState& state = channels[note.channel];
+	state.sounding = false;
+	Remove(soundingChannels, note.channel);
+	PushBack(freeChannels, note.channel);
+
+	// Note Off: same note with velocity 0
+	return CountSent(SendMidiNote(midiOutput, note.channel, note.pitch, 0));
+}
+
+MidiResult MpeZone::SetPitchBend(const MpeNote& note, uint16_t pitchBend)
+{
+	if (!IsCurrent(note))
+	{
+		return MidiResult();
+	}
+
+	ChannelState& state = channels[note.channel];
+	if (state.pitchBend == pitchBend)
+	{
+		++stats.skippedCount;
+		return MidiResult();
+	}
+
+	// 14 bits: Data1 is lower 7 bits, Data2 is upper 7 bits
+	MidiResult result = CountSent(midiOutput.Send(MidiMessage(
+		static_cast<uint8_t>((PitchBendSignature << 4) | note.channel),
+		pitchBend & 0x7F,
+		static_cast<uint8_t>((pitchBend >> 7) & 0x7F))));
+	state.pitchBend = result ? pitchBend : UnknownPitchBend;
+	return result;
+}
+
+MidiResult MpeZone::SetPressure(const MpeNote& note, uint8_t pressure)
+{
+	if (!IsCurrent(note))
+	{
+		return MidiResult();
+	}
+
+	ChannelState& state = channels[note.channel];
+	if (state.pressure == pressure)
+	{
+		++stats.skippedCount;
+		return MidiResult();
+	}
+
+	// Channel Pressure: 0b 1101 CCCC, one data byte
+	MidiResult result = CountSent(midiOutput.Send(MidiMessage(static_cast<uint8_t>(0xD0 | note.channel), pressure)));
+	state.pressure = result ? pressure : UnknownValue;
+	return result;
+}
+
+MidiResult MpeZone::SetTimbre(const MpeNote& note, uint8_t timbre)
+{
+	if (!IsCurrent(note))
+	{
+		return MidiResult();
+	}
+
+	ChannelState& state = channels[note.channel];
+	if (state.timbre == timbre)
+	{
+		++stats.skippedCount;
+		return MidiResult();
+	}
+
+	MidiResult result = CountSent(midiOutput.Send(MakeControlChangeMessage(note.channel, TimbreControl, timbre)));
+	state.timbre = result ? timbre : UnknownValue;
+	return result;
+}
+
+void MpeZone::PushBack(ChannelList& list, uint8_t channel)
+{
+	ChannelState& state = channels[channel];
+	state.previous = list.last;
+	state.next = NoChannel;
+	if (list.last != NoChannel)
+	{
+		channels[list.last].next = channel;
+	}
+	else
+	{
+		list.first = channel;
+	}
+	list.last = channel;
+}
+
+void MpeZone::Remove(ChannelList& list, uint8_t channel)
+{
+	ChannelState& state = channels[channel];
+	if (state.previous != NoChannel)
+	{
+		channels[state.previous].next = state.next;
+	}
+	else
+	{
+		list.first = state.next;
+	}
+	if (state.next != NoChannel)
+	{
+		channels[state.next].previous = state.previous;
+	}
+	else
+	{
+		list.last = state.previous;
+	}
+	state.previous = NoChannel;
+	state.next = NoChannel;
+}
+
+bool MpeZone::IsCurrent(const MpeNote& note) const
+{
+	const ChannelState& state = channels[note.channel & 0x0F];
+	return state.sounding && state.generation == note.generation;
+}
+
+MidiResult MpeZone::CountSent(MidiResult result)
+{
+	if (result)
+	{
+		++stats.sentCount;
+	}
+	return result;
+}
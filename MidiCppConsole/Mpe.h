@@ -0,0 +1,110 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+
+#include <cstdint>
+
+// MPE (Midi Polyphonic Expression).
+// Reference: https://midi.org/mpe-midi-polyphonic-expression
+//
+// Midi 1.0 pitch bend and pressure apply to whole channel.
+// To bend one finger's note without bending others, MPE plays every note
+// on its own channel: Zone has one Manager Channel (global messages)
+// and up to 15 Member Channels, one sounding note each.
+//
+// MpeZone hands out Member Channels and remembers what was last sent on
+// each channel, so repeated pitch bend or pressure values aren't sent again.
+// Expressive controllers report positions at 1 kHz or more, and a finger
+// held still reports same value over and over.
+
+// Note played through MpeZone.
+// Stays valid until note is stopped, or its channel is taken by newer note.
+struct MpeNote {
+	uint8_t channel{ 0 };     // Member Channel note plays on
+	uint8_t pitch{ 0 };
+	uint32_t generation{ 0 }; // Tells old notes from current note of channel
+};
+
+// Per-note expression, Midi 1.0 resolution
+struct MpeExpression {
+	uint16_t pitchBend{ 8192 };  // 14 bits, 8192 is no bend
+	uint8_t pressure{ 0 };       // 7 bits, Channel Pressure
+	uint8_t timbre{ 64 };        // 7 bits, Control Change 74
+};
+
+struct MpeStats {
+	uint64_t sentCount{ 0 };     // Midi Messages sent
+	uint64_t skippedCount{ 0 };  // Expression updates not sent: same value as before
+	uint64_t stolenCount{ 0 };   // Notes stopped early: all Member Channels were busy
+};
+
+// Lower Zone: Manager Channel 0, Member Channels 1 to memberChannelCount.
+// Channel allocation is O(1): channels are kept in two linked lists,
+// free (least recently released first) and sounding (oldest first).
+// Least recently released channel is picked, so release tail of note
+// that just stopped isn't bent by next note.
+// When all channels are sounding, oldest note is stopped and its channel reused.
+class MpeZone {
+public:
+	explicit MpeZone(MidiOutput& midiOutput, uint8_t memberChannelCount = 15);
+
+	MpeZone(const MpeZone&) = delete;
+	MpeZone& operator=(const MpeZone&) = delete;
+
+	// MPE Configuration Message: RPN 6 on Manager Channel, value is Member Channel count.
+	// Synthesizer switches to MPE mode for this Zone.
+	MidiResult Configure();
+
+	// Picks Member Channel, sends initial expression (only what differs from
+	// channel's last values), then Note On
+	MidiExpected<MpeNote> NoteOn(uint8_t pitch, uint8_t velocity, const MpeExpression& expression = {});
+
+	MidiResult NoteOff(const MpeNote& note);
+
+	// Expression of one note. Sent only when value differs from last sent value.
+	// Updates of notes already stopped are ignored.
+	MidiResult SetPitchBend(const MpeNote& note, uint16_t pitchBend);
+	MidiResult SetPressure(const MpeNote& note, uint8_t pressure);
+	MidiResult SetTimbre(const MpeNote& note, uint8_t timbre);
+
+	const MpeStats& Stats() const { return stats; }
+
+private:
+	static constexpr uint8_t NoChannel = 0xFF;
+
+	struct ChannelState {
+		// Last values sent; Unknown until first send
+		uint16_t pitchBend;
+		uint8_t pressure;
+		uint8_t timbre;
+
+		uint32_t generation{ 0 };
+		uint8_t pitch{ 0 };
+		bool sounding{ false };
+
+		// Links in free list or sounding list, channel is always in one of them
+		uint8_t previous{ NoChannel };
+		uint8_t next{ NoChannel };
+	};
+
+	struct ChannelList {
+		uint8_t first{ NoChannel };
+		uint8_t last{ NoChannel };
+	};
+
+	void PushBack(ChannelList& list, uint8_t channel);
+	void Remove(ChannelList& list, uint8_t channel);
+
+	bool IsCurrent(const MpeNote& note) const;
+	MidiResult CountSent(MidiResult result);
+
+	MidiOutput& midiOutput;
+	uint8_t memberChannelCount;
+	ChannelState channels[16];
+	ChannelList freeChannels;
+	ChannelList soundingChannels;
+	MpeStats stats;
+};
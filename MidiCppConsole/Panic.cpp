@@ -0,0 +1,180 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Panic.h"
+
+#include <Windows.h>
+
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+	// Output protected by console and terminate handlers.
+	// Handlers run on other threads: mutex keeps output alive while they use it.
+	std::mutex panicMutex;
+	PanicMidiOutput* panicOutput = nullptr;
+	std::terminate_handler previousTerminate = nullptr;
+
+	void PanicNow()
+	{
+		std::lock_guard<std::mutex> lock(panicMutex);
+		if (panicOutput != nullptr)
+		{
+			panicOutput->Panic();
+		}
+	}
+
+	// Runs on its own thread, while main thread may still be sending
+	BOOL WINAPI ConsoleCtrlHandler(DWORD ctrlType)
+	{
+		switch (ctrlType)
+		{
+		case CTRL_C_EVENT:
+		case CTRL_BREAK_EVENT:
+		case CTRL_CLOSE_EVENT:
+			PanicNow();
+			break;
+		}
+		// Let default handler end process
+		return FALSE;
+	}
+
+	[[noreturn]] void TerminateHandler()
+	{
+		PanicNow();
+		if (previousTerminate != nullptr)
+		{
+			previousTerminate();
+		}
+		std::abort();
+	}
+
+	void InstallHandlers()
+	{
+		static std::once_flag installed;
+		std::call_once(installed, []()
+			{
+				SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
+				previousTerminate = std::set_terminate(TerminateHandler);
+			});
+	}
+
+}
+
+PanicMidiOutput::PanicMidiOutput(std::unique_ptr<MidiOutput> midiOutput)
+	: midiOutput(std::move(midiOutput))
+{
+	InstallHandlers();
+
+	std::lock_guard<std::mutex> lock(panicMutex);
+	panicOutput = this;
+}
+
+PanicMidiOutput::~PanicMidiOutput()
+{
+	std::lock_guard<std::mutex> lock(panicMutex);
+	if (panicOutput == this)
+	{
+		panicOutput = nullptr;
+	}
+	Panic();
+}
+
+MidiResult PanicMidiOutput::Write(MidiMessage midiMessage)
+{
+	std::lock_guard<std::mutex> lock(sendMutex);
+	if (silenced.load(std::memory_order_relaxed)
+		&& (midiMessage.Status() >> 4) == NoteOnSignature
+		&& midiMessage.Data2() != 0)
+	{
+		return MidiResult(MMSYSERR_ERROR);
+	}
+
+	MidiResult result = midiOutput->Write(midiMessage);
+	if (result.Ok())
+	{
+		noteTracker.Update(midiMessage);
+	}
+	return result;
+}
+
+void PanicMidiOutput::Flush()
+{
+	std::lock_guard<std::mutex> lock(sendMutex);
+	midiOutput->Flush();
+}
+
+MidiResult PanicMidiOutput::Reopen()
+{
+	std::lock_guard<std::mutex> lock(sendMutex);
+	return midiOutput->Reopen();
+}
+
+uint32_t PanicMidiOutput::Panic(std::chrono::milliseconds budget)
+{
+	// Sender sees this as soon as it's done with current message
+	silenced.store(true, std::memory_order_relaxed);
+
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + budget;
+	std::unique_lock<std::mutex> lock(sendMutex, std::defer_lock);
+	while (!lock.try_lock())
+	{
+		if (std::chrono::steady_clock::now() > deadline)
+		{
+			return 0;
+		}
+		std::this_thread::yield();
+	}
+
+	// Sends go straight to backend: this already holds send lock
+	auto send = [&](MidiMessage midiMessage)
+	{
+		MidiResult result = midiOutput->Send(midiMessage);
+		if (result.Ok())
+		{
+			noteTracker.Update(midiMessage);
+		}
+		return result;
+	};
+
+	uint32_t sentCount = 0;
+	bool fallback = false;
+
+	// Only notes that are sounding: usually a handful of messages, not 2048
+	for (uint8_t channel = 0; channel < 16 && !fallback; ++channel)
+	{
+		for (uint8_t pitch = 0; pitch < 128 && noteTracker.IsChannelSounding(channel); ++pitch)
+		{
+			if (!noteTracker.IsSounding(channel, pitch))
+			{
+				continue;
+			}
+			if (std::chrono::steady_clock::now() > deadline || !send(MakeNoteMessage(channel, pitch, 0)))
+			{
+				fallback = true;
+				break;
+			}
+			++sentCount;
+		}
+	}
+
+	if (fallback)
+	{
+		// One message per channel silences everything left
+		for (uint8_t channel = 0; channel < 16; ++channel)
+		{
+			if (noteTracker.IsChannelSounding(channel)
+				&& send(MakeControlChangeMessage(channel, AllNotesOffControl, 0)))
+			{
+				noteTracker.ReleaseChannel(channel);
+				++sentCount;
+			}
+		}
+	}
+
+	midiOutput->Flush();
+	return sentCount;
+}
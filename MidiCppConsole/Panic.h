@@ -0,0 +1,116 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Hung-note safety net.
+//
+// Synthesizer keeps playing a note until it gets Note Off.
+// If program stops between Note On and Note Off (Ctrl+C, console closed,
+// exception), note keeps sounding after program is gone.
+// PanicMidiOutput remembers which notes are sounding, and on the way out
+// sends Note Off for each of them.
+
+// Which notes are sounding right now: one bit per channel and pitch, 256 bytes.
+// Updates must not run at the same time: Update() is plain load and store
+// (as in Metrics.h), so two threads updating one word lose each other's bit.
+// PanicMidiOutput updates it only under its send lock. Words are atomics,
+// so other threads may still read them at any time.
+class NoteTracker {
+public:
+	void Update(MidiMessage midiMessage)
+	{
+		uint8_t signature = midiMessage.Status() >> 4;
+		if (signature != NoteOnSignature && signature != NoteOffSignature)
+		{
+			return;
+		}
+
+		// Note On with velocity 0 is Note Off
+		bool sounding = signature == NoteOnSignature && midiMessage.Data2() != 0;
+		uint32_t channel = midiMessage.Status() & 0x0F;
+		uint32_t pitch = midiMessage.Data1() & 0x7F;
+
+		std::atomic<uint64_t>& word = words[channel * 2 + (pitch >> 6)];
+		uint64_t bit = uint64_t{ 1 } << (pitch & 63);
+		uint64_t value = word.load(std::memory_order_relaxed);
+		word.store(sounding ? value | bit : value & ~bit, std::memory_order_relaxed);
+	}
+
+	bool IsSounding(uint8_t channel, uint8_t pitch) const
+	{
+		uint64_t value = words[channel * 2 + (pitch >> 6)].load(std::memory_order_relaxed);
+		return (value >> (pitch & 63)) & 1;
+	}
+
+	bool IsChannelSounding(uint8_t channel) const
+	{
+		return (words[channel * 2].load(std::memory_order_relaxed)
+			| words[channel * 2 + 1].load(std::memory_order_relaxed)) != 0;
+	}
+
+	// After All Notes Off
+	void ReleaseChannel(uint8_t channel)
+	{
+		words[channel * 2].store(0, std::memory_order_relaxed);
+		words[channel * 2 + 1].store(0, std::memory_order_relaxed);
+	}
+
+private:
+	// 16 channels, 2 words of 64 pitches each
+	std::atomic<uint64_t> words[16 * 2]{};
+};
+
+// Wraps backend and tracks sounding notes.
+//
+// Panic() runs when:
+//  - PanicMidiOutput is destroyed with notes still sounding
+//    (for example, exception unwinds through playback)
+//  - Console gets Ctrl+C, Ctrl+Break or is closed
+//  - std::terminate() is called
+// Only one PanicMidiOutput is protected by console and terminate handlers:
+// last one created.
+//
+// Console handler runs on its own thread while sender may be in the middle
+// of Write(): backends aren't thread-safe, so Write(), Flush(), Reopen() and
+// Panic() take one lock. Sender holds it for one message at a time.
+class PanicMidiOutput : public MidiOutput {
+public:
+	explicit PanicMidiOutput(std::unique_ptr<MidiOutput> midiOutput);
+	~PanicMidiOutput() override;
+
+	PanicMidiOutput(const PanicMidiOutput&) = delete;
+	PanicMidiOutput& operator=(const PanicMidiOutput&) = delete;
+
+	void Flush() override;
+	MidiResult Reopen() override;
+	uint32_t Connection() const override { return midiOutput->Connection(); }
+
+	// Sends Note Off for every sounding note. If device fails, or budget
+	// runs out first, falls back to All Notes Off (Control Change 123)
+	// on channels that still have notes: at most 16 messages.
+	// Afterwards new Note Ons are refused, so notes stay off.
+	// Waits for sender to finish message it's sending, within budget;
+	// if sender is stuck in device that long, nothing is sent.
+	// Returns number of Midi Messages sent.
+	uint32_t Panic(std::chrono::milliseconds budget = std::chrono::milliseconds(250));
+
+	const NoteTracker& Notes() const { return noteTracker; }
+
+protected:
+	MidiResult Write(MidiMessage midiMessage) override;
+
+private:
+	std::unique_ptr<MidiOutput> midiOutput;
+	NoteTracker noteTracker;
+	std::atomic<bool> silenced{ false };
+	std::mutex sendMutex;  // Backend and noteTracker, see top of class
+};
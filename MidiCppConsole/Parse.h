@@ -0,0 +1,119 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Small text parsing helpers.
+// They use std::from_chars, which doesn't touch locale or iostream,
+// so parsing stays cheap at startup.
+
+// Parses whole text as unsigned number not bigger than maxValue.
+template <typename T>
+inline bool ParseUnsigned(std::string_view text, T maxValue, T& value)
+{
+	uint64_t parsed = 0;
+	const char* end = text.data() + text.size();
+	std::from_chars_result result = std::from_chars(text.data(), end, parsed);
+	if (text.empty() || result.ec != std::errc() || result.ptr != end || parsed > maxValue)
+	{
+		return false;
+	}
+	value = static_cast<T>(parsed);
+	return true;
+}
+
+// Parses whole text as signed number between minValue and maxValue.
+template <typename T>
+inline bool ParseSigned(std::string_view text, T minValue, T maxValue, T& value)
+{
+	int64_t parsed = 0;
+	const char* end = text.data() + text.size();
+	std::from_chars_result result = std::from_chars(text.data(), end, parsed);
+	if (text.empty() || result.ec != std::errc() || result.ptr != end || parsed < minValue || parsed > maxValue)
+	{
+		return false;
+	}
+	value = static_cast<T>(parsed);
+	return true;
+}
+
+inline bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Splits off next token, separated by whitespace or any of extraSeparators.
+// Returns empty token when text is exhausted.
+inline std::string_view NextToken(std::string_view& text, std::string_view extraSeparators = {})
+{
+	size_t begin = 0;
+	while (begin < text.size() && (IsSpace(text[begin]) || extraSeparators.find(text[begin]) != std::string_view::npos))
+	{
+		++begin;
+	}
+	size_t end = begin;
+	while (end < text.size() && !IsSpace(text[end]) && extraSeparators.find(text[end]) == std::string_view::npos)
+	{
+		++end;
+	}
+	std::string_view token = text.substr(begin, end - begin);
+	text.remove_prefix(end);
+	return token;
+}
+
+struct NoteName {
+	uint8_t pitch{ 0 };
+	size_t length{ 0 };            // Characters read, up to error if there is one
+	const char* error{ nullptr };  // Why name is bad, nullptr if it's good
+};
+
+// Parses note name at start of text: "C4" is Middle C (60), "F#3" is 54, "Bb-1" is 10.
+// Letter A to G, optional sharp (#) or flat (b), octave -1 to 9.
+// constexpr, so same parser checks names in compile-time melodies (see Melody.h)
+// and in score text (see Score.h).
+constexpr NoteName ParseNoteName(std::string_view text)
+{
+	//                                A  B  C  D  E  F  G
+	constexpr int8_t Semitones[] = { 9, 11, 0, 2, 4, 5, 7 };
+
+	size_t i = 0;
+	if (text.empty() || text[i] < 'A' || text[i] > 'G')
+	{
+		return { 0, i, "note name must start with A to G" };
+	}
+	int semitone = Semitones[text[i++] - 'A'];
+	if (i < text.size() && text[i] == '#')
+	{
+		++semitone;
+		++i;
+	}
+	else if (i < text.size() && text[i] == 'b')
+	{
+		--semitone;
+		++i;
+	}
+
+	bool negative = i < text.size() && text[i] == '-';
+	if (negative)
+	{
+		++i;
+	}
+	if (i == text.size() || text[i] < '0' || text[i] > '9' || (i + 1 < text.size() && text[i + 1] >= '0' && text[i + 1] <= '9'))
+	{
+		return { 0, i, "octave must be -1 to 9" };
+	}
+	int octave = text[i++] - '0';
+
+	// Midi pitch 0 is C-1, so Middle C (C4) is 60
+	int pitch = ((negative ? -octave : octave) + 1) * 12 + semitone;
+	if (pitch < 0 || pitch > 127)
+	{
+		return { 0, i, "note out of Midi range" };
+	}
+	return { static_cast<uint8_t>(pitch), i, nullptr };
+}
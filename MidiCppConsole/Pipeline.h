@@ -0,0 +1,247 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "GeneralMidi.h"
+#include "Player.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// Event processing between generation and sending:
+// channel map, transpose, velocity curve, redundancy elision.
+//
+// Stage is any type with
+//     bool operator()(MidiEvent& midiEvent)
+// that changes event in place, and returns false to drop it.
+//
+// Pipeline<Stages...> fuses stages at compile time: one loop over batch,
+// every event goes through all stages while it's in registers, then is
+// written back (or dropped) in place. No buffer between stages,
+// no virtual call, and compiler can inline stages into each other.
+
+template <typename... Stages>
+class Pipeline {
+public:
+	explicit Pipeline(Stages... stages) : stages(std::move(stages)...) {}
+
+	// Processes batch in place. Kept events stay in order at front.
+	// Returns number of kept events.
+	size_t Process(MidiEvent* midiEvents, size_t count)
+	{
+		size_t kept = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			MidiEvent midiEvent = midiEvents[i];
+			if (ProcessEvent<0>(midiEvent))
+			{
+				midiEvents[kept++] = midiEvent;
+			}
+		}
+		return kept;
+	}
+
+	void Process(std::vector<MidiEvent>& midiEvents)
+	{
+		midiEvents.resize(Process(midiEvents.data(), midiEvents.size()));
+	}
+
+	template <size_t Index>
+	auto& Stage() { return std::get<Index>(stages); }
+
+private:
+	// Expands to stage0(e) && stage1(e) && ... at compile time
+	template <size_t Index>
+	bool ProcessEvent(MidiEvent& midiEvent)
+	{
+		if constexpr (Index == sizeof...(Stages))
+		{
+			return true;
+		}
+		else
+		{
+			return std::get<Index>(stages)(midiEvent) && ProcessEvent<Index + 1>(midiEvent);
+		}
+	}
+
+	std::tuple<Stages...> stages;
+};
+
+// Stage types are deduced: MakePipeline(Transpose{ 12 }, RedundancyElision())
+template <typename... Stages>
+Pipeline<Stages...> MakePipeline(Stages... stages)
+{
+	return Pipeline<Stages...>(std::move(stages)...);
+}
+
+//
+// Stages
+//
+
+inline bool IsChannelMessage(MidiMessage midiMessage)
+{
+	return midiMessage.Status() >= 0x80 && midiMessage.Status() < 0xF0;
+}
+
+inline bool IsNoteMessage(MidiMessage midiMessage)
+{
+	uint8_t signature = midiMessage.Status() >> 4;
+	return signature == NoteOnSignature || signature == NoteOffSignature;
+}
+
+// Moves channel messages from one channel to another
+struct ChannelMap {
+	uint8_t channels[16]{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+	bool operator()(MidiEvent& midiEvent) const
+	{
+		MidiMessage& midiMessage = midiEvent.midiMessage;
+		if (IsChannelMessage(midiMessage))
+		{
+			// Channel is lowest 4 bits of status byte
+			midiMessage.dataDWord = (midiMessage.dataDWord & ~DWORD{ 0x0F }) | channels[midiMessage.dataDWord & 0x0F];
+		}
+		return true;
+	}
+};
+
+// Shifts notes by semitones. Notes shifted out of 0 to 127 are dropped:
+// Note On and its Note Off have same pitch, so both go.
+// Drum channel isn't shifted: its pitches pick instruments, not notes.
+struct Transpose {
+	int32_t semitones{ 0 };
+
+	bool operator()(MidiEvent& midiEvent) const
+	{
+		MidiMessage& midiMessage = midiEvent.midiMessage;
+		if (!IsNoteMessage(midiMessage) || (midiMessage.Status() & 0x0F) == GeneralMidi::DrumChannel)
+		{
+			return true;
+		}
+		int32_t pitch = midiMessage.Data1() + semitones;
+		if (pitch < 0 || pitch > 127)
+		{
+			return false;
+		}
+		// Pitch is second byte
+		midiMessage.dataDWord = (midiMessage.dataDWord & ~DWORD{ 0xFF00 }) | (static_cast<DWORD>(pitch) << 8);
+		return true;
+	}
+};
+
+// Maps Note On velocity through table, for example to make soft notes louder.
+// Velocity 0 (Note Off) stays 0, other velocities stay at least 1.
+struct VelocityCurve {
+	uint8_t velocities[128];
+
+	// gamma below 1 makes soft notes louder, above 1 makes them softer
+	explicit VelocityCurve(double gamma = 1.0)
+	{
+		velocities[0] = 0;
+		for (int i = 1; i < 128; ++i)
+		{
+			long velocity = std::lround(127.0 * std::pow(i / 127.0, gamma));
+			velocities[i] = static_cast<uint8_t>(velocity < 1 ? 1 : velocity);
+		}
+	}
+
+	bool operator()(MidiEvent& midiEvent) const
+	{
+		MidiMessage& midiMessage = midiEvent.midiMessage;
+		if ((midiMessage.Status() >> 4) == NoteOnSignature)
+		{
+			// Velocity is third byte
+			DWORD velocity = velocities[(midiMessage.dataDWord >> 16) & 0x7F];
+			midiMessage.dataDWord = (midiMessage.dataDWord & ~DWORD{ 0xFF0000 }) | (velocity << 16);
+		}
+		return true;
+	}
+};
+
+// Drops messages that change nothing: Note Off of note that isn't sounding,
+// Control Change or Program Change with same value as last time.
+// Only controllers that hold a value are compared. Data Entry, Increment,
+// Decrement and parameter selects act on parameter selected at the time,
+// and Channel Mode messages (120 to 127) are commands: those always pass.
+// Bank Select applies at next Program Change, so that one passes after it.
+struct RedundancyElision {
+	uint64_t sounding[16][2]{};      // Bit per channel and pitch
+	uint8_t controls[16][128];       // Last value, 0xFF before first
+	uint8_t instruments[16];         // Last Program Change, 0xFF before first
+
+	RedundancyElision()
+	{
+		for (auto& channelControls : controls)
+		{
+			for (uint8_t& value : channelControls)
+			{
+				value = 0xFF;
+			}
+		}
+		for (uint8_t& instrument : instruments)
+		{
+			instrument = 0xFF;
+		}
+	}
+
+	bool operator()(MidiEvent& midiEvent)
+	{
+		const MidiMessage midiMessage = midiEvent.midiMessage;
+		const uint8_t signature = midiMessage.Status() >> 4;
+		const uint8_t channel = midiMessage.Status() & 0x0F;
+		const uint8_t data1 = midiMessage.Data1() & 0x7F;
+
+		switch (signature)
+		{
+		case NoteOnSignature:
+		case NoteOffSignature:
+		{
+			uint64_t& word = sounding[channel][data1 >> 6];
+			uint64_t bit = uint64_t{ 1 } << (data1 & 63);
+			if (signature == NoteOnSignature && midiMessage.Data2() != 0)
+			{
+				word |= bit;
+				return true;
+			}
+			bool wasSounding = (word & bit) != 0;
+			word &= ~bit;
+			return wasSounding;
+		}
+		case ControlChangeSignature:
+		{
+			if (!IsStateController(data1))
+			{
+				return true;
+			}
+			uint8_t& last = controls[channel][data1];
+			bool changed = last != midiMessage.Data2();
+			last = midiMessage.Data2();
+			if (changed && (data1 == BankSelectMsbControl || data1 == BankSelectLsbControl))
+			{
+				instruments[channel] = 0xFF;
+			}
+			return changed;
+		}
+		case SetInstrumentSignature:
+		{
+			uint8_t& last = instruments[channel];
+			bool changed = last != data1;
+			last = data1;
+			return changed;
+		}
+		default:
+			return true;
+		}
+	}
+
+	static constexpr bool IsStateController(uint8_t control)
+	{
+		// Data Entry MSB and LSB, Increment, Decrement, NRPN and RPN selects
+		return control != 6 && control != 38 && (control < 96 || control > 101) && control < 120;
+	}
+};
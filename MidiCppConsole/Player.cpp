@@ -0,0 +1,206 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Player.h"
+
+#include "Metrics.h"
+#include "Parse.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+bool ParseNoteList(
+	std::string_view text,
+	const Note& defaultNote,
+	std::vector<Note>& notes)
+{
+	for (std::string_view token = NextToken(text, ","); !token.empty(); token = NextToken(text, ","))
+	{
+		// pitch[:velocity[:durationMs]]
+		std::string_view fields[3];
+		size_t fieldCount = 0;
+		while (fieldCount < 3)
+		{
+			size_t colon = token.find(':');
+			fields[fieldCount++] = token.substr(0, colon);
+			if (colon == std::string_view::npos)
+			{
+				token = {};
+				break;
+			}
+			token.remove_prefix(colon + 1);
+		}
+
+		Note note = defaultNote;
+		if (!token.empty()
+			|| !ParseUnsigned<uint8_t>(fields[0], 127, note.pitch)
+			|| (fieldCount > 1 && !ParseUnsigned<uint8_t>(fields[1], 127, note.velocity))
+			|| (fieldCount > 2 && !ParseUnsigned<uint32_t>(fields[2], UINT32_MAX, note.durationMs)))
+		{
+			fprintf(stderr, "Bad note: %.*s\n", static_cast<int>(fields[0].size()), fields[0].data());
+			return false;
+		}
+		notes.push_back(note);
+	}
+	return true;
+}
+
+std::vector<MidiEvent> CompileNotes(
+	uint8_t channel,
+	uint8_t instrument,
+	const std::vector<Note>& notes)
+{
+	std::vector<MidiEvent> midiEvents;
+	midiEvents.reserve(1 + notes.size() * 2);
+
+	midiEvents.push_back({ 0, MakeInstrumentMessage(channel, instrument) });
+
+	int64_t timeMicroseconds = 0;
+	for (const Note& note : notes)
+	{
+		midiEvents.push_back({ timeMicroseconds, MakeNoteMessage(channel, note.pitch, note.velocity) });
+		timeMicroseconds += static_cast<int64_t>(note.durationMs) * 1000;
+
+		// Note Off: same note with velocity 0
+		midiEvents.push_back({ timeMicroseconds, MakeNoteMessage(channel, note.pitch, 0) });
+	}
+	return midiEvents;
+}
+
+namespace {
+
+	// Sleeps until deadline, and counts how late wakeup was
+	void WaitForDeadline(Clock& clock, std::chrono::nanoseconds deadline)
+	{
+		clock.SleepUntil(deadline);
+		const std::chrono::nanoseconds lateness = clock.Now() - deadline;
+		TraceCounter("wakeup lateness (ns)", lateness.count());
+		if (lateness > std::chrono::milliseconds(1))
+		{
+			CountMetric(Metric::LateEvents);
+		}
+	}
+
+}
+
+MidiResult PlayEvents(
+	MidiOutput& midiOutput,
+	Clock& clock,
+	const MidiEvent* midiEvents,
+	size_t count)
+{
+	MidiResult firstError;
+	// Slow device gets events early, so they are heard on time.
+	// Events in first latency of song can't be early: they go out right away.
+	const std::chrono::nanoseconds latency = midiOutput.Latency();
+	for (size_t i = 0; i < count; ++i)
+	{
+		const MidiEvent& midiEvent = midiEvents[i];
+		const std::chrono::nanoseconds deadline = std::max(
+			std::chrono::nanoseconds(std::chrono::microseconds(midiEvent.timeMicroseconds)) - latency,
+			std::chrono::nanoseconds(0));
+		WaitForDeadline(clock, deadline);
+
+		{
+			TraceScope traceScope("send");
+			MidiResult result = midiOutput.Send(midiEvent.midiMessage);
+			if (!result && firstError.Ok())
+			{
+				firstError = result;
+			}
+		}
+
+		// Events at same time (for example Note Off and next Note On) go out together
+		if (i + 1 == count || midiEvents[i + 1].timeMicroseconds != midiEvent.timeMicroseconds)
+		{
+			midiOutput.Flush();
+		}
+	}
+	return firstError;
+}
+
+MidiResult PlayEvents(
+	MidiOutput* const* midiOutputs,
+	size_t outputCount,
+	Clock& clock,
+	const MidiEvent* midiEvents,
+	size_t count)
+{
+	if (outputCount == 1)
+	{
+		return PlayEvents(*midiOutputs[0], clock, midiEvents, count);
+	}
+
+	struct Cursor {
+		size_t next;                        // Index of output's next event
+		std::chrono::nanoseconds holdBack;  // Slowest latency minus output's latency
+		bool unflushed;
+	};
+	std::chrono::nanoseconds slowest(0);
+	for (size_t i = 0; i < outputCount; ++i)
+	{
+		slowest = std::max<std::chrono::nanoseconds>(slowest, midiOutputs[i]->Latency());
+	}
+	std::vector<Cursor> cursors(outputCount);
+	for (size_t i = 0; i < outputCount; ++i)
+	{
+		cursors[i] = { 0, slowest - midiOutputs[i]->Latency(), false };
+	}
+
+	MidiResult firstError;
+	std::chrono::nanoseconds previousDeadline(-1);
+	while (true)
+	{
+		// Few outputs: linear scan beats any heap
+		size_t output = outputCount;
+		std::chrono::nanoseconds deadline = std::chrono::nanoseconds::max();
+		for (size_t i = 0; i < outputCount; ++i)
+		{
+			if (cursors[i].next < count)
+			{
+				std::chrono::nanoseconds outputDeadline =
+					std::chrono::microseconds(midiEvents[cursors[i].next].timeMicroseconds) + cursors[i].holdBack;
+				if (outputDeadline < deadline)
+				{
+					deadline = outputDeadline;
+					output = i;
+				}
+			}
+		}
+
+		// Messages due together go out together, before waiting for next ones
+		if (output == outputCount || deadline != previousDeadline)
+		{
+			for (size_t i = 0; i < outputCount; ++i)
+			{
+				if (cursors[i].unflushed)
+				{
+					midiOutputs[i]->Flush();
+					cursors[i].unflushed = false;
+				}
+			}
+		}
+		if (output == outputCount)
+		{
+			break;
+		}
+
+		WaitForDeadline(clock, deadline);
+		previousDeadline = deadline;
+
+		Cursor& cursor = cursors[output];
+		{
+			TraceScope traceScope("send");
+			MidiResult result = midiOutputs[output]->Send(midiEvents[cursor.next].midiMessage);
+			if (!result && firstError.Ok())
+			{
+				firstError = result;
+			}
+		}
+		cursor.unflushed = true;
+		++cursor.next;
+	}
+	return firstError;
+}
@@ -0,0 +1,72 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "Clock.h"
+#include "MidiOutput.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// One note of a note list.
+// Text form: pitch[:velocity[:durationMs]], for example 60:90:2000
+struct Note {
+	uint8_t pitch;        // 7 bits, 0 to 127
+	uint8_t velocity;     // 7 bits, 0 to 127
+	uint32_t durationMs;
+};
+
+// Midi Message together with time when it should be sent.
+// Time is measured from start of playback.
+struct MidiEvent {
+	int64_t timeMicroseconds;
+	MidiMessage midiMessage;
+};
+
+// Parses note list, for example: "60:90:2000, 64 67:100"
+// Notes are separated by commas or whitespace.
+// Missing velocity and duration are taken from defaultNote.
+// Returns false, and prints reason, on bad input.
+bool ParseNoteList(
+	std::string_view text,
+	const Note& defaultNote,
+	std::vector<Note>& notes);
+
+// Converts notes, played one after another, into flat buffer of timed Midi Messages.
+std::vector<MidiEvent> CompileNotes(
+	uint8_t channel,
+	uint8_t instrument,
+	const std::vector<Note>& notes);
+
+// Sends every event at its time.
+// Events must be sorted by time.
+// Failed sends don't stop playback (rest of song still plays);
+// first failure is returned.
+MidiResult PlayEvents(
+	MidiOutput& midiOutput,
+	Clock& clock,
+	const MidiEvent* midiEvents,
+	size_t count);
+
+inline MidiResult PlayEvents(
+	MidiOutput& midiOutput,
+	Clock& clock,
+	const std::vector<MidiEvent>& midiEvents)
+{
+	return PlayEvents(midiOutput, clock, midiEvents.data(), midiEvents.size());
+}
+
+// Sends every event to every output, so all of them sound together
+// although devices have different latencies (MidiOutput::Latency()).
+// Slowest output gets events at their time; faster ones are held back
+// by difference. No queues or threads: one cursor per output walks
+// same events, and output with earliest next deadline sends next.
+// One output is same as single-output PlayEvents().
+MidiResult PlayEvents(
+	MidiOutput* const* midiOutputs,
+	size_t outputCount,
+	Clock& clock,
+	const MidiEvent* midiEvents,
+	size_t count);
@@ -0,0 +1,81 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Programs.h"
+
+ChannelPrograms::ChannelPrograms(MidiOutput& midiOutput)
+	: midiOutput(midiOutput)
+{
+}
+
+MidiResult ChannelPrograms::Select(uint8_t channel, ProgramSelection selection)
+{
+	channel &= 0x0F;
+	const uint16_t channelBit = static_cast<uint16_t>(1u << channel);
+	const bool known = (knownChannels & channelBit) != 0;
+	ProgramSelection& state = current[channel];
+
+	if (known && state == selection)
+	{
+		stats.skippedCount += 3;
+		return MidiResult();
+	}
+
+	// Until all messages went out, device may have half of new selection
+	knownChannels &= ~channelBit;
+
+	MidiResult result;
+	if (!known || state.bankMsb != selection.bankMsb)
+	{
+		result = CountSent(midiOutput.Send(MakeControlChangeMessage(channel, BankSelectMsbControl, selection.bankMsb)));
+	}
+	else
+	{
+		++stats.skippedCount;
+	}
+
+	if (result && (!known || state.bankLsb != selection.bankLsb))
+	{
+		result = CountSent(midiOutput.Send(MakeControlChangeMessage(channel, BankSelectLsbControl, selection.bankLsb)));
+	}
+	else if (result)
+	{
+		++stats.skippedCount;
+	}
+
+	// Always sent: either program changed, or bank changed and waits for it
+	if (result)
+	{
+		result = CountSent(SelectMidiInstrument(midiOutput, channel, selection.program));
+	}
+
+	if (result)
+	{
+		state = selection;
+		knownChannels |= channelBit;
+	}
+	return result;
+}
+
+MidiResult ChannelPrograms::Configure(const ProgramSelection (&selections)[16], uint16_t channelMask)
+{
+	MidiResult result;
+	for (uint8_t channel = 0; channel < 16 && result; ++channel)
+	{
+		if (channelMask & (1u << channel))
+		{
+			result = Select(channel, selections[channel]);
+		}
+	}
+	midiOutput.Flush();
+	return result;
+}
+
+MidiResult ChannelPrograms::CountSent(MidiResult result)
+{
+	if (result)
+	{
+		++stats.sentCount;
+	}
+	return result;
+}
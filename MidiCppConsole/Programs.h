@@ -0,0 +1,62 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiOutput.h"
+
+#include <cstdint>
+
+// Instrument selection beyond 128 General Midi sounds.
+//
+// Program Change alone picks one of 128 instruments. Synthesizers keep
+// more sounds in banks, picked by Bank Select before Program Change:
+//     Control Change 0  : Bank Select MSB (upper 7 bits of bank)
+//     Control Change 32 : Bank Select LSB (lower 7 bits of bank)
+//     Program Change    : Instrument within bank
+// Bank Select only takes effect at next Program Change,
+// so Program Change is sent after every bank change, even if same program.
+
+struct ProgramSelection {
+	uint8_t bankMsb{ 0 };  // 7 bits, Control Change 0
+	uint8_t bankLsb{ 0 };  // 7 bits, Control Change 32
+	uint8_t program{ 0 };  // 7 bits, 0 to 127
+
+	bool operator==(const ProgramSelection&) const = default;
+};
+
+struct ProgramStats {
+	uint64_t sentCount{ 0 };     // Midi Messages sent
+	uint64_t skippedCount{ 0 };  // Midi Messages not sent: channel already had that value
+};
+
+// Remembers bank and program of every channel, sends only what changes.
+// Until channel's selection is sent once, its state on device is unknown,
+// and all three messages are sent.
+class ChannelPrograms {
+public:
+	explicit ChannelPrograms(MidiOutput& midiOutput);
+
+	ChannelPrograms(const ChannelPrograms&) = delete;
+	ChannelPrograms& operator=(const ChannelPrograms&) = delete;
+
+	MidiResult Select(uint8_t channel, ProgramSelection selection);
+
+	// Startup configuration: selects channels whose bit is set in channelMask
+	// (bit 0 is channel 0), then flushes output once.
+	// Stops at first error.
+	MidiResult Configure(const ProgramSelection (&selections)[16], uint16_t channelMask = 0xFFFF);
+
+	// Device state is unknown again, for example after device was reconnected
+	void Forget() { knownChannels = 0; }
+
+	const ProgramStats& Stats() const { return stats; }
+
+private:
+	MidiResult CountSent(MidiResult result);
+
+	MidiOutput& midiOutput;
+	ProgramSelection current[16];
+	uint16_t knownChannels{ 0 };  // Bit per channel: current[] matches device
+	ProgramStats stats;
+};
@@ -0,0 +1,391 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Score.h"
+
+#include "Parse.h"
+
+#include <cstdio>
+#include <optional>
+
+namespace {
+
+	const size_t MaxChordNotes = 16;
+
+	// Single pass over score text.
+	// No tokens or syntax tree are built: every note goes
+	// straight into event buffer as soon as it's read.
+	class ScoreCompiler {
+	public:
+		ScoreCompiler(std::string_view text, const ScoreDefaults& defaults, std::vector<MidiEvent>& midiEvents)
+			: position(text.data()),
+			end(text.data() + text.size()),
+			lineStart(text.data()),
+			channel(defaults.channel),
+			velocity(defaults.velocity),
+			tempo(defaults.tempo),
+			midiEvents(midiEvents)
+		{
+			// Roughly one note per 3 characters, 2 events per note
+			midiEvents.reserve(midiEvents.size() + text.size() / 2 + 1);
+			midiEvents.push_back({ 0, MakeInstrumentMessage(channel, defaults.instrument) });
+		}
+
+		bool Compile()
+		{
+			while (SkipSpaceAndComments())
+			{
+				char c = *position;
+				bool ok = false;
+				if (c == '[')
+				{
+					ok = Chord();
+				}
+				else if (c == 'r')
+				{
+					++position;
+					ok = Rest();
+				}
+				else if ((c >= 'A' && c <= 'G') || IsDigit(c))
+				{
+					ok = SingleNote();
+				}
+				else if (c >= 'a' && c <= 'z')
+				{
+					ok = Command();
+				}
+				else
+				{
+					ok = Fail("unexpected character");
+				}
+				if (!ok)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+	private:
+		static bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+		bool Fail(const char* message)
+		{
+			fprintf(stderr, "Score line %u, column %u: %s\n",
+				line, static_cast<unsigned>(position - lineStart) + 1, message);
+			return false;
+		}
+
+		// Returns false at end of text
+		bool SkipSpaceAndComments()
+		{
+			while (position < end)
+			{
+				char c = *position;
+				if (c == '\n')
+				{
+					++line;
+					lineStart = ++position;
+				}
+				else if (c == ' ' || c == '\t' || c == '\r' || c == ',' || c == '|')
+				{
+					// Commas and bar lines are only for readability
+					++position;
+				}
+				else if (c == '#')
+				{
+					while (position < end && *position != '\n')
+					{
+						++position;
+					}
+				}
+				else
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool Number(uint32_t maxValue, uint32_t& value)
+		{
+			if (position == end || !IsDigit(*position))
+			{
+				return Fail("number expected");
+			}
+			uint32_t result = 0;
+			while (position < end && IsDigit(*position))
+			{
+				result = result * 10 + static_cast<uint32_t>(*position - '0');
+				if (result > maxValue)
+				{
+					return Fail("number too big");
+				}
+				++position;
+			}
+			value = result;
+			return true;
+		}
+
+		// Instrument number, or General Midi name like acoustic-guitar-nylon
+		bool Program(uint32_t& value)
+		{
+			if (position == end || IsDigit(*position))
+			{
+				return Number(127, value);
+			}
+			const char* nameStart = position;
+			while (position < end && std::string_view(" \t\r\n,|#").find(*position) == std::string_view::npos)
+			{
+				++position;
+			}
+			std::optional<uint8_t> program = GeneralMidi::FindInstrument(
+				std::string_view(nameStart, static_cast<size_t>(position - nameStart)));
+			if (!program)
+			{
+				position = nameStart;
+				return Fail("unknown instrument");
+			}
+			value = *program;
+			return true;
+		}
+
+		// C4, D#4, Eb-1, or Midi pitch number
+		bool Pitch(uint8_t& pitch)
+		{
+			uint32_t value = 0;
+			if (IsDigit(*position))
+			{
+				if (!Number(127, value))
+				{
+					return false;
+				}
+				pitch = static_cast<uint8_t>(value);
+				return true;
+			}
+
+			NoteName note = ParseNoteName(std::string_view(position, static_cast<size_t>(end - position)));
+			position += note.length;
+			if (note.error != nullptr)
+			{
+				return Fail(note.error);
+			}
+			pitch = note.pitch;
+			return true;
+		}
+
+		// Optional "/N" and ".", sticky for following notes
+		bool Duration()
+		{
+			if (position < end && *position == '/')
+			{
+				++position;
+				uint32_t division = 0;
+				if (!Number(64, division))
+				{
+					return false;
+				}
+				if (division == 0 || (division & (division - 1)) != 0)
+				{
+					return Fail("duration must be 1, 2, 4, 8, 16, 32 or 64");
+				}
+				noteDivision = division;
+				dotted = position < end && *position == '.';
+				if (dotted)
+				{
+					++position;
+				}
+			}
+			return true;
+		}
+
+		int64_t DurationMicroseconds() const
+		{
+			// Whole note is 4 quarter notes, tempo is quarter notes per minute
+			int64_t microseconds = 4ll * 60 * 1000000 / (static_cast<int64_t>(tempo) * noteDivision);
+			return dotted ? microseconds * 3 / 2 : microseconds;
+		}
+
+		// Optional "!V", velocity for one note
+		bool NoteVelocity(uint8_t& noteVelocity)
+		{
+			noteVelocity = velocity;
+			if (position < end && *position == '!')
+			{
+				++position;
+				uint32_t value = 0;
+				if (!Number(127, value))
+				{
+					return false;
+				}
+				if (value == 0)
+				{
+					return Fail("velocity 0 would stop the note");
+				}
+				noteVelocity = static_cast<uint8_t>(value);
+			}
+			return true;
+		}
+
+		bool SingleNote()
+		{
+			uint8_t pitch = 0;
+			uint8_t noteVelocity = 0;
+			if (!Pitch(pitch) || !Duration() || !NoteVelocity(noteVelocity))
+			{
+				return false;
+			}
+			EmitNotes(&pitch, &noteVelocity, 1);
+			return true;
+		}
+
+		bool Chord()
+		{
+			++position; // [
+			uint8_t pitches[MaxChordNotes];
+			uint8_t velocities[MaxChordNotes];
+			size_t count = 0;
+			while (true)
+			{
+				if (!SkipSpaceAndComments())
+				{
+					return Fail("chord not closed with ]");
+				}
+				if (*position == ']')
+				{
+					++position;
+					break;
+				}
+				if (count == MaxChordNotes)
+				{
+					return Fail("too many notes in chord");
+				}
+				if (!((*position >= 'A' && *position <= 'G') || IsDigit(*position)))
+				{
+					return Fail("note expected in chord");
+				}
+				if (!Pitch(pitches[count]) || !NoteVelocity(velocities[count]))
+				{
+					return false;
+				}
+				++count;
+			}
+			if (!Duration())
+			{
+				return false;
+			}
+			EmitNotes(pitches, velocities, count);
+			return true;
+		}
+
+		bool Rest()
+		{
+			if (!Duration())
+			{
+				return false;
+			}
+			time += DurationMicroseconds();
+			return true;
+		}
+
+		// tempo, program, channel, velocity
+		bool Command()
+		{
+			const char* wordStart = position;
+			while (position < end && *position >= 'a' && *position <= 'z')
+			{
+				++position;
+			}
+			std::string_view word(wordStart, static_cast<size_t>(position - wordStart));
+
+			SkipSpaceAndComments();
+			uint32_t value = 0;
+			if (word == "tempo")
+			{
+				if (!Number(1000, value))
+				{
+					return false;
+				}
+				if (value == 0)
+				{
+					return Fail("tempo must be at least 1");
+				}
+				tempo = value;
+			}
+			else if (word == "program")
+			{
+				if (!Program(value))
+				{
+					return false;
+				}
+				midiEvents.push_back({ time, MakeInstrumentMessage(channel, static_cast<uint8_t>(value)) });
+			}
+			else if (word == "channel")
+			{
+				if (!Number(15, value))
+				{
+					return false;
+				}
+				channel = static_cast<uint8_t>(value);
+			}
+			else if (word == "velocity")
+			{
+				if (!Number(127, value))
+				{
+					return false;
+				}
+				if (value == 0)
+				{
+					return Fail("velocity 0 would stop the notes");
+				}
+				velocity = static_cast<uint8_t>(value);
+			}
+			else
+			{
+				position = wordStart;
+				return Fail("unknown command");
+			}
+			return true;
+		}
+
+		// Notes start together now, and stop together after current duration.
+		// Notes are sequential, so events come out already sorted by time.
+		void EmitNotes(const uint8_t* pitches, const uint8_t* velocities, size_t count)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				midiEvents.push_back({ time, MakeNoteMessage(channel, pitches[i], velocities[i]) });
+			}
+			time += DurationMicroseconds();
+			for (size_t i = 0; i < count; ++i)
+			{
+				// Note Off: same note with velocity 0
+				midiEvents.push_back({ time, MakeNoteMessage(channel, pitches[i], 0) });
+			}
+		}
+
+		const char* position;
+		const char* end;
+		const char* lineStart;
+		unsigned line{ 1 };
+
+		uint8_t channel;
+		uint8_t velocity;
+		uint32_t tempo;
+		uint32_t noteDivision{ 4 }; // Quarter note
+		bool dotted{ false };
+		int64_t time{ 0 };
+
+		std::vector<MidiEvent>& midiEvents;
+	};
+
+}
+
+bool CompileScore(
+	std::string_view text,
+	const ScoreDefaults& defaults,
+	std::vector<MidiEvent>& midiEvents)
+{
+	ScoreCompiler compiler(text, defaults, midiEvents);
+	return compiler.Compile();
+}
@@ -0,0 +1,49 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "GeneralMidi.h"
+#include "Player.h"
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Compact text notation for melodies, compiled once into
+// flat buffer of timed Midi Messages, which PlayEvents() simply iterates.
+//
+// Example, "Twinkle Twinkle Little Star":
+//   tempo 100 program 0
+//   C4/4 C4 G4 G4 A4 A4 G4/2
+//   F4/4 F4 E4 E4 D4 D4 C4/2
+//
+// Syntax:
+//   C4 D#4 Eb3 60     Note: letter, optional # or b, octave (C4 is Middle C, 60),
+//                     or Midi pitch number
+//   C4/8  C4/4.       Duration: 1 whole, 2 half, 4 quarter, 8 eighth, ... up to 64.
+//                     Trailing dot makes it 1.5 times longer.
+//                     Duration sticks: following notes reuse it.
+//   C4!100            Velocity for this note only, 1 to 127
+//   [C4 E4 G4]/2      Chord: notes start and stop together
+//   r/4  r            Rest
+//   tempo 120         Quarter notes per minute
+//   program 24        Select Midi Instrument, 0 to 127,
+//   program violin    or General Midi name: case and punctuation ignored,
+//                     so "Acoustic Guitar (nylon)" is acoustic-guitar-nylon
+//   channel 9         Midi channel, 0 to 15
+//   velocity 90       Default velocity, 1 to 127
+//   # comment         Until end of line
+struct ScoreDefaults {
+	uint8_t channel{ 0 };
+	uint8_t instrument{ GeneralMidi::Instrument("Acoustic Guitar (nylon)") };
+	uint8_t velocity{ 90 };
+	uint32_t tempo{ 120 };
+};
+
+// Appends compiled events to midiEvents, sorted by time.
+// Returns false, and prints line and column, on bad score.
+bool CompileScore(
+	std::string_view text,
+	const ScoreDefaults& defaults,
+	std::vector<MidiEvent>& midiEvents);
@@ -0,0 +1,153 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Sequencer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <new>
+
+namespace {
+
+	// Frames are rounded up to 64 bytes; 16 size classes cover frames up to 1 KB.
+	// Larger frames (voices with big local arrays) use general heap.
+	const size_t FrameGranularity = 64;
+	const size_t FrameClassCount = 16;
+	const size_t ChunkSize = 64 * 1024;
+
+	struct FreeFrame {
+		FreeFrame* next;
+	};
+
+	struct FramePoolState {
+		FreeFrame* freeFrames[FrameClassCount]{};
+		std::vector<std::unique_ptr<std::byte[]>> chunks;
+		std::byte* chunkNext{ nullptr };
+		size_t chunkLeft{ 0 };
+	};
+
+	thread_local FramePoolState framePool;
+
+	size_t FrameClass(size_t size)
+	{
+		return (size + FrameGranularity - 1) / FrameGranularity - 1;
+	}
+
+	// Wakeup heap: std::push_heap keeps largest on top, so compare reversed
+	struct LaterWakeup {
+		template <typename Wakeup>
+		bool operator()(const Wakeup& a, const Wakeup& b) const
+		{
+			return a.timeMicroseconds != b.timeMicroseconds
+				? a.timeMicroseconds > b.timeMicroseconds
+				: a.order > b.order;
+		}
+	};
+
+}
+
+void* FramePool::Allocate(size_t size)
+{
+	size_t frameClass = FrameClass(size);
+	if (frameClass >= FrameClassCount)
+	{
+		return ::operator new(size);
+	}
+
+	FramePoolState& pool = framePool;
+	if (FreeFrame* frame = pool.freeFrames[frameClass])
+	{
+		pool.freeFrames[frameClass] = frame->next;
+		return frame;
+	}
+
+	// Carve new frame from current chunk
+	size_t frameSize = (frameClass + 1) * FrameGranularity;
+	if (pool.chunkLeft < frameSize)
+	{
+		pool.chunks.push_back(std::make_unique<std::byte[]>(ChunkSize));
+		pool.chunkNext = pool.chunks.back().get();
+		pool.chunkLeft = ChunkSize;
+	}
+	void* frame = pool.chunkNext;
+	pool.chunkNext += frameSize;
+	pool.chunkLeft -= frameSize;
+	return frame;
+}
+
+void FramePool::Free(void* frame, size_t size)
+{
+	size_t frameClass = FrameClass(size);
+	if (frameClass >= FrameClassCount)
+	{
+		::operator delete(frame);
+		return;
+	}
+
+	FramePoolState& pool = framePool;
+	FreeFrame* freeFrame = static_cast<FreeFrame*>(frame);
+	freeFrame->next = pool.freeFrames[frameClass];
+	pool.freeFrames[frameClass] = freeFrame;
+}
+
+void DelayAwaiter::await_suspend(std::coroutine_handle<SequencerTask::promise_type> handle) const
+{
+	SequencerTask::promise_type& promise = handle.promise();
+	promise.beat += beats > 0 ? beats : 0;
+	promise.sequencer->Schedule(handle);
+}
+
+Sequencer::Sequencer(MidiOutput& midiOutput, Clock& clock, uint32_t tempo)
+	: midiOutput(midiOutput), clock(clock), microsecondsPerBeat(60e6 / (tempo > 0 ? tempo : 120))
+{
+}
+
+Sequencer::~Sequencer()
+{
+	// Voices still waiting never finish
+	for (const Wakeup& wakeup : wakeups)
+	{
+		wakeup.handle.destroy();
+	}
+}
+
+void Sequencer::Spawn(SequencerTask task)
+{
+	std::coroutine_handle<SequencerTask::promise_type> handle = task.handle;
+	task.handle = nullptr;
+
+	handle.promise().sequencer = this;
+	handle.promise().beat = currentBeat;
+	Schedule(handle);
+}
+
+void Sequencer::Schedule(std::coroutine_handle<SequencerTask::promise_type> handle)
+{
+	int64_t timeMicroseconds = std::llround(handle.promise().beat * microsecondsPerBeat);
+	wakeups.push_back({ timeMicroseconds, scheduledCount++, handle });
+	std::push_heap(wakeups.begin(), wakeups.end(), LaterWakeup());
+}
+
+void Sequencer::Run()
+{
+	while (!wakeups.empty())
+	{
+		std::pop_heap(wakeups.begin(), wakeups.end(), LaterWakeup());
+		Wakeup wakeup = wakeups.back();
+		wakeups.pop_back();
+
+		clock.SleepUntil(std::chrono::microseconds(wakeup.timeMicroseconds));
+
+		// Voice runs until its next co_await Delay(), or until it ends
+		currentBeat = wakeup.handle.promise().beat;
+		++resumeCount;
+		wakeup.handle.resume();
+
+		// Messages of voices waking at same time go out together
+		if (wakeups.empty() || wakeups.front().timeMicroseconds != wakeup.timeMicroseconds)
+		{
+			midiOutput.Flush();
+		}
+	}
+}
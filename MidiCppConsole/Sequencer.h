@@ -0,0 +1,144 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "Clock.h"
+#include "MidiOutput.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <vector>
+
+// Coroutine sequencing: every voice is a plain function that reads top to bottom,
+//
+//     SequencerTask Bass(Sequencer& sequencer)
+//     {
+//         for (int i = 0; i < 16; ++i)
+//         {
+//             (void)SendMidiNote(sequencer.Output(), 1, 36, 100);
+//             co_await Delay(0.5);
+//             (void)SendMidiNote(sequencer.Output(), 1, 36, 0);
+//             co_await Delay(0.5);
+//         }
+//     }
+//
+// but instead of blocking a thread, co_await Delay() parks the voice in
+// Sequencer's wakeup queue. One thread runs thousands of voices:
+// it sleeps until earliest wakeup, resumes that voice, repeats.
+//
+// Voice time is counted in beats from start, not from when it woke up,
+// so voices never drift apart however late a wakeup was.
+
+class Sequencer;
+
+// Allocates coroutine frames. Frames of same size class are recycled,
+// so starting voice after voice doesn't go to general heap.
+// One pool per thread: voices are created and destroyed on sequencer thread.
+class FramePool {
+public:
+	static void* Allocate(size_t size);
+	static void Free(void* frame, size_t size);
+};
+
+// Coroutine returned by voice function. Hand it to Sequencer::Spawn().
+class SequencerTask {
+public:
+	struct promise_type {
+		Sequencer* sequencer{ nullptr };
+		double beat{ 0 };  // Voice time
+
+		SequencerTask get_return_object() { return SequencerTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+		// Voice starts when Sequencer runs it, not when it's created
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		// Finished voice frees its frame right away
+		std::suspend_never final_suspend() noexcept { return {}; }
+
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+
+		static void* operator new(size_t size) { return FramePool::Allocate(size); }
+		static void operator delete(void* frame, size_t size) { FramePool::Free(frame, size); }
+	};
+
+	SequencerTask(SequencerTask&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+	SequencerTask(const SequencerTask&) = delete;
+	SequencerTask& operator=(const SequencerTask&) = delete;
+
+	// Voice that was never spawned is destroyed with its task
+	~SequencerTask()
+	{
+		if (handle)
+		{
+			handle.destroy();
+		}
+	}
+
+private:
+	explicit SequencerTask(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+	std::coroutine_handle<promise_type> handle;
+
+	friend class Sequencer;
+};
+
+// co_await Delay(beats): voice continues beats later
+struct DelayAwaiter {
+	double beats;
+
+	bool await_ready() const noexcept { return false; }
+	void await_suspend(std::coroutine_handle<SequencerTask::promise_type> handle) const;
+	void await_resume() const noexcept {}
+};
+
+inline DelayAwaiter Delay(double beats)
+{
+	return DelayAwaiter{ beats };
+}
+
+class Sequencer {
+public:
+	Sequencer(MidiOutput& midiOutput, Clock& clock, uint32_t tempo = 120);
+	~Sequencer();
+
+	Sequencer(const Sequencer&) = delete;
+	Sequencer& operator=(const Sequencer&) = delete;
+
+	// Voice starts at beat 0, or at current beat when spawned by running voice
+	void Spawn(SequencerTask task);
+
+	// Runs voices until all of them finished
+	void Run();
+
+	MidiOutput& Output() { return midiOutput; }
+
+	// Beat of voice that is running now
+	double Beat() const { return currentBeat; }
+
+	size_t ResumeCount() const { return resumeCount; }
+
+private:
+	struct Wakeup {
+		int64_t timeMicroseconds;
+		uint64_t order;  // Same time: first scheduled runs first
+		std::coroutine_handle<SequencerTask::promise_type> handle;
+	};
+
+	void Schedule(std::coroutine_handle<SequencerTask::promise_type> handle);
+
+	MidiOutput& midiOutput;
+	Clock& clock;
+	double microsecondsPerBeat;
+	double currentBeat{ 0 };
+	uint64_t scheduledCount{ 0 };
+	size_t resumeCount{ 0 };
+
+	// Min-heap by time, then order
+	std::vector<Wakeup> wakeups;
+
+	friend struct DelayAwaiter;
+};
@@ -0,0 +1,197 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Smf.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	uint32_t ReadBigEndian(const uint8_t* bytes, int size)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < size; ++i)
+		{
+			value = (value << 8) | bytes[i];
+		}
+		return value;
+	}
+
+}
+
+bool ParseSmf(const uint8_t* data, size_t size, SmfFile& smf, const char*& error)
+{
+	smf.tracks.clear();
+	if (size < 14 || memcmp(data, "MThd", 4) != 0)
+	{
+		error = "not a Standard Midi File (no MThd)";
+		return false;
+	}
+	uint32_t headerSize = ReadBigEndian(data + 4, 4);
+	if (headerSize < 6 || headerSize > size - 8)
+	{
+		error = "bad MThd length";
+		return false;
+	}
+	smf.header.format = static_cast<uint16_t>(ReadBigEndian(data + 8, 2));
+	smf.header.trackCount = static_cast<uint16_t>(ReadBigEndian(data + 10, 2));
+	smf.header.division = static_cast<uint16_t>(ReadBigEndian(data + 12, 2));
+	if (smf.header.format > 2)
+	{
+		error = "unknown format";
+		return false;
+	}
+	if (smf.header.division == 0)
+	{
+		error = "division is 0";
+		return false;
+	}
+
+	// Chunks follow each other; anything shorter than chunk header at the end is padding
+	size_t offset = 8 + static_cast<size_t>(headerSize);
+	while (size - offset >= 8)
+	{
+		uint32_t chunkSize = ReadBigEndian(data + offset + 4, 4);
+		if (chunkSize > size - offset - 8)
+		{
+			error = "chunk runs past end of file";
+			return false;
+		}
+		if (memcmp(data + offset, "MTrk", 4) == 0)
+		{
+			// Only pass that checks track bytes: every later walk trusts them
+			SmfChunk track{ data + offset + 8, chunkSize };
+			SmfCheckedTrackReader reader(track);
+			SmfEvent event;
+			while (reader.Next(event))
+			{
+			}
+			if (reader.Error() != nullptr)
+			{
+				error = reader.Error();
+				return false;
+			}
+			track.size = static_cast<size_t>(reader.End() - track.data);
+			smf.tracks.push_back(track);
+		}
+		offset += 8 + static_cast<size_t>(chunkSize);
+	}
+
+	// Track count in MThd is often wrong in files found in the wild:
+	// tracks actually there win
+	smf.header.trackCount = static_cast<uint16_t>(std::min<size_t>(smf.tracks.size(), UINT16_MAX));
+	smf.tracks.resize(smf.header.trackCount);
+	return true;
+}
+
+void SmfWriter::WriteHeader(const SmfHeader& header)
+{
+	PutBytes(reinterpret_cast<const uint8_t*>("MThd"), 4);
+	PutBigEndian(6, 4);
+	PutBigEndian(header.format, 2);
+	PutBigEndian(header.trackCount, 2);
+	PutBigEndian(header.division, 2);
+}
+
+void SmfWriter::BeginTrack(uint32_t trackSize)
+{
+	PutBytes(reinterpret_cast<const uint8_t*>("MTrk"), 4);
+	PutBigEndian(trackSize, 4);
+	trackTick = 0;
+	runningStatus = 0;
+}
+
+void SmfWriter::WriteEvent(uint64_t tick, const SmfEvent& event)
+{
+	PutVlq(tick - trackTick);
+	trackTick = tick;
+
+	if (event.IsChannelMessage())
+	{
+		if (event.status != runningStatus)
+		{
+			Put(event.status);
+			runningStatus = event.status;
+		}
+		PutBytes(event.data, event.size);
+		return;
+	}
+
+	Put(event.status);
+	if (event.IsMeta())
+	{
+		Put(event.metaType);
+	}
+	PutVlq(event.size);
+	PutBytes(event.data, event.size);
+	runningStatus = 0;
+}
+
+void SmfWriter::EndTrack(uint64_t tick)
+{
+	PutVlq(tick - trackTick);
+	trackTick = tick;
+	const uint8_t endOfTrack[] = { SmfMetaEvent, SmfMetaEndOfTrack, 0 };
+	PutBytes(endOfTrack, sizeof(endOfTrack));
+	runningStatus = 0;
+}
+
+bool SmfWriter::Flush()
+{
+	if (used > 0)
+	{
+		if (file != nullptr)
+		{
+			failed = fwrite(buffer, 1, used, file) != used || failed;
+		}
+		else if (memory != nullptr)
+		{
+			memory->append(reinterpret_cast<const char*>(buffer), used);
+		}
+		used = 0;
+	}
+	return !failed;
+}
+
+void SmfWriter::PutBytes(const uint8_t* bytes, size_t count)
+{
+	while (count > 0)
+	{
+		if (used == sizeof(buffer))
+		{
+			Flush();
+		}
+		size_t chunk = std::min(count, sizeof(buffer) - used);
+		memcpy(buffer + used, bytes, chunk);
+		used += chunk;
+		byteCount += chunk;
+		bytes += chunk;
+		count -= chunk;
+	}
+}
+
+void SmfWriter::PutVlq(uint64_t value)
+{
+	// Groups of 7 bits, most significant first
+	uint8_t bytes[10];
+	int count = 0;
+	do
+	{
+		bytes[count++] = static_cast<uint8_t>(value & 0x7F);
+		value >>= 7;
+	} while (value != 0);
+	while (count > 1)
+	{
+		Put(bytes[--count] | 0x80);
+	}
+	Put(bytes[0]);
+}
+
+void SmfWriter::PutBigEndian(uint32_t value, int size)
+{
+	for (int i = size - 1; i >= 0; --i)
+	{
+		Put(static_cast<uint8_t>(value >> (i * 8)));
+	}
+}
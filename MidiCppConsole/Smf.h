@@ -0,0 +1,290 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Standard Midi File (.mid), reading and writing.
+//
+// File is chunks: "MThd" header, then one "MTrk" chunk per track.
+// Every chunk is 4-byte type and 4-byte big-endian length.
+//
+// MThd: format (0: one track, 1: tracks play together),
+// track count, and division: ticks per quarter note (PPQN).
+//
+// MTrk: events, each one after delta time in ticks,
+// written as variable-length quantity (VLQ): 7 bits per byte,
+// most significant first, top bit set on all bytes but last.
+//     0x00       : 0
+//     0x81 0x00  : 128
+// Events:
+//     Midi Message  : Status byte, then data bytes. Status can be left out
+//                     when it's same as previous one (running status)
+//     System Excl.  : 0xF0 or 0xF7, VLQ length, bytes
+//     Meta event    : 0xFF, type, VLQ length, bytes
+//                     (tempo, track name, End of Track 0x2F ...)
+//
+// Reading is zero-copy: events point into file's bytes,
+// nothing is decoded until it's asked for.
+
+const uint8_t SmfMetaEvent = 0xFF;
+const uint8_t SmfMetaEndOfTrack = 0x2F;
+
+struct SmfHeader {
+	uint16_t format{ 0 };
+	uint16_t trackCount{ 0 };
+	uint16_t division{ 0 };   // Ticks per quarter note; top bit set means SMPTE time
+
+	bool IsSmpte() const { return (division & 0x8000) != 0; }
+};
+
+// Bytes of one chunk, inside file's bytes
+struct SmfChunk {
+	const uint8_t* data;
+	size_t size;
+};
+
+struct SmfFile {
+	SmfHeader header;
+	std::vector<SmfChunk> tracks;
+};
+
+// Longest delta time variable-length quantity can hold: 4 bytes of 7 bits
+const uint32_t SmfMaxDelta = 0x0FFFFFFF;
+
+// Parses chunk structure, and validates every track once:
+// bounds, lengths, running status, data bytes. Tracks are cut
+// after End of Track. Later walks (SmfTrackReader) trust result.
+// Unknown chunk types are skipped, as standard asks.
+// Returns false, and sets error to reason, on bad file.
+bool ParseSmf(const uint8_t* data, size_t size, SmfFile& smf, const char*& error);
+
+// One event of a track
+struct SmfEvent {
+	uint64_t tick;          // Absolute: from start of track
+	uint8_t status;         // Midi Status byte, 0xF0/0xF7 System Exclusive, or 0xFF meta event
+	uint8_t metaType;       // Meta events only
+	const uint8_t* data;    // Data bytes (after Status byte, length and meta type)
+	uint32_t size;
+
+	bool IsMeta() const { return status == SmfMetaEvent; }
+	bool IsChannelMessage() const { return status < 0xF0; }
+	uint8_t Channel() const { return status & 0x0F; }
+};
+
+// Data bytes after Midi Status byte, by upper 4 bits 0x8 to 0xE.
+// Same as MidiMessageLength() - 1, without branches.
+constexpr uint8_t SmfDataLengths[8] = {
+	2, // Note Off
+	2, // Note On
+	2, // Aftertouch
+	2, // Control Change
+	1, // Select Midi Instrument
+	1, // Channel Pressure
+	2, // Pitch Bend
+	0, // System (not read through this table)
+};
+
+// Walks events of one track.
+//
+// Checked reader tests every byte against end of track and rejects
+// bad events: that's what ParseSmf() runs, once per track.
+// Unchecked reader, for every later walk, tests only for end of track:
+// inner loop has no bounds checks, so track must come from ParseSmf().
+// Untrusted bytes never reach it.
+template <bool Checked>
+class BasicSmfTrackReader {
+public:
+	explicit BasicSmfTrackReader(SmfChunk track)
+		: position(track.data), end(track.data + track.size) {}
+
+	// Returns false at end of track, or on bad event (then Error() is set)
+	bool Next(SmfEvent& event)
+	{
+		if (position == end)
+		{
+			return false;
+		}
+
+		uint32_t delta = 0;
+		if (!ReadVlq(delta))
+		{
+			return Fail("bad delta time");
+		}
+		tick += delta;
+		if (Checked && position == end)
+		{
+			return Fail("delta time without event");
+		}
+		event.tick = tick;
+		event.metaType = 0;
+
+		// Running status: data byte first, Status byte is previous one
+		uint8_t status = *position;
+		if (status & 0x80)
+		{
+			++position;
+		}
+		else
+		{
+			if (Checked && runningStatus == 0)
+			{
+				return Fail("data byte without Status byte");
+			}
+			status = runningStatus;
+		}
+		event.status = status;
+
+		if (status < 0xF0)
+		{
+			runningStatus = status;
+			uint32_t length = SmfDataLengths[(status >> 4) & 0x7];
+			if constexpr (Checked)
+			{
+				if (static_cast<size_t>(end - position) < length)
+				{
+					return Fail("truncated Midi Message");
+				}
+				if (((position[0] | position[length - 1]) & 0x80) != 0)
+				{
+					return Fail("Status byte inside Midi Message");
+				}
+			}
+			event.data = position;
+			event.size = length;
+			position += length;
+			return true;
+		}
+
+		// System Exclusive and meta events cancel running status
+		runningStatus = 0;
+		if (status == SmfMetaEvent)
+		{
+			if (Checked && position == end)
+			{
+				return Fail("truncated meta event");
+			}
+			event.metaType = *position++;
+		}
+		else if (Checked && status != 0xF0 && status != 0xF7)
+		{
+			return Fail("System message in track");
+		}
+
+		uint32_t length = 0;
+		if (!ReadVlq(length) || (Checked && static_cast<size_t>(end - position) < length))
+		{
+			return Fail("truncated event");
+		}
+		event.data = position;
+		event.size = length;
+		position += length;
+
+		if (Checked && status == SmfMetaEvent && event.metaType == SmfMetaEndOfTrack)
+		{
+			// Anything after End of Track isn't part of track
+			end = position;
+		}
+		return true;
+	}
+
+	const char* Error() const { return error; }
+
+	// Where reading stopped: after End of Track, once it was read
+	const uint8_t* End() const { return end; }
+
+private:
+	// SMF allows at most 4 bytes: 28 bits
+	bool ReadVlq(uint32_t& value)
+	{
+		value = 0;
+		for (int i = 0; i < 4; ++i)
+		{
+			if (Checked && position == end)
+			{
+				return false;
+			}
+			uint8_t byte = *position++;
+			value = (value << 7) | (byte & 0x7F);
+			if ((byte & 0x80) == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool Fail(const char* reason)
+	{
+		error = reason;
+		return false;
+	}
+
+	const uint8_t* position;
+	const uint8_t* end;
+	uint64_t tick{ 0 };
+	uint8_t runningStatus{ 0 };
+	const char* error{ nullptr };
+};
+
+using SmfCheckedTrackReader = BasicSmfTrackReader<true>;
+using SmfTrackReader = BasicSmfTrackReader<false>;
+
+// Writes Standard Midi File as it goes: nothing is kept but small buffer.
+// Track length goes before track's events, so caller measures track first
+// (same events through a writer without output, see ByteCount()).
+// Midi Messages are written with running status.
+class SmfWriter {
+public:
+	// No output: only counts bytes
+	SmfWriter() = default;
+	explicit SmfWriter(FILE* file) : file(file) {}
+	explicit SmfWriter(std::string& memory) : memory(&memory) {}
+	~SmfWriter() { Flush(); }
+
+	SmfWriter(const SmfWriter&) = delete;
+	SmfWriter& operator=(const SmfWriter&) = delete;
+
+	void WriteHeader(const SmfHeader& header);
+
+	// trackSize: bytes of events, End of Track included
+	void BeginTrack(uint32_t trackSize);
+
+	// Events must come in tick order
+	void WriteEvent(uint64_t tick, const SmfEvent& event);
+
+	void EndTrack(uint64_t tick);
+
+	// Bytes written so far, including ones still in buffer
+	uint64_t ByteCount() const { return byteCount; }
+
+	// Returns false if file write failed, at any point
+	bool Flush();
+
+private:
+	void Put(uint8_t byte)
+	{
+		if (used == sizeof(buffer))
+		{
+			Flush();
+		}
+		buffer[used++] = byte;
+		++byteCount;
+	}
+	void PutBytes(const uint8_t* bytes, size_t count);
+	void PutVlq(uint64_t value);
+	void PutBigEndian(uint32_t value, int size);
+
+	FILE* file{ nullptr };
+	std::string* memory{ nullptr };
+	uint8_t buffer[16 * 1024];
+	size_t used{ 0 };
+	uint64_t byteCount{ 0 };
+	uint64_t trackTick{ 0 };
+	uint8_t runningStatus{ 0 };
+	bool failed{ false };
+};
@@ -0,0 +1,111 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Trace.h"
+
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+bool traceEnabled = false;
+
+namespace {
+
+	size_t traceEventsPerThread = 0;
+	int64_t traceStart = 0;
+
+	// All buffers ever registered. Buffers outlive their threads,
+	// so events of finished threads still get written.
+	std::mutex traceBuffersMutex;
+	std::vector<std::unique_ptr<TraceBuffer>> traceBuffers;
+
+}
+
+TraceBuffer* RegisterTraceThread()
+{
+	// make_unique zeroes events, which also faults in all pages now,
+	// instead of one by one while recording
+	auto buffer = std::make_unique<TraceBuffer>();
+	buffer->events = std::make_unique<TraceEvent[]>(traceEventsPerThread);
+	buffer->capacity = traceEventsPerThread;
+
+	std::lock_guard<std::mutex> lock(traceBuffersMutex);
+	buffer->threadIndex = static_cast<uint32_t>(traceBuffers.size());
+	threadTraceBuffer = buffer.get();
+	traceBuffers.push_back(std::move(buffer));
+	return threadTraceBuffer;
+}
+
+void StartTrace(size_t eventsPerThread)
+{
+	traceEventsPerThread = eventsPerThread;
+	if (threadTraceBuffer == nullptr)
+	{
+		// Calling thread gets its buffer now, not in middle of timed work
+		RegisterTraceThread();
+	}
+	traceStart = TraceNow();
+	traceEnabled = true;
+}
+
+bool WriteTrace(const char* path)
+{
+	FILE* file = nullptr;
+	if (fopen_s(&file, path, "wb") != 0 || file == nullptr)
+	{
+		fprintf(stderr, "Can't open trace file: %s\n", path);
+		return false;
+	}
+
+	// Chrome trace format: timestamps and durations are microseconds
+	const unsigned processId = 1;
+	uint64_t droppedCount = 0;
+	bool first = true;
+	fputs("{\"traceEvents\":[\n", file);
+
+	std::lock_guard<std::mutex> lock(traceBuffersMutex);
+	for (const std::unique_ptr<TraceBuffer>& buffer : traceBuffers)
+	{
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			first ? "" : ",\n", processId, buffer->threadIndex, buffer->threadIndex);
+		first = false;
+
+		size_t count = buffer->count.load(std::memory_order_acquire);
+		for (size_t i = 0; i < count; ++i)
+		{
+			const TraceEvent& event = buffer->events[i];
+			double timestamp = static_cast<double>(event.timestamp - traceStart) / 1000.0;
+			switch (event.type)
+			{
+			case TraceEventType::Complete:
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%u,\"tid\":%u}",
+					event.name, timestamp, static_cast<double>(event.value) / 1000.0, processId, buffer->threadIndex);
+				break;
+			case TraceEventType::Counter:
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"value\":%lld}}",
+					event.name, timestamp, processId, buffer->threadIndex, static_cast<long long>(event.value));
+				break;
+			case TraceEventType::Instant:
+				fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%u,\"tid\":%u}",
+					event.name, timestamp, processId, buffer->threadIndex);
+				break;
+			}
+		}
+		droppedCount += buffer->droppedCount;
+	}
+
+	fputs("\n]}\n", file);
+	bool ok = ferror(file) == 0;
+	fclose(file);
+
+	if (!ok)
+	{
+		fprintf(stderr, "Can't write trace file: %s\n", path);
+	}
+	if (droppedCount > 0)
+	{
+		fprintf(stderr, "Trace buffers were full, %llu events dropped\n",
+			static_cast<unsigned long long>(droppedCount));
+	}
+	return ok;
+}
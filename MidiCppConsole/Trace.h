@@ -0,0 +1,125 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+// Timeline tracing: scheduler wakeups, send calls, queue depths
+// and backend latencies, written as Chrome trace JSON.
+// Open result in chrome://tracing or https://ui.perfetto.dev
+//
+// Every thread records into its own buffer, so recording takes no lock
+// and no atomic read-modify-write: one clock read and one small store.
+// When tracing is off, recording is a single predictable branch.
+// Buffers are written out by WriteTrace(), after work is done.
+
+enum class TraceEventType : uint8_t {
+	Complete,  // Span with duration, for example one send call
+	Counter,   // Value over time, for example queue depth
+	Instant,   // Single point in time
+};
+
+struct TraceEvent {
+	int64_t timestamp;   // Nanoseconds, steady clock
+	int64_t value;       // Duration (Complete), value (Counter), or unused
+	const char* name;    // Must be string literal, only pointer is stored
+	TraceEventType type;
+};
+
+// One thread's events. Only owner thread writes,
+// count is published with release so WriteTrace() sees finished events.
+struct TraceBuffer {
+	std::unique_ptr<TraceEvent[]> events;
+	size_t capacity{ 0 };
+	std::atomic<size_t> count{ 0 };
+	uint64_t droppedCount{ 0 };
+	uint32_t threadIndex{ 0 };
+};
+
+extern bool traceEnabled;
+inline thread_local TraceBuffer* threadTraceBuffer = nullptr;
+
+// Allocates buffer for calling thread.
+// Called on first event of a thread, or earlier by thread itself,
+// to keep allocation out of timed work.
+TraceBuffer* RegisterTraceThread();
+
+inline int64_t TraceNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void TraceRecord(TraceEventType type, const char* name, int64_t timestamp, int64_t value)
+{
+	TraceBuffer* buffer = threadTraceBuffer;
+	if (buffer == nullptr)
+	{
+		buffer = RegisterTraceThread();
+	}
+
+	size_t index = buffer->count.load(std::memory_order_relaxed);
+	if (index < buffer->capacity)
+	{
+		buffer->events[index] = TraceEvent{ timestamp, value, name, type };
+		buffer->count.store(index + 1, std::memory_order_release);
+	}
+	else
+	{
+		// Full: keep oldest events, they explain how trouble started
+		++buffer->droppedCount;
+	}
+}
+
+inline void TraceCounter(const char* name, int64_t value)
+{
+	if (traceEnabled)
+	{
+		TraceRecord(TraceEventType::Counter, name, TraceNow(), value);
+	}
+}
+
+inline void TraceInstant(const char* name)
+{
+	if (traceEnabled)
+	{
+		TraceRecord(TraceEventType::Instant, name, TraceNow(), 0);
+	}
+}
+
+// Records span from construction to destruction
+class TraceScope {
+public:
+	explicit TraceScope(const char* name)
+		: name(name), start(traceEnabled ? TraceNow() : 0)
+	{
+	}
+
+	~TraceScope()
+	{
+		if (traceEnabled)
+		{
+			TraceRecord(TraceEventType::Complete, name, start, TraceNow() - start);
+		}
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* name;
+	int64_t start;
+};
+
+// Turns tracing on, and registers calling thread.
+// eventsPerThread bounds memory: sizeof(TraceEvent), at most 32 bytes, per event.
+// Call before starting threads that should be traced.
+void StartTrace(size_t eventsPerThread = 1 << 20);
+
+// Writes all recorded events as Chrome trace JSON.
+// Returns false, and prints reason, if file can't be written.
+bool WriteTrace(const char* path);
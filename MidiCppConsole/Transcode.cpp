@@ -0,0 +1,409 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Transcode.h"
+
+#include "FileUtil.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+	// Events of several tracks, in tick order.
+	// On same tick, earlier track goes first.
+	// Tracks wait in binary heap, earliest head event on top:
+	// files with thousands of tracks cost log(tracks) per event, not tracks.
+	// Track that gave event usually stays near top, so it's put back
+	// with one sift down, instead of pop and push.
+	// Tracks come from ParseSmf(): walks can't fail.
+	class MergedTrackReader {
+	public:
+		MergedTrackReader(const SmfChunk* tracks, size_t trackCount)
+		{
+			readers.reserve(trackCount);
+			heads.resize(trackCount);
+			heap.reserve(trackCount);
+			for (size_t i = 0; i < trackCount; ++i)
+			{
+				readers.emplace_back(tracks[i]);
+				if (readers[i].Next(heads[i]))
+				{
+					heap.push_back(i);
+				}
+			}
+			for (size_t i = heap.size() / 2; i-- > 0;)
+			{
+				SiftDown(i);
+			}
+		}
+
+		bool Next(SmfEvent& event)
+		{
+			if (heap.empty())
+			{
+				return false;
+			}
+			size_t track = heap[0];
+			event = heads[track];
+			if (!readers[track].Next(heads[track]))
+			{
+				heap[0] = heap.back();
+				heap.pop_back();
+			}
+			SiftDown(0);
+			return true;
+		}
+
+	private:
+		bool Before(size_t a, size_t b) const
+		{
+			return heads[a].tick != heads[b].tick ? heads[a].tick < heads[b].tick : a < b;
+		}
+
+		void SiftDown(size_t i)
+		{
+			const size_t count = heap.size();
+			while (true)
+			{
+				size_t first = i;
+				size_t left = 2 * i + 1;
+				if (left < count && Before(heap[left], heap[first]))
+				{
+					first = left;
+				}
+				if (left + 1 < count && Before(heap[left + 1], heap[first]))
+				{
+					first = left + 1;
+				}
+				if (first == i)
+				{
+					return;
+				}
+				std::swap(heap[i], heap[first]);
+				i = first;
+			}
+		}
+
+		std::vector<SmfTrackReader> readers;
+		std::vector<SmfEvent> heads;
+		std::vector<size_t> heap;   // Tracks with events left
+	};
+
+	// Which events of which input tracks make one output track
+	struct OutputTrack {
+		const SmfChunk* tracks;
+		size_t trackCount;
+		int channel;  // 0 to 15: that channel's Midi Messages, or one of below
+	};
+	const int AllEvents = -1;
+	const int NonChannelEvents = -2;
+
+	bool Keeps(const OutputTrack& outputTrack, const SmfEvent& event)
+	{
+		switch (outputTrack.channel)
+		{
+		case AllEvents: return true;
+		case NonChannelEvents: return !event.IsChannelMessage();
+		default: return event.IsChannelMessage() && event.Channel() == outputTrack.channel;
+		}
+	}
+
+	// Ticks are converted from start of track, not per delta:
+	// rounding errors don't add up.
+	// Returns false if new tick doesn't fit 64 bits.
+	bool Retime(uint64_t tick, uint16_t fromPpqn, uint16_t toPpqn, uint64_t& newTick)
+	{
+		if (toPpqn == 0 || toPpqn == fromPpqn)
+		{
+			newTick = tick;
+			return true;
+		}
+		uint64_t quarters = tick / fromPpqn;
+		if (quarters > UINT64_MAX / toPpqn)
+		{
+			return false;
+		}
+		newTick = quarters * toPpqn + (tick % fromPpqn * toPpqn + fromPpqn / 2) / fromPpqn;
+		return true;
+	}
+
+	bool WalkTrack(const OutputTrack& outputTrack, uint16_t fromPpqn, uint16_t toPpqn, SmfWriter& writer, const char*& error)
+	{
+		MergedTrackReader reader(outputTrack.tracks, outputTrack.trackCount);
+		SmfEvent event;
+		uint64_t endTick = 0;
+		uint64_t lastTick = 0;
+		while (reader.Next(event))
+		{
+			uint64_t tick = 0;
+			if (!Retime(event.tick, fromPpqn, toPpqn, tick))
+			{
+				error = "tick too big after retime";
+				return false;
+			}
+
+			// Every output track lasts as long as its input tracks, even where it has no events
+			endTick = std::max(endTick, tick);
+			if (event.IsMeta() && event.metaType == SmfMetaEndOfTrack)
+			{
+				continue;
+			}
+			if (Keeps(outputTrack, event))
+			{
+				// Merging and retiming can make gaps no delta time holds:
+				// output must stay readable
+				if (tick - lastTick > SmfMaxDelta)
+				{
+					error = "delta time too long for output";
+					return false;
+				}
+				writer.WriteEvent(tick, event);
+				lastTick = tick;
+			}
+		}
+		if (endTick - lastTick > SmfMaxDelta)
+		{
+			error = "delta time too long for output";
+			return false;
+		}
+		writer.EndTrack(endTick);
+		return true;
+	}
+
+	bool WriteTrack(const OutputTrack& outputTrack, uint16_t fromPpqn, uint16_t toPpqn, SmfWriter& writer, const char*& error)
+	{
+		SmfWriter counter;
+		if (!WalkTrack(outputTrack, fromPpqn, toPpqn, counter, error))
+		{
+			return false;
+		}
+		if (counter.ByteCount() > UINT32_MAX)
+		{
+			error = "track too big";
+			return false;
+		}
+		writer.BeginTrack(static_cast<uint32_t>(counter.ByteCount()));
+		return WalkTrack(outputTrack, fromPpqn, toPpqn, writer, error);
+	}
+
+	// Channels that have Midi Messages, bit per channel
+	uint16_t UsedChannels(const SmfFile& smf)
+	{
+		uint16_t channelMask = 0;
+		for (const SmfChunk& track : smf.tracks)
+		{
+			SmfTrackReader reader(track);
+			SmfEvent event;
+			while (reader.Next(event))
+			{
+				if (event.IsChannelMessage())
+				{
+					channelMask |= static_cast<uint16_t>(1u << event.Channel());
+				}
+			}
+		}
+		return channelMask;
+	}
+
+	bool TranscodeFile(
+		const std::filesystem::path& inputPath,
+		const std::filesystem::path& outputPath,
+		const TranscodeSettings& settings,
+		std::string& contents,
+		SmfFile& smf,
+		TranscodeStats& stats)
+	{
+		const std::string inputName = inputPath.string();
+		std::error_code errorCode;
+		uint64_t size = std::filesystem::file_size(inputPath, errorCode);
+		if (!errorCode && size > MaxTranscodeFileBytes)
+		{
+			fprintf(stderr, "%s: bigger than %llu MB\n", inputName.c_str(),
+				static_cast<unsigned long long>(MaxTranscodeFileBytes / (1024 * 1024)));
+			return false;
+		}
+		if (!LoadFile(inputName.c_str(), contents))
+		{
+			return false;
+		}
+		stats.inputBytes += contents.size();
+
+		const char* error = nullptr;
+		if (!ParseSmf(reinterpret_cast<const uint8_t*>(contents.data()), contents.size(), smf, error))
+		{
+			fprintf(stderr, "%s: %s\n", inputName.c_str(), error);
+			return false;
+		}
+
+		const std::string outputName = outputPath.string();
+		FILE* file = nullptr;
+		if (fopen_s(&file, outputName.c_str(), "wb") != 0 || file == nullptr)
+		{
+			fprintf(stderr, "Can't open output file: %s\n", outputName.c_str());
+			return false;
+		}
+		bool ok = false;
+		{
+			SmfWriter writer(file);
+			ok = TranscodeSmf(smf, settings, writer, error);
+			if (ok && !writer.Flush())
+			{
+				error = "can't write output file";
+				ok = false;
+			}
+			stats.outputBytes += writer.ByteCount();
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok)
+		{
+			fprintf(stderr, "%s: %s\n", inputName.c_str(), error != nullptr ? error : "can't write output file");
+			std::filesystem::remove(outputPath, errorCode);
+		}
+		return ok;
+	}
+
+}
+
+bool TranscodeSmf(const SmfFile& smf, const TranscodeSettings& settings, SmfWriter& writer, const char*& error)
+{
+	if (settings.ppqn != 0 && smf.header.IsSmpte())
+	{
+		error = "can't change ticks per quarter note of SMPTE-timed file";
+		return false;
+	}
+
+	std::vector<OutputTrack> outputTracks;
+	SmfHeader header = smf.header;
+	switch (settings.mode)
+	{
+	case TranscodeMode::Copy:
+		for (const SmfChunk& track : smf.tracks)
+		{
+			outputTracks.push_back({ &track, 1, AllEvents });
+		}
+		break;
+	case TranscodeMode::Merge:
+		header.format = 0;
+		outputTracks.push_back({ smf.tracks.data(), smf.tracks.size(), AllEvents });
+		break;
+	case TranscodeMode::Split:
+	{
+		uint16_t channelMask = UsedChannels(smf);
+		header.format = 1;
+		outputTracks.push_back({ smf.tracks.data(), smf.tracks.size(), NonChannelEvents });
+		for (int channel = 0; channel < 16; ++channel)
+		{
+			if ((channelMask & (1u << channel)) != 0)
+			{
+				outputTracks.push_back({ smf.tracks.data(), smf.tracks.size(), channel });
+			}
+		}
+		break;
+	}
+	}
+
+	header.trackCount = static_cast<uint16_t>(outputTracks.size());
+	if (settings.ppqn != 0)
+	{
+		header.division = settings.ppqn;
+	}
+	writer.WriteHeader(header);
+	for (const OutputTrack& outputTrack : outputTracks)
+	{
+		if (!WriteTrack(outputTrack, smf.header.division, settings.ppqn, writer, error))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+TranscodeStats TranscodeFiles(
+	const std::vector<std::filesystem::path>& inputPaths,
+	const std::filesystem::path& outputDirectory,
+	const TranscodeSettings& settings,
+	uint32_t jobs)
+{
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	jobs = static_cast<uint32_t>(std::clamp<size_t>(jobs, 1, std::max<size_t>(inputPaths.size(), 1)));
+
+	// Workers take next file from shared index; stats are per worker,
+	// summed after join, so counting needs no synchronization
+	std::atomic<size_t> nextFile{ 0 };
+	std::vector<TranscodeStats> workerStats(jobs);
+	auto worker = [&](TranscodeStats& stats)
+	{
+		std::string contents;
+		SmfFile smf;
+		for (size_t i = nextFile.fetch_add(1); i < inputPaths.size(); i = nextFile.fetch_add(1))
+		{
+			++stats.fileCount;
+			if (!TranscodeFile(inputPaths[i], outputDirectory / inputPaths[i].filename(), settings, contents, smf, stats))
+			{
+				++stats.failedCount;
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t i = 1; i < jobs; ++i)
+	{
+		threads.emplace_back(worker, std::ref(workerStats[i]));
+	}
+	worker(workerStats[0]);
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	TranscodeStats total;
+	for (const TranscodeStats& stats : workerStats)
+	{
+		total.fileCount += stats.fileCount;
+		total.failedCount += stats.failedCount;
+		total.inputBytes += stats.inputBytes;
+		total.outputBytes += stats.outputBytes;
+	}
+	total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return total;
+}
+
+std::vector<std::filesystem::path> ListSmfFiles(const std::filesystem::path& directory)
+{
+	std::vector<std::filesystem::path> paths;
+	std::error_code errorCode;
+	for (std::filesystem::directory_iterator it(directory, errorCode), end; !errorCode && it != end; it.increment(errorCode))
+	{
+		std::string extension = it->path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(),
+			[](char c) { return static_cast<char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c); });
+		if (it->is_regular_file() && (extension == ".mid" || extension == ".midi" || extension == ".smf"))
+		{
+			paths.push_back(it->path());
+		}
+	}
+	if (errorCode)
+	{
+		fprintf(stderr, "Can't list directory: %s\n", directory.string().c_str());
+	}
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+void PrintTranscodeStats(FILE* file, const TranscodeStats& stats)
+{
+	const double Megabyte = 1024.0 * 1024.0;
+	fprintf(file, "Transcoded %llu files (%llu failed): %.2f MB in, %.2f MB out, %.3f seconds\n",
+		static_cast<unsigned long long>(stats.fileCount), static_cast<unsigned long long>(stats.failedCount),
+		static_cast<double>(stats.inputBytes) / Megabyte, static_cast<double>(stats.outputBytes) / Megabyte, stats.seconds);
+	if (stats.seconds > 0)
+	{
+		fprintf(file, "Speed: %.1f MB/s, %.0f files/s\n",
+			static_cast<double>(stats.inputBytes) / Megabyte / stats.seconds,
+			static_cast<double>(stats.fileCount) / stats.seconds);
+	}
+}
@@ -0,0 +1,60 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "Smf.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+
+// Standard Midi File to Standard Midi File conversions, see Smf.h.
+//
+// Output is written while input is read: no event lists are built.
+// Every output track is a walk over input tracks, merged by tick,
+// keeping events that belong to that output track.
+// Track length comes first in file, so every output track is
+// walked twice: once to count bytes, once to write them.
+
+enum class TranscodeMode : uint8_t {
+	Copy,   // Same tracks (only End of Track and running status are normalized)
+	Merge,  // All tracks into one: format 1 to format 0
+	Split,  // One track per channel, plus one for meta and System Exclusive events: format 1
+};
+
+struct TranscodeSettings {
+	TranscodeMode mode{ TranscodeMode::Copy };
+	uint16_t ppqn{ 0 };   // New ticks per quarter note, 0 keeps file's
+};
+
+// Writes smf converted as settings say.
+// Returns false, and sets error to reason, on bad input.
+bool TranscodeSmf(const SmfFile& smf, const TranscodeSettings& settings, SmfWriter& writer, const char*& error);
+
+struct TranscodeStats {
+	uint64_t fileCount{ 0 };
+	uint64_t failedCount{ 0 };
+	uint64_t inputBytes{ 0 };
+	uint64_t outputBytes{ 0 };
+	double seconds{ 0 };
+};
+
+// Bigger input files are refused: every worker holds one whole file in memory
+const uint64_t MaxTranscodeFileBytes = 64 * 1024 * 1024;
+
+// Converts every file into outputDirectory, under same name.
+// Files are shared by jobs worker threads; each worker keeps one
+// input file and write buffer in memory, whatever number of files.
+// Failures are printed, and don't stop other files.
+TranscodeStats TranscodeFiles(
+	const std::vector<std::filesystem::path>& inputPaths,
+	const std::filesystem::path& outputDirectory,
+	const TranscodeSettings& settings,
+	uint32_t jobs);
+
+// Standard Midi Files in directory (.mid, .midi, .smf), sorted by name
+std::vector<std::filesystem::path> ListSmfFiles(const std::filesystem::path& directory);
+
+void PrintTranscodeStats(FILE* file, const TranscodeStats& stats);
@@ -0,0 +1,164 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#include "Ump.h"
+
+size_t TranslateToMidi2(MidiMessage midiMessage, uint8_t group, uint32_t* words)
+{
+	const uint8_t status = midiMessage.Status();
+	const uint8_t channel = status & 0x0F;
+	const uint8_t data1 = midiMessage.Data1();
+	const uint8_t data2 = midiMessage.Data2();
+
+	Ump64 packet;
+	switch (status >> 4)
+	{
+	case NoteOffSignature:
+		packet = MakeUmpNoteOff(group, channel, data1, static_cast<uint16_t>(UmpScaleUp(data2, 7, 16)));
+		break;
+	case NoteOnSignature:
+		// Midi 1.0 Note On with velocity 0 is Note Off with default release velocity 64
+		packet = data2 == 0
+			? MakeUmpNoteOff(group, channel, data1, static_cast<uint16_t>(UmpScaleUp(64, 7, 16)))
+			: MakeUmpNoteOn(group, channel, data1, static_cast<uint16_t>(UmpScaleUp(data2, 7, 16)));
+		break;
+	case 0b1010: // Aftertouch (Poly Pressure)
+		packet = { MakeUmpMidi2Word0(group, 0b1010, channel, data1, 0), UmpScaleUp(data2, 7, 32) };
+		break;
+	case ControlChangeSignature:
+		packet = MakeUmpControlChange(group, channel, data1, UmpScaleUp(data2, 7, 32));
+		break;
+	case SetInstrumentSignature:
+		packet = MakeUmpProgramChange(group, channel, data1);
+		break;
+	case 0b1101: // Channel Pressure
+		packet = { MakeUmpMidi2Word0(group, 0b1101, channel, 0, 0), UmpScaleUp(data1, 7, 32) };
+		break;
+	case PitchBendSignature:
+		// 14 bits: Data1 is lower 7 bits, Data2 is upper 7 bits
+		packet = MakeUmpPitchBend(group, channel, UmpScaleUp(data1 | (uint32_t{ data2 } << 7), 14, 32));
+		break;
+	default:
+		if (status == 0xF0 || status == 0xF7)
+		{
+			// System Exclusive needs Data64 packets, not short message
+			return 0;
+		}
+		// System Common and Real-Time: same bytes, Message Type 1
+		words[0] = (uint32_t{ 0x1 } << 28) | (uint32_t{ group } << 24)
+			| (uint32_t{ status } << 16) | (uint32_t{ data1 } << 8) | data2;
+		return 1;
+	}
+
+	words[0] = packet.word0;
+	words[1] = packet.word1;
+	return 2;
+}
+
+size_t TranslateToMidi2(const MidiMessage* midiMessages, size_t count, uint8_t group, uint32_t* words)
+{
+	size_t wordCount = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		wordCount += TranslateToMidi2(midiMessages[i], group, words + wordCount);
+	}
+	return wordCount;
+}
+
+size_t TranslatePacketToMidi1(const uint32_t* packet, MidiMessage* midiMessages)
+{
+	const uint32_t word0 = packet[0];
+	const uint8_t status = static_cast<uint8_t>(word0 >> 16);
+	const uint8_t index1 = static_cast<uint8_t>(word0 >> 8);
+	const uint8_t index2 = static_cast<uint8_t>(word0);
+
+	switch (GetUmpMessageType(word0))
+	{
+	case UmpMessageType::System:
+	case UmpMessageType::Midi1ChannelVoice:
+		// Midi 1.0 bytes already
+		midiMessages[0] = MidiMessage(status, index1, index2);
+		return 1;
+
+	case UmpMessageType::Midi2ChannelVoice:
+		break;
+
+	default:
+		return 0;
+	}
+
+	const uint32_t word1 = packet[1];
+	const uint8_t channel = status & 0x0F;
+	const uint8_t pitch = index1 & 0x7F;
+
+	switch (status >> 4)
+	{
+	case NoteOffSignature:
+		midiMessages[0] = MidiMessage(status, pitch, static_cast<uint8_t>(UmpScaleDown(word1 >> 16, 16, 7)));
+		return 1;
+	case NoteOnSignature:
+	{
+		// Midi 2.0 Note On with small velocity must not become Midi 1.0 Note Off
+		uint8_t velocity = static_cast<uint8_t>(UmpScaleDown(word1 >> 16, 16, 7));
+		midiMessages[0] = MidiMessage(status, pitch, velocity == 0 ? 1 : velocity);
+		return 1;
+	}
+	case 0b1010: // Poly Pressure
+	case ControlChangeSignature:
+		midiMessages[0] = MidiMessage(status, index1 & 0x7F, static_cast<uint8_t>(UmpScaleDown(word1, 32, 7)));
+		return 1;
+	case SetInstrumentSignature:
+	{
+		size_t count = 0;
+		if (index2 & 1)
+		{
+			// Bank valid: Bank Select MSB (Control 0) and LSB (Control 32) first
+			midiMessages[count++] = MakeControlChangeMessage(channel, 0, (word1 >> 8) & 0x7F);
+			midiMessages[count++] = MakeControlChangeMessage(channel, 32, word1 & 0x7F);
+		}
+		midiMessages[count++] = MakeInstrumentMessage(channel, (word1 >> 24) & 0x7F);
+		return count;
+	}
+	case 0b1101: // Channel Pressure
+		midiMessages[0] = MidiMessage(status, static_cast<uint8_t>(UmpScaleDown(word1, 32, 7)));
+		return 1;
+	case PitchBendSignature:
+	{
+		uint32_t value = UmpScaleDown(word1, 32, 14);
+		midiMessages[0] = MidiMessage(status, value & 0x7F, static_cast<uint8_t>(value >> 7));
+		return 1;
+	}
+	case UmpRegisteredControllerStatus:
+	case UmpAssignableControllerStatus:
+	{
+		// RPN: Controls 101, 100. NRPN: Controls 99, 98. Then Data Entry MSB (6) and LSB (38)
+		bool registered = (status >> 4) == UmpRegisteredControllerStatus;
+		uint32_t value = UmpScaleDown(word1, 32, 14);
+		midiMessages[0] = MakeControlChangeMessage(channel, registered ? 101 : 99, index1 & 0x7F);
+		midiMessages[1] = MakeControlChangeMessage(channel, registered ? 100 : 98, index2 & 0x7F);
+		midiMessages[2] = MakeControlChangeMessage(channel, 6, static_cast<uint8_t>(value >> 7));
+		midiMessages[3] = MakeControlChangeMessage(channel, 38, value & 0x7F);
+		return 4;
+	}
+	default:
+		// Per-note controllers, per-note pitch bend, per-note management
+		return 0;
+	}
+}
+
+size_t TranslateToMidi1(const uint32_t* words, size_t wordCount, MidiMessage* midiMessages)
+{
+	size_t count = 0;
+	size_t i = 0;
+	while (i < wordCount)
+	{
+		size_t packetWordCount = UmpWordCount(words[i]);
+		if (i + packetWordCount > wordCount)
+		{
+			break;
+		}
+		count += TranslatePacketToMidi1(words + i, midiMessages + count);
+		i += packetWordCount;
+	}
+	return count;
+}
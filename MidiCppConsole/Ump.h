@@ -0,0 +1,255 @@
+// Copyright (c) Kodi Studios 2023.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include "MidiMessage.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Universal MIDI Packet (UMP): Midi 2.0 message format.
+// Reference: https://midi.org/universal-midi-packet-ump-and-midi-2-0-protocol-specification
+//
+// Packet is 1, 2, 3 or 4 32-bit words. First word says what it is:
+// [31..28] Message Type 4-bits : 0b TTTT, also says packet size
+// [27..24] Group 4-bits        : 0b GGGG, 16 groups of 16 channels
+// [23..0]  Depends on Message Type
+//
+// Midi 2.0 Channel Voice message (Message Type 4), 64 bits:
+// word0: 0b 0100 GGGG SSSS CCCC IIII IIII JJJJ JJJJ
+//        Status 4-bits  : 0b SSSS, same as Midi 1.0 for Note On, Control Change, ...
+//        Channel 4-bits : 0b CCCC
+//        Index bytes    : note number, controller number, ...
+// word1: Data 32-bits, for example Velocity 16-bits in upper half
+//
+// Compared to Midi 1.0: velocity is 16 bits (not 7), controllers and
+// pitch bend are 32 bits (not 7 and 14), and every note has its own
+// controllers and pitch bend.
+//
+// Packets are kept as plain words, in CPU byte order:
+// byte order only matters when packets are written to file or wire.
+
+enum class UmpMessageType : uint8_t {
+	Utility = 0x0,            // 32 bits: NOOP, Jitter Reduction
+	System = 0x1,             // 32 bits: Timing Clock, Start, Stop, ...
+	Midi1ChannelVoice = 0x2,  // 32 bits: Midi 1.0 message as is
+	Data64 = 0x3,             // 64 bits: System Exclusive, 7-bit data
+	Midi2ChannelVoice = 0x4,  // 64 bits: Midi 2.0 Note On, Control Change, ...
+	Data128 = 0x5,            // 128 bits: System Exclusive, 8-bit data
+	FlexData = 0xD,           // 128 bits: Tempo, Time Signature, Lyrics, ...
+	Stream = 0xF,             // 128 bits: Endpoint discovery, protocol negotiation
+};
+
+constexpr UmpMessageType GetUmpMessageType(uint32_t word0) { return static_cast<UmpMessageType>(word0 >> 28); }
+constexpr uint8_t GetUmpGroup(uint32_t word0) { return static_cast<uint8_t>((word0 >> 24) & 0x0F); }
+
+// Packet size in 32-bit words, based on Message Type of first word.
+// Reserved Message Types have fixed sizes too, so unknown packets can be skipped.
+constexpr uint32_t UmpWordCount(uint32_t word0)
+{
+	switch (word0 >> 28)
+	{
+	case 0x0: case 0x1: case 0x2: case 0x6: case 0x7:
+		return 1;
+	case 0x3: case 0x4: case 0x8: case 0x9: case 0xA:
+		return 2;
+	case 0xB: case 0xC:
+		return 3;
+	default:     // 0x5, 0xD, 0xE, 0xF
+		return 4;
+	}
+}
+
+struct Ump32 {
+	uint32_t word0{ 0 };
+};
+
+struct Ump64 {
+	uint32_t word0{ 0 };
+	uint32_t word1{ 0 };
+};
+
+struct Ump128 {
+	uint32_t word0{ 0 };
+	uint32_t word1{ 0 };
+	uint32_t word2{ 0 };
+	uint32_t word3{ 0 };
+};
+
+static_assert(sizeof(Ump32) == 4 && sizeof(Ump64) == 8 && sizeof(Ump128) == 16, "Packets are plain words");
+
+// Midi 2.0 Channel Voice status (upper 4 bits of word0 byte 2).
+// 0x8 to 0xE are same as Midi 1.0, 0x0 to 0x6 and 0xF are new.
+constexpr uint8_t UmpRegisteredPerNoteControllerStatus = 0x0;
+constexpr uint8_t UmpAssignablePerNoteControllerStatus = 0x1;
+constexpr uint8_t UmpRegisteredControllerStatus = 0x2;   // RPN
+constexpr uint8_t UmpAssignableControllerStatus = 0x3;   // NRPN
+constexpr uint8_t UmpPerNotePitchBendStatus = 0x6;
+constexpr uint8_t UmpPerNoteManagementStatus = 0xF;
+
+//
+// Value scaling
+//
+
+// Widens value, for example 7-bit velocity to 16 bits.
+// Min-Center-Max scaling from UMP specification: 0 stays 0, center stays center
+// (64 becomes 0x8000), maximum becomes maximum (127 becomes 0xFFFF).
+// Above center, lower bits are filled by repeating source bits.
+constexpr uint32_t UmpScaleUp(uint32_t value, uint32_t sourceBits, uint32_t targetBits)
+{
+	const uint32_t scaleBits = targetBits - sourceBits;
+	uint32_t shifted = value << scaleBits;
+	const uint32_t center = 1u << (sourceBits - 1);
+	if (value <= center)
+	{
+		return shifted;
+	}
+
+	const uint32_t repeatBits = sourceBits - 1;
+	uint32_t repeat = value & ((1u << repeatBits) - 1);
+	repeat = scaleBits > repeatBits ? repeat << (scaleBits - repeatBits) : repeat >> (repeatBits - scaleBits);
+	while (repeat != 0)
+	{
+		shifted |= repeat;
+		repeat >>= repeatBits;
+	}
+	return shifted;
+}
+
+// Narrows value, for example 32-bit controller to 7 bits: keeps upper bits
+constexpr uint32_t UmpScaleDown(uint32_t value, uint32_t sourceBits, uint32_t targetBits)
+{
+	return value >> (sourceBits - targetBits);
+}
+
+static_assert(UmpScaleUp(0, 7, 16) == 0x0000, "Minimum stays minimum");
+static_assert(UmpScaleUp(64, 7, 16) == 0x8000, "Center stays center");
+static_assert(UmpScaleUp(127, 7, 16) == 0xFFFF, "Maximum becomes maximum");
+static_assert(UmpScaleUp(127, 7, 32) == 0xFFFFFFFF, "Maximum becomes maximum");
+static_assert(UmpScaleUp(0x2000, 14, 32) == 0x80000000, "Pitch bend center");
+static_assert(UmpScaleDown(UmpScaleUp(100, 7, 16), 16, 7) == 100, "Round trip");
+
+//
+// Encoders
+//
+
+// word0 of Midi 2.0 Channel Voice message
+constexpr uint32_t MakeUmpMidi2Word0(uint8_t group, uint8_t status, uint8_t channel, uint8_t index1, uint8_t index2)
+{
+	return (uint32_t{ 0x4 } << 28)
+		| (uint32_t{ group } << 24)
+		| (uint32_t{ status } << 20)
+		| (uint32_t{ channel } << 16)
+		| (uint32_t{ index1 } << 8)
+		| index2;
+}
+
+// Midi 1.0 message carried as is (Message Type 2)
+constexpr Ump32 MakeUmpMidi1(uint8_t group, MidiMessage midiMessage)
+{
+	// word0: 0b 0010 GGGG, then Status byte, Data1, Data2
+	return { (uint32_t{ 0x2 } << 28)
+		| (uint32_t{ group } << 24)
+		| (uint32_t{ midiMessage.Status() } << 16)
+		| (uint32_t{ midiMessage.Data1() } << 8)
+		| midiMessage.Data2() };
+}
+
+constexpr Ump64 MakeUmpNoteOn(
+	uint8_t group,      // 4 bits, 0 to 15
+	uint8_t channel,    // 4 bits, 0 to 15
+	uint8_t pitch,      // 7 bits, 0 to 127
+	uint16_t velocity,  // 16 bits. 0 is valid velocity: Midi 2.0 Note On is never Note Off
+	uint8_t attributeType = 0,
+	uint16_t attributeData = 0)
+{
+	return { MakeUmpMidi2Word0(group, NoteOnSignature, channel, pitch, attributeType),
+		(uint32_t{ velocity } << 16) | attributeData };
+}
+
+constexpr Ump64 MakeUmpNoteOff(
+	uint8_t group,
+	uint8_t channel,
+	uint8_t pitch,
+	uint16_t velocity,  // Release velocity, 16 bits
+	uint8_t attributeType = 0,
+	uint16_t attributeData = 0)
+{
+	return { MakeUmpMidi2Word0(group, NoteOffSignature, channel, pitch, attributeType),
+		(uint32_t{ velocity } << 16) | attributeData };
+}
+
+constexpr Ump64 MakeUmpControlChange(uint8_t group, uint8_t channel, uint8_t control, uint32_t value)
+{
+	return { MakeUmpMidi2Word0(group, ControlChangeSignature, channel, control, 0), value };
+}
+
+// value: 32 bits, 0x80000000 is center (no bend)
+constexpr Ump64 MakeUmpPitchBend(uint8_t group, uint8_t channel, uint32_t value)
+{
+	return { MakeUmpMidi2Word0(group, PitchBendSignature, channel, 0, 0), value };
+}
+
+// Bends one note only, other notes on channel keep their pitch
+constexpr Ump64 MakeUmpPerNotePitchBend(uint8_t group, uint8_t channel, uint8_t pitch, uint32_t value)
+{
+	return { MakeUmpMidi2Word0(group, UmpPerNotePitchBendStatus, channel, pitch, 0), value };
+}
+
+// Controller of one note, for example Registered Per-Note Controller 7 (Volume)
+constexpr Ump64 MakeUmpPerNoteController(uint8_t group, uint8_t channel, uint8_t pitch, uint8_t control, uint32_t value, bool registered)
+{
+	return { MakeUmpMidi2Word0(group,
+		registered ? UmpRegisteredPerNoteControllerStatus : UmpAssignablePerNoteControllerStatus,
+		channel, pitch, control), value };
+}
+
+// Bank is used only when bankValid is set: Bank Select is part of Program Change in Midi 2.0
+constexpr Ump64 MakeUmpProgramChange(uint8_t group, uint8_t channel, uint8_t program, bool bankValid = false, uint8_t bankMsb = 0, uint8_t bankLsb = 0)
+{
+	return { MakeUmpMidi2Word0(group, SetInstrumentSignature, channel, 0, bankValid ? 1 : 0),
+		(uint32_t{ program } << 24) | (uint32_t{ bankMsb } << 8) | bankLsb };
+}
+
+// Flex Data "Set Tempo" (128 bits): tempo in units of 10 nanoseconds per quarter note
+constexpr Ump128 MakeUmpSetTempo(uint8_t group, uint32_t microsecondsPerQuarterNote)
+{
+	// word0: 0b 1101 GGGG FFAA CCCC BBBB BBBB SSSS SSSS
+	//        Format 0b00 (complete in one packet), Address 0b01 (whole group),
+	//        Status Bank 0x00, Status 0x00 (Set Tempo)
+	return { (uint32_t{ 0xD } << 28) | (uint32_t{ group } << 24) | (uint32_t{ 0b01 } << 20),
+		microsecondsPerQuarterNote * 100, 0, 0 };
+}
+
+// Compile-time checks: Middle C "Note On", velocity 90 widened to 16 bits
+static_assert(MakeUmpNoteOn(0, 0, 60, 0xB4B4).word0 == 0x40903C00, "Note On word0");
+static_assert(MakeUmpNoteOn(0, 0, 60, 0xB4B4).word1 == 0xB4B40000, "Note On word1");
+static_assert(MakeUmpMidi1(1, MakeNoteMessage(0, 60, 90)).word0 == 0x21903C5A, "Midi 1.0 in UMP");
+static_assert(UmpWordCount(MakeUmpSetTempo(0, 500000).word0) == 4, "Flex Data is 128 bits");
+
+//
+// Translation between Midi 1.0 and Midi 2.0 protocols
+//
+
+// Midi 1.0 message to Midi 2.0 packet (or System packet), as UMP specification says:
+// values are widened with UmpScaleUp(), Note On with velocity 0 becomes Note Off.
+// Writes 1 or 2 words, returns count. System Exclusive isn't short message: 0 words.
+size_t TranslateToMidi2(MidiMessage midiMessage, uint8_t group, uint32_t* words);
+
+// Bulk version: words must have room for 2 * count.
+// Returns number of words written.
+size_t TranslateToMidi2(const MidiMessage* midiMessages, size_t count, uint8_t group, uint32_t* words);
+
+// One packet to Midi 1.0 messages, at most 4.
+// Program Change with bank becomes Bank Select MSB, LSB and Program Change.
+// Registered and Assignable Controllers become RPN and NRPN Control Change sequences.
+// Packets without Midi 1.0 equivalent (per-note controllers, per-note pitch bend,
+// System Exclusive, Flex Data, ...) give 0 messages.
+// Group is dropped: Midi 1.0 has 16 channels only.
+size_t TranslatePacketToMidi1(const uint32_t* packet, MidiMessage* midiMessages);
+
+// Bulk version: whole packets only, incomplete packet at end is ignored.
+// midiMessages must have room for 2 * wordCount.
+// Returns number of Midi Messages written.
+size_t TranslateToMidi1(const uint32_t* words, size_t wordCount, MidiMessage* midiMessages);
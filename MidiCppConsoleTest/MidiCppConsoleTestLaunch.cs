@@ -2,8 +2,11 @@
 // Licensed under the MIT license.
 
 using Microsoft.VisualStudio.TestTools.UnitTesting;
+using System;
 using System.Diagnostics;
 using System.IO;
+using System.Runtime.InteropServices;
+using System.Threading;
 
 namespace MidiCppConsoleTest
 {
@@ -22,6 +25,339 @@ namespace MidiCppConsoleTest
             }
         }
 
+        [TestMethod]
+        public void NotesLaunch()
+        {
+            Assert.AreEqual(0, RunMidiCppConsole("--backend null --clock virtual --notes 60:90:500,64,67"));
+        }
+
+        [TestMethod]
+        public void UnknownOptionLaunch()
+        {
+            Assert.AreEqual(1, RunMidiCppConsole("--no-such-option"));
+        }
+
+        [TestMethod]
+        public void BadDeviceLaunch()
+        {
+            // Device that doesn't exist is reported, not played into
+            Assert.AreEqual(1, RunMidiCppConsole("--device 4000 --clock virtual"));
+        }
+
+        [TestMethod]
+        public void ListDevicesLaunch()
+        {
+            Assert.AreEqual(0, RunMidiCppConsole("--list-devices"));
+        }
+
+        [TestMethod]
+        public void ScoreLaunch()
+        {
+            Assert.AreEqual(0, RunMidiCppConsole("--backend null --clock virtual --score \"tempo 90 C4/4 D#4!100 [C4 E4 G4]/2 r/8 60/8.\""));
+            Assert.AreEqual(1, RunMidiCppConsole("--backend null --clock virtual --score \"C4 [C4 E4\""));
+        }
+
+        [TestMethod]
+        public void JingleLaunch()
+        {
+            Assert.AreEqual(0, RunMidiCppConsole("--backend null --clock virtual --jingle twinkle"));
+        }
+
+        [TestMethod]
+        public void GenerateLaunch()
+        {
+            Assert.AreEqual(0, RunMidiCppConsole("--generate --backend null --rate 100000 --seconds 1 --distribution normal"));
+        }
+
+        [TestMethod]
+        [Timeout(10000)]
+        public void GenerateUnevenRateLaunch()
+        {
+            // 1e9 / 3 isn't whole nanoseconds: every deadline must still be reached
+            Assert.AreEqual(0, RunMidiCppConsole("--generate --backend null --clock virtual --rate 3 --seconds 1"));
+            Assert.AreEqual(0, RunMidiCppConsole("--benchmark generate --iterations 1001"));
+        }
+
+        [TestMethod]
+        public void UmpLaunch()
+        {
+            string umpPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.ump");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend ump --clock virtual --notes 60:90:10 --output \"" + umpPath + "\""));
+
+            // Program Change, Note On, Note Off: 64-bit Midi 2.0 packets, big-endian
+            byte[] bytes = File.ReadAllBytes(umpPath);
+            Assert.AreEqual(3 * 8, bytes.Length);
+            Assert.AreEqual(0x40, bytes[0]);
+            Assert.AreEqual(0x90, bytes[9]);
+        }
+
+        [TestMethod]
+        public void TransposeLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.transpose.raw");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --notes 60:90:10,120:90:10 --transpose 12 --output \"" + rawPath + "\""));
+
+            // Program Change, then Middle C an octave up; 120 + 12 is out of range and dropped
+            CollectionAssert.AreEqual(new byte[] { 0xC0, 0x18, 0x90, 0x48, 0x5A, 0x90, 0x48, 0x00 }, File.ReadAllBytes(rawPath));
+        }
+
+        [TestMethod]
+        public void BankLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.bank.raw");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --bank 1:2 --notes 60:90:10 --output \"" + rawPath + "\""));
+
+            // Bank Select MSB and LSB, then Program Change once, then note
+            CollectionAssert.AreEqual(new byte[] { 0xB0, 0x00, 0x01, 0xB0, 0x20, 0x02, 0xC0, 0x18, 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00 }, File.ReadAllBytes(rawPath));
+        }
+
+        [TestMethod]
+        public void InstrumentNameLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.instrument.raw");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --instrument \"Acoustic Grand Piano\" --notes 60:90:10 --output \"" + rawPath + "\""));
+            Assert.AreEqual(0x00, File.ReadAllBytes(rawPath)[1]);
+
+            Assert.AreEqual(1, RunMidiCppConsole("--backend null --instrument Kazoo"));
+        }
+
+        [TestMethod]
+        public void DrumsLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.drums.raw");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --drums \"swing 60 closed-hi-hat:xx\" --output \"" + rawPath + "\""));
+
+            // Channel 10: first hit's Note Off goes out with second hit
+            CollectionAssert.AreEqual(new byte[] { 0x99, 0x2A, 0x5A, 0x99, 0x2A, 0x00, 0x99, 0x2A, 0x5A, 0x99, 0x2A, 0x00 }, File.ReadAllBytes(rawPath));
+        }
+
+        [TestMethod]
+        public void DrumsTransposeLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.drums-transpose.raw");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --drums \"bass-drum-1:x.x.\" --transpose 12 --output \"" + rawPath + "\""));
+
+            // Drum channel picks instruments by pitch, so transpose leaves it alone: still Bass Drum 1
+            CollectionAssert.AreEqual(new byte[] { 0x99, 0x24, 0x5A, 0x99, 0x24, 0x00, 0x99, 0x24, 0x5A, 0x99, 0x24, 0x00 }, File.ReadAllBytes(rawPath));
+        }
+
+        [TestMethod]
+        public void CalibrateLaunch()
+        {
+            string latencyPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.latency.txt");
+
+            // Memory backend loops probes back in process
+            Assert.AreEqual(0, RunMidiCppConsole("--calibrate --backend memory --probes 10 --latency-file \"" + latencyPath + "\""));
+            StringAssert.EndsWith(File.ReadAllText(latencyPath), " Loopback\n");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend memory --notes 60:90:10 --latency-file \"" + latencyPath + "\""));
+
+            Assert.AreEqual(1, RunMidiCppConsole("--calibrate --backend memory --probes 0"));
+        }
+
+        [TestMethod]
+        public void DevicesLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.devices.raw");
+
+            // File backend: both devices write to one file, in send order.
+            // Device 1 is 5 ms slower, so device 0 plays its 3 ms note 5 ms later.
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --devices 0,1:5 --notes 60:90:3 --output \"" + rawPath + "\""));
+            CollectionAssert.AreEqual(new byte[] { 0xC0, 0x18, 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00, 0xC0, 0x18, 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00 }, File.ReadAllBytes(rawPath));
+        }
+
+        [TestMethod]
+        public void TranscodeLaunch()
+        {
+            string inputDirectory = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.smf");
+            string outputDirectory = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.smf.merged");
+            Directory.CreateDirectory(inputDirectory);
+
+            // Format 1, 96 PPQN: Middle C on channel 0, E4 on channel 1 half a beat later
+            File.WriteAllBytes(Path.Combine(inputDirectory, "song.mid"), new byte[] {
+                0x4D, 0x54, 0x68, 0x64, 0x00, 0x00, 0x00, 0x06, 0x00, 0x01, 0x00, 0x02, 0x00, 0x60,
+                0x4D, 0x54, 0x72, 0x6B, 0x00, 0x00, 0x00, 0x0C, 0x00, 0x90, 0x3C, 0x40, 0x60, 0x80, 0x3C, 0x00, 0x00, 0xFF, 0x2F, 0x00,
+                0x4D, 0x54, 0x72, 0x6B, 0x00, 0x00, 0x00, 0x0C, 0x30, 0x91, 0x40, 0x40, 0x60, 0x81, 0x40, 0x00, 0x00, 0xFF, 0x2F, 0x00 });
+
+            Assert.AreEqual(0, RunMidiCppConsole("--transcode merge --input-dir \"" + inputDirectory + "\" --output-dir \"" + outputDirectory + "\""));
+
+            // Format 0: one track, events of both tracks in time order
+            CollectionAssert.AreEqual(new byte[] {
+                0x4D, 0x54, 0x68, 0x64, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x01, 0x00, 0x60,
+                0x4D, 0x54, 0x72, 0x6B, 0x00, 0x00, 0x00, 0x14,
+                0x00, 0x90, 0x3C, 0x40, 0x30, 0x91, 0x40, 0x40, 0x30, 0x80, 0x3C, 0x00, 0x30, 0x81, 0x40, 0x00, 0x00, 0xFF, 0x2F, 0x00 },
+                File.ReadAllBytes(Path.Combine(outputDirectory, "song.mid")));
+        }
+
+        [TestMethod]
+        public void TranscodeBadFileLaunch()
+        {
+            string inputDirectory = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.smf.bad");
+            string outputDirectory = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.smf.bad.merged");
+            Directory.CreateDirectory(inputDirectory);
+
+            // Note On cut short by next Status byte
+            File.WriteAllBytes(Path.Combine(inputDirectory, "bad.mid"), new byte[] {
+                0x4D, 0x54, 0x68, 0x64, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x01, 0x00, 0x60,
+                0x4D, 0x54, 0x72, 0x6B, 0x00, 0x00, 0x00, 0x08, 0x00, 0x90, 0x3C, 0x90, 0x00, 0xFF, 0x2F, 0x00 });
+
+            Assert.AreEqual(1, RunMidiCppConsole("--transcode merge --input-dir \"" + inputDirectory + "\" --output-dir \"" + outputDirectory + "\""));
+            Assert.IsFalse(File.Exists(Path.Combine(outputDirectory, "bad.mid")));
+
+            // Zero ticks per quarter note is rejected before any file is read
+            Assert.AreEqual(1, RunMidiCppConsole("--transcode copy --ppqn 0 --input-dir \"" + inputDirectory + "\" --output-dir \"" + outputDirectory + "\""));
+        }
+
+        [TestMethod]
+        public void DecodeRawLaunch()
+        {
+            string inputPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.raw.bin");
+            string outputPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.raw.txt");
+
+            // Guitar, Note On, running status Note On with Timing Clock inside it,
+            // System Exclusive, then running status cancelled by it: 3C 00 is dropped
+            File.WriteAllBytes(inputPath, new byte[] {
+                0xC0, 0x18, 0x90, 0x3C, 0x5A, 0x40, 0xF8, 0x5A,
+                0xF0, 0x7E, 0x7F, 0x09, 0x01, 0xF7, 0x3C, 0x00 });
+
+            Assert.AreEqual(0, RunMidiCppConsole("--decode-raw \"" + inputPath + "\" --output \"" + outputPath + "\""));
+            CollectionAssert.AreEqual(new string[] { "C0 18", "90 3C 5A", "F8", "90 40 5A" }, File.ReadAllLines(outputPath));
+        }
+
+        [TestMethod]
+        public void FilterLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.filter.raw");
+            string rulesPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.filter.txt");
+
+            // Select Midi Instrument is dropped, notes stay
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --notes 60:90:3 --filter \"drop program-change, mute 1\" --output \"" + rawPath + "\""));
+            CollectionAssert.AreEqual(new byte[] { 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00 }, File.ReadAllBytes(rawPath));
+
+            // Same from rules file, checked as messages are sent
+            File.WriteAllText(rulesPath, "# Notes only\ndrop program-change\n");
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --notes 60:90:3 --filter-file \"" + rulesPath + "\" --output \"" + rawPath + "\""));
+            CollectionAssert.AreEqual(new byte[] { 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00 }, File.ReadAllBytes(rawPath));
+
+            Assert.AreEqual(1, RunMidiCppConsole("--backend null --filter \"drop bogus\""));
+        }
+
+        [TestMethod]
+        public void StateFileLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.state-play.raw");
+            string statePath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.state.raw");
+            File.Delete(statePath);
+
+            // Program 40 differs from power-on program 0, so it's saved
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --instrument 40 --notes 60:90:3 --state-file \"" + statePath + "\" --output \"" + rawPath + "\""));
+            CollectionAssert.AreEqual(new byte[] { 0xC0, 0x28 }, File.ReadAllBytes(statePath));
+
+            // Restored first, then this run's program, which is power-on value again
+            Assert.AreEqual(0, RunMidiCppConsole("--backend file --clock virtual --instrument 0 --notes 60:90:3 --state-file \"" + statePath + "\" --output \"" + rawPath + "\""));
+            CollectionAssert.AreEqual(new byte[] { 0xC0, 0x28, 0xC0, 0x00, 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00 }, File.ReadAllBytes(rawPath));
+            Assert.AreEqual(0, File.ReadAllBytes(statePath).Length);
+        }
+
+        [TestMethod]
+        [Timeout(20000)]
+        public void CtrlCPanicLaunch()
+        {
+            string rawPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.panic.raw");
+
+            using (Process midiCppConsoleProcess = Process.Start(GetMidiCppConsoleFilePath(), "--backend file --notes 60:90:10000,64 --output \"" + rawPath + "\""))
+            {
+                // Note On goes out right away, its Note Off is 10 seconds away
+                Thread.Sleep(1000);
+                SendCtrlC(midiCppConsoleProcess);
+                Assert.IsTrue(midiCppConsoleProcess.HasExited);
+            }
+
+            // Sounding note got its Note Off before program ended; second note never started
+            CollectionAssert.AreEqual(new byte[] { 0xC0, 0x18, 0x90, 0x3C, 0x5A, 0x90, 0x3C, 0x00 }, File.ReadAllBytes(rawPath));
+        }
+
+        [TestMethod]
+        public void TraceLaunch()
+        {
+            string tracePath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.trace.json");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--backend null --notes 60:90:10,64:90:10 --trace \"" + tracePath + "\""));
+            StringAssert.StartsWith(File.ReadAllText(tracePath), "{\"traceEvents\":[");
+        }
+
+        [TestMethod]
+        public void MetricsLaunch()
+        {
+            string metricsPath = Path.Combine(TestContext.TestRunDirectory, "MidiCppConsole.metrics.txt");
+
+            Assert.AreEqual(0, RunMidiCppConsole("--generate --backend null --rate 10000 --metrics \"" + metricsPath + "\""));
+
+            // 10000 generated: 8 Note Ons fill polyphony, then Note Off and Note On take turns;
+            // 8 Note Offs at end stop notes still sounding. Velocity 0 Note On counts as Note Off.
+            string metrics = File.ReadAllText(metricsPath);
+            StringAssert.Contains(metrics, "midi_messages_sent_total{type=\"note_off\"} 5004\n");
+            StringAssert.Contains(metrics, "midi_messages_sent_total{type=\"note_on\"} 5004\n");
+
+            // File rewritten in a busy loop is rejected
+            Assert.AreEqual(1, RunMidiCppConsole("--generate --backend null --metrics \"" + metricsPath + "\" --metrics-interval 0"));
+        }
+
+        [TestMethod]
+        public void BenchmarkLaunch()
+        {
+            Assert.AreEqual(0, RunMidiCppConsole("--benchmark all --iterations 1000"));
+        }
+
+        int RunMidiCppConsole(string arguments)
+        {
+            using (Process midiCppConsoleProcess = Process.Start(GetMidiCppConsoleFilePath(), arguments))
+            {
+                midiCppConsoleProcess.WaitForExit();
+
+                return midiCppConsoleProcess.ExitCode;
+            }
+        }
+
+        // Ctrl+C goes to every process attached to a console: join process's
+        // console, ignore Ctrl+C here until process has ended, then leave
+        void SendCtrlC(Process process)
+        {
+            const uint CtrlCEvent = 0;
+
+            FreeConsole();
+            Assert.IsTrue(AttachConsole((uint)process.Id));
+            SetConsoleCtrlHandler(IntPtr.Zero, true);
+            try
+            {
+                Assert.IsTrue(GenerateConsoleCtrlEvent(CtrlCEvent, 0));
+                process.WaitForExit(5000);
+            }
+            finally
+            {
+                FreeConsole();
+                SetConsoleCtrlHandler(IntPtr.Zero, false);
+            }
+        }
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        static extern bool AttachConsole(uint processId);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        static extern bool FreeConsole();
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        static extern bool SetConsoleCtrlHandler(IntPtr handlerRoutine, bool add);
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        static extern bool GenerateConsoleCtrlEvent(uint ctrlEvent, uint processGroupId);
+
         string GetMidiCppConsoleFilePath()
         {
             // Sample TestContext.TestRunDirectory: